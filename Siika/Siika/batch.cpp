@@ -0,0 +1,374 @@
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "batch.h"
+#include "epd.h"
+#include "position.h"
+#include "resultcache.h"
+#include "san.h"
+#include "search.h"
+#include "tools.h"
+#include "uci.h"
+
+namespace Chess {
+
+	namespace {
+		struct Options {
+			std::string file = "-";
+			SearchParameters sp;
+			int threads = std::max(1u, std::thread::hardware_concurrency());
+			std::string cache;
+		};
+
+		// Without any limit analysis goes to this depth, and the suite
+		// solver gets this time per position
+		constexpr u32 DEFAULT_DEPTH = 6;
+		constexpr u64 DEFAULT_MOVETIME_MS = 1000;
+
+		bool parse_options(const std::vector<std::string>& args, Options& options, bool& limited) {
+			limited = false;
+			bool ok = true;
+			for (size_t i = 0; ok && i < args.size(); i++) {
+				const std::string& arg = args[i];
+				bool has_value = i + 1 < args.size();
+
+				if (arg == "depth" && has_value) {
+					ok = Tools::parse_integer(arg, args[++i], 1, MAX_SEARCH_DEPTH, options.sp.max_depth);
+					limited = true;
+				}
+				else if (arg == "nodes" && has_value) {
+					ok = Tools::parse_integer(arg, args[++i], 1, Tools::MAX_ARGUMENT, options.sp.max_nodes);
+					limited = true;
+				}
+				else if (arg == "movetime" && has_value) {
+					ok = Tools::parse_integer(arg, args[++i], 1, Tools::MAX_ARGUMENT, options.sp.max_search_time_ms);
+					limited = true;
+				}
+				else if (arg == "threads" && has_value) {
+					ok = Tools::parse_integer(arg, args[++i], 1, Tools::MAX_THREADS, options.threads);
+				}
+				else if (Tools::parse_engine_option(args, i, ok)) {
+					if (!ok) {
+						return false;
+					}
+				}
+				else if (arg == "cache" && has_value) {
+					options.cache = args[++i];
+				}
+				else if (i == 0) {
+					options.file = arg;
+				}
+				else {
+					std::cerr << "Unknown argument " << arg << "\n";
+					return false;
+				}
+			}
+			return ok;
+		}
+
+		typedef std::function<std::string(Tools::Worker& worker, const std::string& line, size_t index)> Job;
+
+		// Lines are handed out to the threads as they become free, and the
+		// results are written in input order as soon as all before them are
+		void run_ordered(std::istream& in, std::ostream& out, int threads, const Job& job) {
+			std::mutex in_mutex, out_mutex;
+			size_t next_index = 0, next_output = 0;
+			std::map<size_t, std::string> pending;
+
+			auto work = [&]() {
+				Tools::Worker worker;
+				while (true) {
+					std::string line;
+					size_t index;
+					{
+						std::lock_guard<std::mutex> lock(in_mutex);
+						if (!std::getline(in, line)) {
+							return;
+						}
+						index = next_index++;
+					}
+
+					std::string result = job(worker, line, index);
+
+					std::lock_guard<std::mutex> lock(out_mutex);
+					pending[index] = result;
+					for (auto it = pending.find(next_output); it != pending.end(); it = pending.find(++next_output)) {
+						if (!it->second.empty()) {
+							out << it->second << std::endl;
+						}
+						pending.erase(it);
+					}
+				}
+			};
+
+			std::vector<std::thread> workers;
+			for (int i = 0; i < threads; i++) {
+				workers.emplace_back(work);
+			}
+			for (auto& worker : workers) {
+				worker.join();
+			}
+		}
+
+		std::string json_string(const std::string& s) {
+			std::ostringstream ss;
+			ss << '"';
+			for (const auto c : s) {
+				switch (c) {
+				case '"': ss << "\\\""; break;
+				case '\\': ss << "\\\\"; break;
+				case '\n': ss << "\\n"; break;
+				case '\t': ss << "\\t"; break;
+				default:
+					if (static_cast<unsigned char>(c) < 0x20) {
+						ss << "\\u00" << "0123456789abcdef"[c >> 4] << "0123456789abcdef"[c & 15];
+					}
+					else {
+						ss << c;
+					}
+				}
+			}
+			ss << '"';
+			return ss.str();
+		}
+
+		bool is_blank(const std::string& line) {
+			return line.find_first_not_of(" \t\r\n") == std::string::npos;
+		}
+
+		bool open_input(const std::string& name, std::ifstream& file) {
+			if (name != "-") {
+				file.open(name);
+				if (!file) {
+					std::cerr << "Could not open " << name << "\n";
+					return false;
+				}
+			}
+			return true;
+		}
+
+		bool limits_depth_only(const SearchParameters& sp) {
+			return sp.max_nodes == REALLY_BIG_NUMBER && sp.max_search_time_ms == REALLY_BIG_NUMBER;
+		}
+
+		std::string analyze_line(Tools::Worker& worker, const std::string& line, size_t index, const SearchParameters& sp, ResultCache& cache) {
+			if (is_blank(line)) {
+				return "";
+			}
+
+			std::ostringstream ss;
+			ss << "{\"index\":" << index;
+
+			EPD epd;
+			if (!epd.parse(line)) {
+				ss << ",\"error\":\"invalid EPD\"}";
+				return ss.str();
+			}
+			if (!worker.pos.set_legal(epd.fen)) {
+				ss << ",\"error\":\"invalid position\"}";
+				return ss.str();
+			}
+			SearchResult r;
+			bool cached = cache.is_open() && limits_depth_only(sp) && cache.probe(worker.pos, sp.max_depth, r);
+			if (!cached) {
+				r = worker.search.run(worker.pos, sp);
+				if (cache.is_open() && !r.tablebase_hit) {
+					cache.store(worker.pos, r);
+				}
+			}
+
+			if (!epd.operation("id").empty()) {
+				ss << ",\"id\":" << json_string(epd.operation("id"));
+			}
+			ss << ",\"fen\":" << json_string(epd.fen);
+			ss << ",\"depth\":" << r.depth << ",\"seldepth\":" << r.seldepth;
+			if (is_mate(r.value)) {
+				ss << ",\"score\":{\"mate\":" << mate_moves(r.value) << "}";
+			}
+			else {
+				ss << ",\"score\":{\"cp\":" << r.value << "}";
+			}
+			ss << ",\"bestmove\":\"" << UCI::move_to_string(r.bestmove) << "\"";
+			ss << ",\"pv\":[";
+			for (size_t i = 0; i < r.pv.size(); i++) {
+				ss << (i ? "," : "") << "\"" << UCI::move_to_string(r.pv[i]) << "\"";
+			}
+			ss << "],\"nodes\":" << r.nodes << ",\"time_ms\":" << r.time_us / 1000;
+			if (cached) {
+				ss << ",\"cached\":true";
+			}
+			ss << "}";
+			return ss.str();
+		}
+
+		struct Solution {
+			bool solved = false;
+			u64 time_us = 0;
+			u64 nodes = 0;
+		};
+
+		// Moves in SAN, or in coordinates as UCI writes them
+		bool parse_moves(Position& pos, const std::string& str, std::vector<Move>& moves) {
+			std::istringstream ss(str);
+			std::string token;
+			while (ss >> token) {
+				Move move = SAN::parse(pos, token);
+				if (move == NULLMOVE) {
+					move = UCI::parse_move(pos, token);
+				}
+				if (move == NULLMOVE) {
+					return false;
+				}
+				moves.push_back(move);
+			}
+			return true;
+		}
+
+		std::string solve_line(Tools::Worker& worker, const std::string& line, size_t index, const SearchParameters& sp, std::map<size_t, Solution>& solutions, std::mutex& mutex) {
+			if (is_blank(line)) {
+				return "";
+			}
+
+			std::ostringstream ss;
+			EPD epd;
+			if (!epd.parse(line)) {
+				ss << index << ": invalid EPD";
+				return ss.str();
+			}
+			Position& pos = worker.pos;
+			if (!pos.set_legal(epd.fen)) {
+				ss << index << ": invalid position";
+				return ss.str();
+			}
+
+			std::string name = epd.operation("id").empty() ? std::to_string(index) : epd.operation("id");
+			std::vector<Move> best, avoid;
+			std::string bm = epd.operation("bm"), am = epd.operation("am");
+			if ((bm.empty() && am.empty()) || !parse_moves(pos, bm, best) || !parse_moves(pos, am, avoid)) {
+				ss << name << ": no legal bm or am operation";
+				return ss.str();
+			}
+
+			auto is_right = [&best, &avoid](Move move) {
+				return (best.empty() || std::find(best.begin(), best.end(), move) != best.end())
+					&& std::find(avoid.begin(), avoid.end(), move) == avoid.end();
+			};
+
+			Solution solution;
+			bool was_right = false;
+			SearchResult r = worker.search.run(pos, sp, [&](const SearchResult& depth) {
+				bool right = is_right(depth.bestmove);
+				if (right && !was_right) {
+					solution.time_us = depth.time_us;
+					solution.nodes = depth.nodes;
+				}
+				was_right = right;
+			});
+			solution.solved = was_right && r.bestmove != NULLMOVE;
+
+			ss << name << ": ";
+			if (solution.solved) {
+				ss << "solved in " << solution.time_us / 1000 << " ms, " << solution.nodes << " nodes, " << SAN::to_string(pos, r.bestmove);
+			}
+			else {
+				ss << "failed, " << (r.bestmove == NULLMOVE ? "no move" : SAN::to_string(pos, r.bestmove));
+				ss << (bm.empty() ? "" : " bm " + bm) << (am.empty() ? "" : " am " + am);
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			solutions[index] = solution;
+			return ss.str();
+		}
+
+		template <typename T>
+		double median(std::vector<T> values) {
+			if (values.empty()) {
+				return 0.0;
+			}
+			std::sort(values.begin(), values.end());
+			size_t n = values.size();
+			return n % 2 ? static_cast<double>(values[n / 2]) : (values[n / 2 - 1] + values[n / 2]) / 2.0;
+		}
+	}
+
+	int Batch::analyze(const std::vector<std::string>& args) {
+		Options options;
+		bool limited;
+		if (!parse_options(args, options, limited)) {
+			std::cerr << "usage: Siika analyze [file|-] [depth N] [nodes N] [movetime MS] [threads N] [evalfile FILE] [tbpath DIR] [cache FILE]\n";
+			return 1;
+		}
+		if (!limited) {
+			options.sp.max_depth = DEFAULT_DEPTH;
+		}
+
+		std::ifstream file;
+		if (!open_input(options.file, file)) {
+			return 1;
+		}
+		std::istream& in = options.file == "-" ? std::cin : file;
+
+		ResultCache cache;
+		if (!options.cache.empty() && !cache.open(options.cache)) {
+			std::cerr << "Could not open " << options.cache << "\n";
+			return 1;
+		}
+
+		run_ordered(in, std::cout, options.threads, [&options, &cache](Tools::Worker& worker, const std::string& line, size_t index) {
+			return analyze_line(worker, line, index, options.sp, cache);
+		});
+		return 0;
+	}
+
+	int Batch::solve(const std::vector<std::string>& args) {
+		Options options;
+		bool limited;
+		// solving needs the search of every depth, which a cache does not keep
+		if (args.empty() || !parse_options(args, options, limited) || !options.cache.empty()) {
+			std::cerr << "usage: Siika solve <file|-> [movetime MS] [nodes N] [depth N] [threads N] [evalfile FILE] [tbpath DIR]\n";
+			return 1;
+		}
+		if (!limited) {
+			options.sp.max_search_time_ms = DEFAULT_MOVETIME_MS;
+		}
+
+		std::ifstream file;
+		if (!open_input(options.file, file)) {
+			return 1;
+		}
+		std::istream& in = options.file == "-" ? std::cin : file;
+
+		std::map<size_t, Solution> solutions;
+		std::mutex mutex;
+		Timer timer;
+		run_ordered(in, std::cout, options.threads, [&](Tools::Worker& worker, const std::string& line, size_t index) {
+			return solve_line(worker, line, index, options.sp, solutions, mutex);
+		});
+
+		std::vector<u64> times, nodes;
+		for (const auto& s : solutions) {
+			if (s.second.solved) {
+				times.push_back(s.second.time_us);
+				nodes.push_back(s.second.nodes);
+			}
+		}
+
+		std::cout << "Solved " << times.size() << " out of " << solutions.size();
+		if (!solutions.empty()) {
+			std::cout << " (" << std::fixed << std::setprecision(1) << 100.0 * times.size() / solutions.size() << "%)";
+		}
+		std::cout << "\n";
+		std::cout << "Median time to solution " << std::fixed << std::setprecision(1) << median(times) / 1000.0 << " ms, "
+			<< std::setprecision(0) << median(nodes) << " nodes\n";
+		std::cout << "Total time " << std::setprecision(2) << timer.get_elapsed_microseconds() / 1000000.0 << " s\n";
+		return 0;
+	}
+}
\ No newline at end of file
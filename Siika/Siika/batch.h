@@ -0,0 +1,31 @@
+#pragma once
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <string>
+#include <vector>
+
+namespace Chess {
+
+	// Command line jobs that search many positions on a pool of threads,
+	// each with its own position and search
+	namespace Batch {
+		// Siika analyze [file|-] [depth N] [nodes N] [movetime MS] [threads N]
+		//               [evalfile FILE] [tbpath DIR] [cache FILE]
+		// Writes one JSON line per position, in input order. With a result
+		// cache, positions searched deep enough before are not searched
+		// again when only the depth is limited, and new results are kept.
+		int analyze(const std::vector<std::string>& args);
+
+		// Siika solve <file|-> [movetime MS] [nodes N] [depth N] [threads N]
+		//             [evalfile FILE] [tbpath DIR]
+		// Searches the positions of a test suite with bm or am operations.
+		// A position is solved at the first depth from which on the best
+		// move stays right. Prints the solve rate and the median time and
+		// nodes to solution.
+		int solve(const std::vector<std::string>& args);
+	}
+}
+
+#endif // BATCH_H
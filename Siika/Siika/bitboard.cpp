@@ -4,8 +4,85 @@ namespace Chess {
 
 	std::array<Bitboard, SQUARE_COUNT> Bitboards::knight_attacks_;
 	std::array<Bitboard, SQUARE_COUNT> Bitboards::king_attacks_;
+	std::array<std::array<Bitboard, SQUARE_COUNT>, SQUARE_COUNT> Bitboards::between_;
+	std::array<std::array<Bitboard, SQUARE_COUNT>, SQUARE_COUNT> Bitboards::line_;
+	std::array<Bitboard, FILE_COUNT> Bitboards::adjacent_files_;
+	std::array<std::array<Bitboard, SQUARE_COUNT>, 2> Bitboards::forward_files_;
+	std::array<std::array<Bitboard, SQUARE_COUNT>, 2> Bitboards::pawn_attack_spans_;
+	std::array<std::array<Bitboard, SQUARE_COUNT>, 2> Bitboards::passed_pawn_masks_;
+	std::array<Bitboards::Magic, SQUARE_COUNT> Bitboards::bishop_magics_;
+	std::array<Bitboards::Magic, SQUARE_COUNT> Bitboards::rook_magics_;
+	LargeVector<Bitboard> Bitboards::slider_table_{ LargePageAllocator<Bitboard>("slider attacks") };
 	bool Bitboards::initialized_ = Bitboards::initialize();
 
+	template <int D1, int D2, int D3, int D4>
+	void Bitboards::init_magics(std::array<Magic, SQUARE_COUNT>& magics, Bitboard* table) {
+		// Seeds per rank that find a magic quickly, see Stockfish
+		constexpr u64 seeds[RANK_COUNT] = { 728, 10316, 55013, 32803, 12281, 15100, 16645, 255 };
+
+		std::array<Bitboard, 4096> occupancy, reference;
+		std::array<int, 4096> epoch = { 0 };
+		int count = 0;
+
+		for (int s = A1; s < SQUARE_COUNT; s++) {
+			Bitboard b = make(s);
+			auto attacks = [b](Bitboard empty) {
+				return ray<D1>(b, empty) | ray<D2>(b, empty) | ray<D3>(b, empty) | ray<D4>(b, empty);
+			};
+
+			// board edges are not relevant for the occupancy unless the slider is on them
+			Bitboard edges =
+				((RANK_1 | RANK_8) & ~(RANK_1 << (8 * square_rank(s)))) |
+				((FILE_A | FILE_H) & ~(FILE_A << square_file(s)));
+
+			Magic& m = magics[s];
+			m.mask = attacks(ALL) & ~edges;
+			m.shift = 64 - popcount(m.mask);
+			m.attacks = s == A1 ? table : magics[s - 1].attacks + (ONE << (64 - magics[s - 1].shift));
+
+			// enumerate all subsets of the mask (Carry-Rippler)
+			int size = 0;
+			Bitboard occupied = EMPTY;
+			do {
+				occupancy[size] = occupied;
+				reference[size] = attacks(~occupied);
+				size++;
+				occupied = (occupied - m.mask) & m.mask;
+			} while (occupied);
+
+			u64 state = seeds[square_rank(s)];
+			auto sparse_random = [&state]() {
+				u64 r = ALL;
+				for (int i = 0; i < 3; i++) {
+					state ^= state >> 12;
+					state ^= state << 25;
+					state ^= state >> 27;
+					r &= state * 2685821657736338717ULL;
+				}
+				return r;
+			};
+
+			for (int i = 0; i < size;) {
+				do {
+					m.magic = sparse_random();
+				} while (popcount((m.magic * m.mask) >> 56) < 6);
+
+				// epoch marks the table entries written during this attempt
+				for (++count, i = 0; i < size; i++) {
+					unsigned idx = m.index(occupancy[i]);
+					if (epoch[idx] < count) {
+						epoch[idx] = count;
+						m.attacks[idx] = reference[i];
+					}
+					else if (m.attacks[idx] != reference[i]) {
+						break;
+					}
+				}
+			}
+		}
+	}
+
+
 	bool Bitboards::initialize() {
 		for (int i = 0; i < 64; i++) {
 			auto b = make(i);
@@ -33,6 +110,43 @@ namespace Chess {
 			king_attacks_[i] |= shift<NORTHWEST>(b);
 		}
 
+		slider_table_.assign(BISHOP_TABLE_SIZE + ROOK_TABLE_SIZE, 0);
+		init_magics<NORTHEAST, SOUTHEAST, SOUTHWEST, NORTHWEST>(bishop_magics_, slider_table_.data());
+		init_magics<NORTH, EAST, SOUTH, WEST>(rook_magics_, slider_table_.data() + BISHOP_TABLE_SIZE);
+
+		for (int s1 = A1; s1 < SQUARE_COUNT; s1++) {
+			for (int s2 = A1; s2 < SQUARE_COUNT; s2++) {
+				between_[s1][s2] = line_[s1][s2] = EMPTY;
+				if (s1 == s2) {
+					continue;
+				}
+
+				if (bishop_attacks(s1, ALL) & make(s2)) {
+					between_[s1][s2] = bishop_attacks(s1, ~make(s2)) & bishop_attacks(s2, ~make(s1));
+					line_[s1][s2] = (bishop_attacks(s1, ALL) & bishop_attacks(s2, ALL)) | make(s1) | make(s2);
+				}
+				else if (rook_attacks(s1, ALL) & make(s2)) {
+					between_[s1][s2] = rook_attacks(s1, ~make(s2)) & rook_attacks(s2, ~make(s1));
+					line_[s1][s2] = (rook_attacks(s1, ALL) & rook_attacks(s2, ALL)) | make(s1) | make(s2);
+				}
+			}
+		}
+
+		for (int f = 0; f < FILE_COUNT; f++) {
+			Bitboard file = FILE_A << f;
+			adjacent_files_[f] = shift<EAST>(file) | shift<WEST>(file);
+		}
+
+		for (int s = A1; s < SQUARE_COUNT; s++) {
+			forward_files_[0][s] = ray<NORTH>(make(s), ALL);
+			forward_files_[1][s] = ray<SOUTH>(make(s), ALL);
+
+			for (int c = 0; c < 2; c++) {
+				Bitboard span = forward_files_[c][s];
+				pawn_attack_spans_[c][s] = shift<EAST>(span) | shift<WEST>(span);
+				passed_pawn_masks_[c][s] = forward_files_[c][s] | pawn_attack_spans_[c][s];
+			}
+		}
 
 		return true;
 	}
@@ -43,6 +43,17 @@ namespace Chess {
 		static int lsb(Bitboard b);
 		static int pop(Bitboard& b);
 		static int popcount(Bitboard b);
+		static bool more_than_one(Bitboard b);
+
+		static Bitboard between(int from, int to);
+		static Bitboard line(int from, int to);
+		static bool aligned(int s1, int s2, int s3);
+
+		// Pawn structure masks, color is WHITE or BLACK
+		static Bitboard adjacent_files(int square);
+		static Bitboard forward_file(int color, int square);
+		static Bitboard pawn_attack_span(int color, int square);
+		static Bitboard passed_pawn_mask(int color, int square);
 
 		template <int D>
 		static Bitboard shift(Bitboard b);
@@ -55,7 +66,10 @@ namespace Chess {
 		static Bitboard knight_attacks(Bitboard b);
 		static Bitboard knight_attacks(int square);
 		static Bitboard bishop_attacks(Bitboard b, Bitboard empty);
+		static Bitboard bishop_attacks(int square, Bitboard empty);
 		static Bitboard rook_attacks(Bitboard b, Bitboard empty);
+		static Bitboard rook_attacks(int square, Bitboard empty);
+		static Bitboard queen_attacks(int square, Bitboard empty);
 		static Bitboard king_attacks(Bitboard b);
 		static Bitboard king_attacks(int square);
 
@@ -64,10 +78,37 @@ namespace Chess {
 	private: // methods
 		static bool initialize();
 
+		// Magic bitboard lookup for slider attacks
+		struct Magic {
+			Bitboard mask;
+			Bitboard magic;
+			Bitboard* attacks;
+			int shift;
+
+			unsigned index(Bitboard occupied) const;
+		};
+
+		template <int D1, int D2, int D3, int D4>
+		static void init_magics(std::array<Magic, SQUARE_COUNT>& magics, Bitboard* table);
+
 	private:
 		static bool initialized_;
 		static std::array<Bitboard, SQUARE_COUNT> knight_attacks_;
 		static std::array<Bitboard, SQUARE_COUNT> king_attacks_;
+		static std::array<std::array<Bitboard, SQUARE_COUNT>, SQUARE_COUNT> between_;
+		static std::array<std::array<Bitboard, SQUARE_COUNT>, SQUARE_COUNT> line_;
+		static std::array<Bitboard, FILE_COUNT> adjacent_files_;
+		static std::array<std::array<Bitboard, SQUARE_COUNT>, 2> forward_files_;
+		static std::array<std::array<Bitboard, SQUARE_COUNT>, 2> pawn_attack_spans_;
+		static std::array<std::array<Bitboard, SQUARE_COUNT>, 2> passed_pawn_masks_;
+
+		static std::array<Magic, SQUARE_COUNT> bishop_magics_;
+		static std::array<Magic, SQUARE_COUNT> rook_magics_;
+
+		// The attacks of both, bishops first
+		static constexpr size_t BISHOP_TABLE_SIZE = 0x1480;
+		static constexpr size_t ROOK_TABLE_SIZE = 0x19000;
+		static LargeVector<Bitboard> slider_table_;
 	};
 
 	inline Bitboard Bitboards::make(int square) {
@@ -111,6 +152,43 @@ namespace Chess {
 		return n;
 	}
 
+	inline bool Bitboards::more_than_one(Bitboard b) {
+		return b & (b - 1);
+	}
+
+	// Squares strictly between two squares on a common line, or empty
+	inline Bitboard Bitboards::between(int from, int to) {
+		return between_[from][to];
+	}
+
+	// The whole line through two squares, or empty
+	inline Bitboard Bitboards::line(int from, int to) {
+		return line_[from][to];
+	}
+
+	inline bool Bitboards::aligned(int s1, int s2, int s3) {
+		return line(s1, s2) & make(s3);
+	}
+
+	inline Bitboard Bitboards::adjacent_files(int square) {
+		return adjacent_files_[square_file(square)];
+	}
+
+	// Squares in front of the square on its file
+	inline Bitboard Bitboards::forward_file(int color, int square) {
+		return forward_files_[color_index(color)][square];
+	}
+
+	// Squares in front of the square on the adjacent files
+	inline Bitboard Bitboards::pawn_attack_span(int color, int square) {
+		return pawn_attack_spans_[color_index(color)][square];
+	}
+
+	// A pawn is passed when no enemy pawn is on these squares
+	inline Bitboard Bitboards::passed_pawn_mask(int color, int square) {
+		return passed_pawn_masks_[color_index(color)][square];
+	}
+
 	template <int D>
 	Bitboard Bitboards::shift(Bitboard b) {
 		if (D == NORTH) { return b << 8; }
@@ -151,6 +229,24 @@ namespace Chess {
 		return king_attacks_[square];
 	}
 
+	inline unsigned Bitboards::Magic::index(Bitboard occupied) const {
+		return static_cast<unsigned>(((occupied & mask) * magic) >> shift);
+	}
+
+	inline Bitboard Bitboards::bishop_attacks(int square, Bitboard empty) {
+		const Magic& m = bishop_magics_[square];
+		return m.attacks[m.index(~empty)];
+	}
+
+	inline Bitboard Bitboards::rook_attacks(int square, Bitboard empty) {
+		const Magic& m = rook_magics_[square];
+		return m.attacks[m.index(~empty)];
+	}
+
+	inline Bitboard Bitboards::queen_attacks(int square, Bitboard empty) {
+		return bishop_attacks(square, empty) | rook_attacks(square, empty);
+	}
+
 }
 
 #endif // BITBOARD_H
@@ -0,0 +1,55 @@
+#pragma once
+
+#ifndef BOOK_H
+#define BOOK_H
+
+#include <string>
+
+#include "chess.h"
+#include "position.h"
+#include "util.h"
+
+namespace Chess {
+
+	// Opening book in the Polyglot format: 16 byte big-endian entries of
+	// key, move, weight and learn, sorted by key. The file is mapped and
+	// searched in place.
+	class Book {
+	public:
+		bool open(const std::string& file);
+		void close();
+		bool is_open() const;
+
+		// A legal book move picked at random by weight, or NULLMOVE
+		Move probe(Position& pos) const;
+
+		// Polyglot hash of the position, separate from the Zobrist hash
+		static u64 key(const Position& pos);
+
+		// Polyglot move encoding, castling as the king taking its rook
+		static u16 encode(Move move);
+		static Move decode(Position& pos, u16 move);
+
+	private:
+		struct Entry {
+			u64 key;
+			u16 move;
+			u16 weight;
+			u32 learn;
+		};
+
+		static constexpr size_t ENTRY_SIZE = 16;
+
+		Entry entry(size_t i) const;
+		size_t lower_bound(u64 key) const;
+
+		MappedFile file_;
+		size_t count_ = 0;
+	};
+
+	inline bool Book::is_open() const {
+		return count_ > 0;
+	}
+}
+
+#endif // BOOK_H
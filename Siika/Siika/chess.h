@@ -91,6 +91,7 @@ namespace Chess {
 	};
 
 	constexpr int color_flip(int color) { return color ^ BLACK; }
+	constexpr int color_index(int color) { return color >> 3; }
 
 	constexpr int make_square(int rank, int file) { return (rank << 3) + file; }
 	constexpr int square_rank(int square) { return square >> 3; }
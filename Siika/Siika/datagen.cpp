@@ -0,0 +1,281 @@
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+
+#include "datagen.h"
+#include "eval.h"
+#include "packed.h"
+#include "search.h"
+#include "tools.h"
+
+namespace Chess {
+
+	namespace {
+		struct Options {
+			std::string file;
+			u64 games = 1000;
+			int threads = std::max(1u, std::thread::hardware_concurrency());
+			SearchParameters sp;
+			bool limited = false;
+			int random_plies = 8;
+			u64 seed = 1;
+			bool resume = false;
+		};
+
+		constexpr int MAX_RANDOM_PLIES = 40;
+
+		// The output is flushed and the progress saved this often
+		constexpr u64 CHECKPOINT_GAMES = 100;
+
+		bool parse_options(const std::vector<std::string>& args, Options& options) {
+			bool ok = true;
+			for (size_t i = 0; ok && i < args.size(); i++) {
+				const std::string& arg = args[i];
+				bool has_value = i + 1 < args.size();
+
+				if (arg == "games" && has_value) {
+					ok = Tools::parse_integer(arg, args[++i], 1, Tools::MAX_ARGUMENT, options.games);
+				}
+				else if (arg == "threads" && has_value) {
+					ok = Tools::parse_integer(arg, args[++i], 1, Tools::MAX_THREADS, options.threads);
+				}
+				else if (arg == "depth" && has_value) {
+					ok = Tools::parse_integer(arg, args[++i], 1, MAX_SEARCH_DEPTH, options.sp.max_depth);
+					options.limited = true;
+				}
+				else if (arg == "nodes" && has_value) {
+					ok = Tools::parse_integer(arg, args[++i], 1, Tools::MAX_ARGUMENT, options.sp.max_nodes);
+					options.limited = true;
+				}
+				else if (arg == "random" && has_value) {
+					ok = Tools::parse_integer(arg, args[++i], 0, MAX_RANDOM_PLIES, options.random_plies);
+				}
+				else if (arg == "seed" && has_value) {
+					ok = Tools::parse_integer(arg, args[++i], 0, Tools::MAX_ARGUMENT, options.seed);
+				}
+				else if (Tools::parse_engine_option(args, i, ok)) {
+					if (!ok) {
+						return false;
+					}
+				}
+				else if (arg == "resume") {
+					options.resume = true;
+				}
+				else if (i == 0) {
+					options.file = arg;
+				}
+				else {
+					std::cerr << "Unknown argument " << arg << "\n";
+					return false;
+				}
+			}
+			if (!options.limited) {
+				options.sp.max_nodes = Tools::DEFAULT_NODES;
+			}
+			return ok && !options.file.empty();
+		}
+
+		// Games finished and records written as of the last checkpoint
+		struct Progress {
+			u64 games = 0;
+			u64 records = 0;
+		};
+
+		std::string progress_path(const std::string& file) {
+			return file + ".progress";
+		}
+
+		bool read_progress(const std::string& file, Progress& progress) {
+			std::ifstream in(progress_path(file));
+			std::string token;
+			while (in >> token) {
+				if (token == "games") {
+					in >> progress.games;
+				}
+				else if (token == "records") {
+					in >> progress.records;
+				}
+			}
+			return !in.bad() && in.eof();
+		}
+
+		bool write_progress(const std::string& file, const Progress& progress) {
+			std::ofstream out(progress_path(file));
+			out << "games " << progress.games << "\nrecords " << progress.records << "\n";
+			return out.good();
+		}
+
+		u64 file_size(const std::string& file) {
+			std::ifstream in(file, std::ios::binary | std::ios::ate);
+			return in ? static_cast<u64>(in.tellg()) : 0;
+		}
+
+		u64 mix(u64 x) {
+			x += 0x9E3779B97F4A7C15;
+			x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9;
+			x = (x ^ (x >> 27)) * 0x94D049BB133111EB;
+			return x ^ (x >> 31);
+		}
+
+		// A thread's search and its own random openings
+		struct Worker : Tools::Worker {
+			std::mt19937_64 rng;
+
+			explicit Worker(u64 seed) : rng(seed) {
+			}
+		};
+
+		// Random plies from the initial position, again until the side to
+		// move has a move
+		void random_opening(Worker& worker, Position& game, int plies) {
+			while (true) {
+				game.set_default();
+				bool ok = true;
+				for (int i = 0; i < plies && ok; i++) {
+					auto moves = game.legal_moves();
+					ok = !moves.empty();
+					if (ok) {
+						game.do_move(moves[worker.rng() % moves.size()]);
+					}
+				}
+				if (ok && !game.legal_moves().empty()) {
+					return;
+				}
+			}
+		}
+
+		void play_game(Worker& worker, const Options& options, std::vector<TrainingRecord>& records) {
+			records.clear();
+			Position game;
+			random_opening(worker, game, options.random_plies);
+
+			// for white
+			int result = 0;
+			for (int ply = 0; ; ply++) {
+				std::string reason;
+				int points;
+				if (Tools::is_game_over(game, game.legal_moves(), ply, reason, points)) {
+					result = points - 1;
+					break;
+				}
+
+				worker.pos = game;
+				SearchResult r = worker.search.run(worker.pos, options.sp);
+				if (r.bestmove == NULLMOVE) {
+					break;
+				}
+				// a found mate decides the game
+				if (is_mate(r.value)) {
+					result = (r.value > 0) == (game.turn() == WHITE) ? 1 : -1;
+					break;
+				}
+
+				Move move = r.bestmove;
+				bool noisy = game.piece_on(move_to(move)) != NO_PIECE || move_flags(move) == EN_PASSANT_CAPTURE || is_promotion(move);
+				TrainingRecord record = TrainingRecord();
+				if (!noisy && !game.is_in_check() && game.pack(record.pos)) {
+					record.score = static_cast<i16>(std::min(std::max(r.value, -32000), 32000));
+					records.push_back(record);
+				}
+				game.do_move(move);
+			}
+
+			for (auto& record : records) {
+				record.result = static_cast<i8>(record.pos.turn_and_castling & 1 ? -result : result);
+			}
+		}
+
+		void print_status(const Progress& progress, const Options& options, u64 positions, double seconds) {
+			double rate = positions / std::max(seconds, 1e-6);
+			std::cout << "Games " << progress.games << "/" << options.games << ", positions " << progress.records
+				<< std::fixed << std::setprecision(0) << ", " << rate << " positions/s, "
+				<< rate / options.threads << " per thread" << std::endl;
+		}
+	}
+
+	int Datagen::run(const std::vector<std::string>& args) {
+		Options options;
+		if (!parse_options(args, options)) {
+			std::cerr << "usage: Siika datagen <out> [games N] [threads N] [depth N] [nodes N] [random N] [seed N]"
+				" [evalfile FILE] [tbpath DIR] [resume]\n";
+			return 1;
+		}
+
+		// Games since the last checkpoint are played again, so the records
+		// written after it are cut off. The output is flushed before the
+		// progress is saved and so holds at least the checkpointed records.
+		Progress progress;
+		if (options.resume) {
+			if (!read_progress(options.file, progress)) {
+				std::cerr << "Could not read " << progress_path(options.file) << "\n";
+				return 1;
+			}
+			u64 size = progress.records * sizeof(TrainingRecord);
+			if (file_size(options.file) < size) {
+				std::cerr << options.file << " is shorter than its " << progress.records << " checkpointed positions\n";
+				return 1;
+			}
+			if (!truncate_file(options.file, size)) {
+				std::cerr << "Could not truncate " << options.file << "\n";
+				return 1;
+			}
+			std::cout << "Resuming after " << progress.games << " games, " << progress.records << " positions" << std::endl;
+		}
+
+		RecordWriter<TrainingRecord> writer;
+		if (!writer.open(options.file, options.resume) || !write_progress(options.file, progress)) {
+			std::cerr << "Could not write " << options.file << "\n";
+			return 1;
+		}
+
+		// another seed for each session, so that a resumed run does not
+		// play the same openings again
+		const u64 session_seed = mix(options.seed ^ mix(progress.games));
+		std::atomic<u64> next_game{ progress.games };
+		std::mutex mutex;
+		u64 positions = 0;
+		bool ok = true;
+		Timer timer;
+
+		auto work = [&](int thread) {
+			Worker worker(mix(session_seed + thread));
+			std::vector<TrainingRecord> records;
+			while (next_game++ < options.games) {
+				play_game(worker, options, records);
+
+				std::lock_guard<std::mutex> lock(mutex);
+				for (const auto& record : records) {
+					writer.write(record);
+				}
+				progress.games++;
+				progress.records += records.size();
+				positions += records.size();
+				if (progress.games % CHECKPOINT_GAMES == 0) {
+					ok = writer.flush() && write_progress(options.file, progress) && ok;
+					print_status(progress, options, positions, timer.get_elapsed_microseconds() / 1000000.0);
+				}
+			}
+		};
+
+		std::vector<std::thread> workers;
+		for (int i = 0; i < options.threads; i++) {
+			workers.emplace_back(work, i);
+		}
+		for (auto& worker : workers) {
+			worker.join();
+		}
+
+		ok = writer.close() && write_progress(options.file, progress) && ok;
+		if (!ok) {
+			std::cerr << "Could not write " << options.file << "\n";
+			return 1;
+		}
+		print_status(progress, options, positions, timer.get_elapsed_microseconds() / 1000000.0);
+		return 0;
+	}
+}
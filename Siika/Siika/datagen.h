@@ -0,0 +1,40 @@
+#pragma once
+
+#ifndef DATAGEN_H
+#define DATAGEN_H
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include "chess.h"
+#include "position.h"
+
+namespace Chess {
+
+	// A scored position for training. The score and the result are from the
+	// side to move's point of view, the result 1 for a win, 0 for a draw
+	// and -1 for a loss.
+	struct TrainingRecord {
+		PackedPosition pos;
+		i16 score;
+		i8 result;
+		std::array<u8, 5> unused;
+	};
+
+	static_assert(sizeof(TrainingRecord) == 40, "TrainingRecord should be 40 bytes");
+
+	// Self-play games for training data, played concurrently with a
+	// position and a search per thread
+	namespace Datagen {
+		// Siika datagen <out> [games N] [threads N] [depth N] [nodes N]
+		//               [random N] [seed N] [evalfile FILE] [tbpath DIR] [resume]
+		// Each game starts with random plies and goes on with the best move
+		// of a search. Positions in check and those where the best move
+		// captures or promotes are left out. Progress is kept next to the
+		// output in <out>.progress, and resume goes on from it.
+		int run(const std::vector<std::string>& args);
+	}
+}
+
+#endif // DATAGEN_H
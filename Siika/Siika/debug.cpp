@@ -3,8 +3,18 @@
 #include <algorithm>
 #include <chrono>
 #include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <utility>
 
 #include "debug.h"
+#include "uci.h"
+#include "pawns.h"
+#include "nnue.h"
+#include "tablebase.h"
+#include "book.h"
+#include "san.h"
 #include <iomanip>
 
 namespace Chess {
@@ -66,23 +76,29 @@ namespace Chess {
 			return os.str();
 		}
 
+		template <int M>
 		unsigned long long perft(Position& pos, int depth) {
 			if (depth <= 0) {
 				return 1;
 			}
 
 			unsigned long long nodes = 0;
+			Position::Board snapshot;
 			for (const auto move : pos.legal_moves()) {
-				pos.do_move(move);
-				unsigned long long move_nodes = perft(pos, depth - 1);
+				pos.do_move<M>(move, snapshot);
+				unsigned long long move_nodes = perft<M>(pos, depth - 1);
 
 				nodes += move_nodes;
-				pos.undo_move(move);
+				pos.undo_move<M>(move, snapshot);
 			}
 
 			return nodes;
 		}
-		void perft_suite(const std::string& file) {
+
+		template unsigned long long perft<MAKE_UNMAKE>(Position& pos, int depth);
+		template unsigned long long perft<COPY_MAKE>(Position& pos, int depth);
+
+		void perft_suite(const std::string& file, int max_depth, int mode) {
 			std::ifstream ifs(file.c_str());
 
 			if (!ifs.good()) {
@@ -123,8 +139,11 @@ namespace Chess {
 					int depth = 0;
 					unsigned long long nodes = 0;
 					ss >> depth >> nodes;
+					if (depth > max_depth) {
+						continue;
+					}
 
-					auto result = perft(pos, depth);
+					auto result = mode == COPY_MAKE ? perft<COPY_MAKE>(pos, depth) : perft<MAKE_UNMAKE>(pos, depth);
 					std::cout << "perft(" << depth << "): " << result << " (" << nodes << ")\n";
 					total_nodes += result;
 					if (result != nodes) {
@@ -156,5 +175,551 @@ namespace Chess {
 
 
 		}
+	
+		void see_suite(const std::string& file) {
+			std::ifstream ifs(file.c_str());
+
+			if (!ifs.good()) {
+				return;
+			}
+
+			std::vector<std::string> incorrect;
+			std::string line;
+			int correct = 0, total = 0;
+
+			Position pos;
+
+			while (std::getline(ifs, line)) {
+				std::string fen, movestr;
+				Value expected = 0;
+
+				std::istringstream iss(line);
+				std::getline(iss, fen, ';');
+				iss >> movestr >> expected;
+				pos.set(fen);
+
+				Move move = UCI::parse_move(pos, movestr);
+				Value result = pos.see(move);
+				bool ok = move != NULLMOVE && result == expected &&
+					pos.see_ge(move, expected) && !pos.see_ge(move, expected + 1);
+
+				std::cout << "FEN: " << fen << "\n";
+				std::cout << "see(" << movestr << "): " << result << " (" << expected << ")\n";
+				if (ok) {
+					correct++;
+				}
+				else {
+					incorrect.push_back(fen + " " + movestr);
+				}
+				total++;
+			}
+
+			std::cout << correct << " out of " << total << " correct.\n";
+
+			for (const auto& c : incorrect) {
+				std::cout << "Incorrect: " << c << "\n";
+			}
+		}
+	
+		// Checks is_pseudo_legal and is_legal against the generator and against
+		// make/unmake for every possible 16-bit move, and the generation types and
+		// gives_check against the full move list, in the positions up to depth
+		// plies from the suite
+		static bool check_legality(Position& pos, int depth) {
+			auto moves = pos.legal_moves();
+			std::vector<bool> generated(1 << 16, false);
+			for (const auto move : moves) {
+				generated[move] = true;
+			}
+
+			for (int m = 0; m < (1 << 16); m++) {
+				Move move = static_cast<Move>(m);
+				bool pseudo_legal = pos.is_pseudo_legal(move);
+				bool legal = pseudo_legal && pos.is_legal(move);
+
+				bool made_legal = false;
+				if (pseudo_legal) {
+					pos.do_move(move);
+					made_legal = !pos.is_in_check(pos.opponent());
+					pos.undo_move(move);
+				}
+
+				if (legal != generated[move] || legal != made_legal) {
+					std::cout << "Mismatch: " << UCI::move_to_string(move) << " (flags " << std::hex << move_flags(move) << std::dec << ") in " << pos.fen() << "\n";
+					return false;
+				}
+			}
+
+			// generation types against the full move list
+			auto as_set = [](std::vector<Move> v) { std::sort(v.begin(), v.end()); return v; };
+			auto captures = pos.legal_moves<CAPTURES>();
+			auto quiets = pos.legal_moves<QUIETS>();
+			std::vector<Move> split = captures;
+			split.insert(split.end(), quiets.begin(), quiets.end());
+
+			std::vector<Move> checks;
+			for (const auto move : quiets) {
+				if (pos.gives_check(move)) {
+					checks.push_back(move);
+				}
+			}
+
+			bool ok = as_set(split) == as_set(moves) && as_set(checks) == as_set(pos.legal_moves<QUIET_CHECKS>());
+			if (pos.is_in_check()) {
+				ok = ok && as_set(pos.legal_moves<EVASIONS>()) == as_set(moves);
+			}
+			for (const auto move : moves) {
+				bool gives_check = pos.gives_check(move);
+				pos.do_move(move);
+				ok = ok && gives_check == pos.is_in_check();
+				pos.undo_move(move);
+			}
+			if (!ok) {
+				std::cout << "Generation type mismatch in " << pos.fen() << "\n";
+				return false;
+			}
+
+			if (depth > 1) {
+				for (const auto move : moves) {
+					pos.do_move(move);
+					bool ok = check_legality(pos, depth - 1);
+					pos.undo_move(move);
+					if (!ok) {
+						return false;
+					}
+				}
+			}
+			return true;
+		}
+
+		void legality_suite(const std::string& file, int depth) {
+			std::ifstream ifs(file.c_str());
+
+			if (!ifs.good()) {
+				return;
+			}
+
+			std::string line;
+			int correct = 0, total = 0;
+
+			Position pos;
+
+			while (std::getline(ifs, line)) {
+				std::string fen;
+				std::istringstream iss(line);
+				std::getline(iss, fen, ';');
+				pos.set(fen);
+
+				if (check_legality(pos, depth)) {
+					correct++;
+				}
+				total++;
+			}
+
+			std::cout << correct << " out of " << total << " correct.\n";
+		}
+
+		// Checks the incremental piece-square score, phase and pawn key and the
+		// pawn table against a computation from scratch, and the lazy tiers
+		// against their margins, in the positions up to depth plies from the
+		// suite
+		static bool check_eval(Position& pos, int depth) {
+			if (pos.psq_score() != pos.calculate_psq_score() || pos.phase() != pos.calculate_phase()) {
+				std::cout << "Mismatch: psq " << pos.psq_score().mg << " " << pos.psq_score().eg << " phase " << pos.phase()
+					<< " (" << pos.calculate_psq_score().mg << " " << pos.calculate_psq_score().eg << " phase " << pos.calculate_phase() << ") in " << pos.fen() << "\n";
+				return false;
+			}
+
+			// the table entry against the pawn structure from scratch
+			Pawns::Entry* cached = Pawns::probe(pos);
+			Pawns::Entry fresh = Pawns::evaluate(pos);
+			if (pos.pawn_key() != pos.calculate_pawn_key() || cached->score != fresh.score
+				|| cached->passed[0] != fresh.passed[0] || cached->passed[1] != fresh.passed[1]
+				|| cached->king_shelter(pos, WHITE) != Pawns::shelter(pos, WHITE, pos.king_square(WHITE))
+				|| cached->king_shelter(pos, BLACK) != Pawns::shelter(pos, BLACK, pos.king_square(BLACK))) {
+				std::cout << "Pawn mismatch: key " << pos.pawn_key() << " (" << pos.calculate_pawn_key() << ") in " << pos.fen() << "\n";
+				return false;
+			}
+
+			Value full = evaluate_tier(pos, TIER_FULL);
+			for (EvalTier tier : { TIER_MATERIAL, TIER_PAWNS }) {
+				Value lazy = evaluate_tier(pos, tier);
+				if (std::abs(full - lazy) > lazy_margin(tier)) {
+					std::cout << "Tier " << tier << " is " << lazy << ", full " << full << " in " << pos.fen() << "\n";
+					return false;
+				}
+			}
+
+			if (depth > 0) {
+				for (const auto move : pos.legal_moves()) {
+					pos.do_move(move);
+					bool ok = check_eval(pos, depth - 1);
+					pos.undo_move(move);
+					if (!ok) {
+						return false;
+					}
+				}
+			}
+			return true;
+		}
+
+		void eval_suite(const std::string& file, int depth) {
+			std::ifstream ifs(file.c_str());
+
+			if (!ifs.good()) {
+				return;
+			}
+
+			std::string line;
+			int correct = 0, total = 0;
+
+			Position pos;
+
+			while (std::getline(ifs, line)) {
+				std::string fen;
+				std::istringstream iss(line);
+				std::getline(iss, fen, ';');
+				pos.set(fen);
+
+				if (check_eval(pos, depth)) {
+					correct++;
+				}
+				total++;
+			}
+
+			std::cout << correct << " out of " << total << " correct.\n";
+		}
+
+		// Checks the incrementally updated accumulator against a full refresh
+		// in the positions up to depth plies from the suite
+		static bool check_accumulator(Position& pos, NNUE::Accumulator& fresh, int depth) {
+			NNUE::refresh(pos, fresh);
+			if (std::memcmp(pos.accumulator(), &fresh, sizeof(fresh)) != 0) {
+				std::cout << "Accumulator mismatch in " << pos.fen() << "\n";
+				return false;
+			}
+
+			if (depth > 0) {
+				for (const auto move : pos.legal_moves()) {
+					pos.do_move(move);
+					bool ok = check_accumulator(pos, fresh, depth - 1);
+					pos.undo_move(move);
+					if (!ok) {
+						return false;
+					}
+				}
+			}
+			return true;
+		}
+
+		void nnue_suite(const std::string& file, int depth) {
+			std::ifstream ifs(file.c_str());
+
+			if (!ifs.good()) {
+				return;
+			}
+
+			if (!NNUE::is_loaded()) {
+				std::cout << "No network loaded, using random weights.\n";
+				NNUE::init_random(1);
+			}
+
+			std::string line;
+			int correct = 0, total = 0;
+
+			std::vector<NNUE::Accumulator> accumulators(MAX_PLYS);
+			NNUE::Accumulator fresh;
+			Position pos;
+			pos.attach(accumulators.data());
+
+			while (std::getline(ifs, line)) {
+				std::string fen;
+				std::istringstream iss(line);
+				std::getline(iss, fen, ';');
+				pos.set(fen);
+
+				if (check_accumulator(pos, fresh, depth)) {
+					correct++;
+				}
+				total++;
+			}
+
+			std::cout << correct << " out of " << total << " correct.\n";
+		}
+	
+		// A random legal position with up to the given number of pieces
+		void random_position(Position& pos, int max_pieces) {
+			constexpr int types[5] = { PAWN, KNIGHT, BISHOP, ROOK, QUEEN };
+
+			while (true) {
+				pos.set(PRNG::get_32() & 1 ? "8/8/8/8/8/8/8/8 w - - 0 1" : "8/8/8/8/8/8/8/8 b - - 0 1");
+				int pieces[Tablebases::MAX_PIECES] = { WHITE_KING, BLACK_KING };
+				int count = 3 + PRNG::get_32() % (max_pieces - 2);
+				for (int i = 2; i < count; i++) {
+					pieces[i] = make_piece(types[PRNG::get_32() % 5], PRNG::get_32() & 1 ? WHITE : BLACK);
+				}
+
+				bool ok = true;
+				for (int i = 0; i < count && ok; i++) {
+					int square = PRNG::get_32() % SQUARE_COUNT;
+					int rank = square_rank(square);
+					ok = pos.piece_on(square) == NO_PIECE && !(piece_type(pieces[i]) == PAWN && (rank == RANK_1 || rank == RANK_8));
+					if (ok) {
+						pos.put_piece(pieces[i], square);
+					}
+				}
+				if (ok && !pos.is_in_check(pos.opponent())) {
+					return;
+				}
+			}
+		}
+
+		// The best of the probed values after each move. With expand, a
+		// position that is not in the tables for its en passant square is
+		// searched one ply deeper.
+		bool best_child_value(Position& pos, int ply, bool expand, Value& value) {
+			auto moves = pos.legal_moves();
+			value = moves.empty() ? (pos.is_in_check() ? mate(ply) : STALEMATE) : VALUE_MIN;
+			for (const auto move : moves) {
+				Value child;
+				pos.do_move(move);
+				bool found = Tablebases::probe(pos, ply + 1, child)
+					|| (expand && pos.en_passant_square() != NO_SQUARE && best_child_value(pos, ply + 1, false, child));
+				pos.undo_move(move);
+				if (!found) {
+					return false;
+				}
+				value = std::max(value, -child);
+			}
+			return true;
+		}
+
+		bool check_tablebase(Position& pos, int& correct, int& total) {
+			Value value, expected;
+			if (!Tablebases::probe(pos, 0, value) || !best_child_value(pos, 0, true, expected)) {
+				return false;
+			}
+
+			if (value == expected) {
+				correct++;
+			}
+			else {
+				std::cout << "Incorrect: " << pos.fen() << " " << value << " expected " << expected << "\n";
+			}
+			total++;
+			return true;
+		}
+
+		// Every probed value should be the best of the values after each
+		// move, also where a double push allows an en passant capture
+		void tablebase_suite(int count) {
+			if (Tablebases::max_pieces() < 3) {
+				std::cout << "No tablebases loaded.\n";
+				return;
+			}
+
+			int correct = 0, total = 0;
+			Position pos;
+			PRNG::seed_32(1);
+
+			const char* positions[] = {
+				"8/2Kp4/8/2P3k1/8/8/8/8 b - - 0 1",
+				"8/8/8/7K/1p6/8/2P5/2k5 w - - 0 1"
+			};
+			for (const auto fen : positions) {
+				pos.set(fen);
+				check_tablebase(pos, correct, total);
+			}
+
+			for (int i = 0; i < count; i++) {
+				random_position(pos, Tablebases::max_pieces());
+				check_tablebase(pos, correct, total);
+			}
+
+			std::cout << correct << " out of " << total << " correct.\n";
+		}
+	
+		// Book moves should decode to the move that was encoded, keys should
+		// be those published with the Polyglot format, and a written book
+		// should give back its moves by weight
+		void book_suite(const std::string& file) {
+			std::ifstream ifs(file.c_str());
+
+			if (!ifs.good()) {
+				return;
+			}
+
+			std::string line;
+			int correct = 0, total = 0;
+			Position pos;
+
+			while (std::getline(ifs, line)) {
+				std::string fen;
+				std::istringstream iss(line);
+				std::getline(iss, fen, ';');
+				pos.set(fen);
+
+				bool ok = true;
+				for (const auto move : pos.legal_moves()) {
+					ok = ok && Book::decode(pos, Book::encode(move)) == move;
+				}
+				if (ok) {
+					correct++;
+				}
+				else {
+					std::cout << "Incorrect: " << fen << "\n";
+				}
+				total++;
+			}
+
+			const std::pair<const char*, u64> keys[] = {
+				{ "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 0x463b96181691fc9cULL },
+				{ "rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1", 0x823c9b50fd114196ULL },
+				{ "rnbqkbnr/ppp1pppp/8/3p4/4P3/8/PPPP1PPP/RNBQKBNR w KQkq d6 0 2", 0x0756b94461c50fb0ULL },
+				{ "rnbqkbnr/ppp1pppp/8/3pP3/8/8/PPPP1PPP/RNBQKBNR b KQkq - 0 2", 0x662fafb965db29d4ULL },
+				{ "rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3", 0x22a48b5a8e47ff78ULL },
+				{ "rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPPKPPP/RNBQ1BNR b kq - 0 3", 0x652a607ca3f242c1ULL },
+				{ "rnbq1bnr/ppp1pkpp/8/3pPp2/8/8/PPPPKPPP/RNBQ1BNR w - - 0 4", 0x00fdd303c946bdd9ULL },
+				{ "rnbqkbnr/p1pppppp/8/8/PpP4P/8/1P1PPPP1/RNBQKBNR b KQkq c3 0 3", 0x3c8123ea7b067637ULL },
+				{ "rnbqkbnr/p1pppppp/8/8/P6P/R1p5/1P1PPPP1/1NBQKBNR b Kkq - 0 4", 0x5c3f9b829b279560ULL },
+			};
+			for (const auto& k : keys) {
+				pos.set(k.first);
+				if (Book::key(pos) == k.second) {
+					correct++;
+				}
+				else {
+					std::cout << "Incorrect key: " << k.first << "\n";
+				}
+				total++;
+			}
+
+			// e2e4 three times as often as d2d4
+			const std::string book_file = "booksuite.bin";
+			pos.set_default();
+			Move moves[2] = { make_move(E2, E4, PAWN_DOUBLE_PUSH), make_move(D2, D4, PAWN_DOUBLE_PUSH) };
+			u16 weights[2] = { 3, 1 };
+			{
+				std::ofstream out(book_file, std::ios::binary);
+				for (int i = 0; i < 2; i++) {
+					u8 entry[16] = {};
+					u64 key = Book::key(pos);
+					u16 move = Book::encode(moves[i]);
+					for (int b = 0; b < 8; b++) {
+						entry[b] = static_cast<u8>(key >> (56 - 8 * b));
+					}
+					entry[8] = static_cast<u8>(move >> 8);
+					entry[9] = static_cast<u8>(move);
+					entry[11] = static_cast<u8>(weights[i]);
+					out.write(reinterpret_cast<const char*>(entry), sizeof(entry));
+				}
+			}
+
+			Book book;
+			int picks[2] = { 0, 0 };
+			bool ok = book.open(book_file);
+			for (int i = 0; i < 4000 && ok; i++) {
+				Move move = book.probe(pos);
+				ok = move == moves[0] || move == moves[1];
+				picks[move == moves[0] ? 0 : 1]++;
+			}
+			ok = ok && picks[0] > 2 * picks[1] && picks[0] < 4 * picks[1];
+			book.close();
+			std::remove(book_file.c_str());
+
+			if (ok) {
+				correct++;
+			}
+			else {
+				std::cout << "Incorrect: " << book_file << "\n";
+			}
+			total++;
+
+			std::cout << correct << " out of " << total << " correct.\n";
+		}
+	
+		// Every legal move should read back from its SAN, also without the
+		// capture and check marks
+		void san_suite(const std::string& file) {
+			std::ifstream ifs(file.c_str());
+
+			if (!ifs.good()) {
+				return;
+			}
+
+			std::string line;
+			int correct = 0, total = 0;
+			Position pos;
+
+			while (std::getline(ifs, line)) {
+				std::string fen;
+				std::istringstream iss(line);
+				std::getline(iss, fen, ';');
+				pos.set(fen);
+
+				bool ok = true;
+				for (const auto move : pos.legal_moves()) {
+					std::string san = SAN::to_string(pos, move);
+					std::string bare = san;
+					bare.erase(std::remove_if(bare.begin(), bare.end(), [](char c) { return c == 'x' || c == '+' || c == '#'; }), bare.end());
+					if (SAN::parse(pos, san) != move || SAN::parse(pos, bare) != move) {
+						std::cout << "Incorrect: " << fen << " " << san << "\n";
+						ok = false;
+					}
+				}
+				if (ok) {
+					correct++;
+				}
+				total++;
+			}
+
+			std::cout << correct << " out of " << total << " correct.\n";
+		}
+
+		// Each position and those after one move should unpack to the same
+		// position and hash
+		void pack_suite(const std::string& file) {
+			std::ifstream ifs(file.c_str());
+
+			if (!ifs.good()) {
+				return;
+			}
+
+			std::string line;
+			int correct = 0, total = 0;
+			Position pos, unpacked;
+			PackedPosition packed;
+
+			auto round_trip = [&]() {
+				if (!pos.pack(packed)) {
+					return false;
+				}
+				unpacked.set(packed);
+				return unpacked.fen() == pos.fen() && unpacked.hash() == pos.hash() && unpacked.pawn_key() == pos.pawn_key();
+			};
+
+			while (std::getline(ifs, line)) {
+				std::string fen;
+				std::istringstream iss(line);
+				std::getline(iss, fen, ';');
+				pos.set(fen);
+
+				bool ok = round_trip();
+				for (const auto move : pos.legal_moves()) {
+					pos.do_move(move);
+					if (!round_trip()) {
+						std::cout << "Incorrect: " << pos.fen() << "\n";
+						ok = false;
+					}
+					pos.undo_move(move);
+				}
+				if (ok) {
+					correct++;
+				}
+				total++;
+			}
+
+			std::cout << correct << " out of " << total << " correct.\n";
+		}
 	}
 }
\ No newline at end of file
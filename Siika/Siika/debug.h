@@ -14,8 +14,17 @@ namespace Chess {
 	namespace Debug {
 		std::string bitboard_to_string(Bitboard b);
 
+		template <int M = MAKE_UNMAKE>
 		unsigned long long perft(Position& pos, int depth);
-		void perft_suite(const std::string& file);
+		void perft_suite(const std::string& file, int max_depth = MAX_PLYS, int mode = MAKE_UNMAKE);
+		void see_suite(const std::string& file);
+		void legality_suite(const std::string& file, int depth);
+		void eval_suite(const std::string& file, int depth);
+		void nnue_suite(const std::string& file, int depth);
+		void tablebase_suite(int count);
+		void book_suite(const std::string& file);
+		void san_suite(const std::string& file);
+		void pack_suite(const std::string& file);
 	}
 }
 
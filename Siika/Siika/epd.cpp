@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+#include <vector>
+
+#include "epd.h"
+
+namespace Chess {
+
+	namespace {
+		bool is_number(const std::string& token) {
+			return !token.empty() && std::all_of(token.begin(), token.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)); });
+		}
+
+		std::string trim(const std::string& s) {
+			auto begin = s.find_first_not_of(" \t\r\n");
+			auto end = s.find_last_not_of(" \t\r\n");
+			return begin == std::string::npos ? "" : s.substr(begin, end - begin + 1);
+		}
+	}
+
+	bool EPD::parse(const std::string& line) {
+		fen.clear();
+		operations.clear();
+
+		std::istringstream ss(line);
+		std::vector<std::string> fields;
+		std::string token;
+		for (int i = 0; i < 4 && ss >> token; i++) {
+			fields.push_back(token);
+		}
+		if (fields.size() < 4) {
+			return false;
+		}
+
+		// the clocks, unless an operation follows right away
+		auto rest_start = ss.tellg();
+		for (int i = 0; i < 2; i++) {
+			auto before = ss.tellg();
+			if (!(ss >> token)) {
+				break;
+			}
+			if (!token.empty() && token.back() == ';') {
+				token.pop_back();
+			}
+			if (!is_number(token)) {
+				ss.clear();
+				ss.seekg(before);
+				break;
+			}
+			fields.push_back(token);
+			rest_start = ss.tellg();
+		}
+
+		for (const auto& field : fields) {
+			fen += field + " ";
+		}
+		fen.pop_back();
+
+		std::string rest = rest_start == std::streampos(-1) ? "" : line.substr(static_cast<size_t>(rest_start));
+		std::string op;
+		bool quoted = false;
+		for (const auto c : rest) {
+			if (c == '"') {
+				quoted = !quoted;
+			}
+			if (c == ';' && !quoted) {
+				op = trim(op);
+				auto space = op.find_first_of(" \t");
+				if (!op.empty()) {
+					std::string value = space == std::string::npos ? "" : trim(op.substr(space));
+					if (value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+						value = value.substr(1, value.size() - 2);
+					}
+					operations[op.substr(0, space)] = value;
+				}
+				op.clear();
+			}
+			else {
+				op += c;
+			}
+		}
+		return true;
+	}
+
+	std::string EPD::operation(const std::string& opcode) const {
+		auto it = operations.find(opcode);
+		return it == operations.end() ? "" : it->second;
+	}
+}
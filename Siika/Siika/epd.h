@@ -0,0 +1,23 @@
+#pragma once
+
+#ifndef EPD_H
+#define EPD_H
+
+#include <map>
+#include <string>
+
+namespace Chess {
+
+	// A line of an EPD file: the four FEN fields, the clocks if given, and
+	// the operations such as "bm Nf3; id \"test 1\";"
+	struct EPD {
+		std::string fen;
+		std::map<std::string, std::string> operations;
+
+		// Also accepts a plain FEN, optionally followed by ';'
+		bool parse(const std::string& line);
+		std::string operation(const std::string& opcode) const;
+	};
+}
+
+#endif // EPD_H
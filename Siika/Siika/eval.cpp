@@ -1,10 +1,171 @@
 #include "eval.h"
+#include "evalparams.h"
 #include <algorithm>
 
 
 namespace Chess {
-	
-	
+
+	size_t EvalCache::size_mb_ = 4;
+
+	// Rounded down to a power of two entries
+	EvalCache::EvalCache(size_t size_mb) : entries_(LargePageAllocator<Entry>("eval cache")), mask_(0), probes_(0), hits_(0) {
+		size_t count = size_mb * 1024 * 1024 / sizeof(Entry);
+		if (count > 0) {
+			size_t n = 1;
+			while (n * 2 <= count) {
+				n *= 2;
+			}
+			entries_.assign(n, { 0, 0 });
+			mask_ = n - 1;
+		}
+	}
+
+	namespace {
+		thread_local EvalCache* local_cache = nullptr;
+	}
+
+	EvalCache& EvalCache::local() {
+		if (local_cache) {
+			return *local_cache;
+		}
+		thread_local EvalCache cache(size_mb_);
+		return cache;
+	}
+
+	void EvalCache::set_local(EvalCache* cache) {
+		local_cache = cache;
+	}
+
+	void EvalCache::set_size(size_t size_mb) {
+		size_mb_ = size_mb;
+	}
+
+	EvalStats& EvalStats::local() {
+		thread_local EvalStats stats = {};
+		return stats;
+	}
+
+	namespace {
+		// The changes of the pawn tier and the full tier are clamped to
+		// these, so that a lazy exit is never further from the full
+		// evaluation than its margin
+		constexpr Value PAWN_TIER_LIMIT = 250;
+		constexpr Value FULL_TIER_LIMIT = 200;
+		constexpr Value LAZY_MARGIN_MATERIAL = PAWN_TIER_LIMIT + FULL_TIER_LIMIT;
+		constexpr Value LAZY_MARGIN_PAWNS = FULL_TIER_LIMIT;
+
+		Value clamp_tier(i32 change, Value limit) {
+			return std::max(-limit, std::min(change, limit));
+		}
+
+		// Typical mobility by piece type, the bonus is for squares above it
+		constexpr int mobility_base[PIECETYPE_COUNT] = {
+			0, 0, 4, 6, 6, 12, 0
+		};
+
+		template <int C>
+		Score mobility_and_king_attack(const Position& pos) {
+			constexpr int Them = color_flip(C);
+
+			Bitboard empty = pos.empty();
+			Bitboard excluded = pos.pieces(C) | Bitboards::pawn_attacks<Them>(pos.pieces(PAWN, Them));
+			int king = pos.king_square(Them);
+			Bitboard zone = Bitboards::king_attacks(king) | Bitboards::make(king);
+
+			Score score = { 0, 0 };
+			int units = 0, attackers = 0;
+
+			for (int pt = KNIGHT; pt <= QUEEN; pt++) {
+				Bitboard b = pos.pieces(pt, C);
+				while (b) {
+					int s = Bitboards::pop(b);
+					Bitboard attacks = pt == KNIGHT ? Bitboards::knight_attacks(s)
+						: pt == BISHOP ? Bitboards::bishop_attacks(s, empty)
+						: pt == ROOK ? Bitboards::rook_attacks(s, empty)
+						: Bitboards::queen_attacks(s, empty);
+
+					int mobility = Bitboards::popcount(attacks & ~excluded) - mobility_base[pt];
+					score += { eval_params.mobility[pt].mg * mobility, eval_params.mobility[pt].eg * mobility };
+
+					if (attacks & zone) {
+						units += eval_params.king_attack_units[pt];
+						attackers++;
+					}
+				}
+			}
+
+			// counted from two attackers on
+			if (attackers >= 2) {
+				score += { std::min(units * units * 2, eval_params.king_danger_max), 0 };
+			}
+
+			return score;
+		}
+
+		// Stops after the last tier, or earlier when the value is outside
+		// the window by more than the margin. exact is false when stopping
+		// before the full tier.
+		Value evaluate_classical(const Position& pos, Value alpha, Value beta, EvalTier last, bool& exact) {
+			EvalStats& stats = EvalStats::local();
+			int sign = pos.turn() == WHITE ? 1 : -1;
+			int phase = pos.phase();
+			exact = false;
+
+			Score score = pos.psq_score();
+			i32 tapered = PSQT::taper(score, phase);
+			Value value = pos.material_diff() + sign * tapered;
+			stats.reached[TIER_MATERIAL]++;
+			if (last == TIER_MATERIAL || value + LAZY_MARGIN_MATERIAL <= alpha || value - LAZY_MARGIN_MATERIAL >= beta) {
+				return value;
+			}
+
+			Pawns::Entry* pawns = Pawns::probe(pos);
+			score += pawns->score + pawns->king_shelter(pos, WHITE) - pawns->king_shelter(pos, BLACK);
+			i32 change = PSQT::taper(score, phase) - tapered;
+			tapered += change;
+			value += sign * clamp_tier(change, PAWN_TIER_LIMIT);
+			stats.reached[TIER_PAWNS]++;
+			if (last == TIER_PAWNS || value + LAZY_MARGIN_PAWNS <= alpha || value - LAZY_MARGIN_PAWNS >= beta) {
+				return value;
+			}
+
+			score += mobility_and_king_attack<WHITE>(pos) - mobility_and_king_attack<BLACK>(pos);
+			change = PSQT::taper(score, phase) - tapered;
+			value += sign * clamp_tier(change, FULL_TIER_LIMIT);
+			stats.reached[TIER_FULL]++;
+			exact = true;
+			return value;
+		}
+	}
+
+	Value evaluate_tier(const Position& pos, EvalTier tier) {
+		bool exact;
+		return evaluate_classical(pos, VALUE_MIN, VALUE_MAX, tier, exact);
+	}
+
+	Value lazy_margin(EvalTier tier) {
+		return tier == TIER_MATERIAL ? LAZY_MARGIN_MATERIAL : tier == TIER_PAWNS ? LAZY_MARGIN_PAWNS : 0;
+	}
+
+	// Repetitions depend on the path and are not cached, neither are early returns
+	Value evaluate(const Position& pos, Value alpha, Value beta) {
+		if (pos.is_3x_repeat()) {
+			return DRAW;
+		}
+
+		EvalCache& cache = EvalCache::local();
+		Value value;
+		if (cache.probe(pos.hash(), value)) {
+			return value;
+		}
+
+		bool exact = true;
+		value = pos.accumulator() ? NNUE::evaluate(pos) : evaluate_classical(pos, alpha, beta, TIER_FULL, exact);
+		if (exact) {
+			cache.store(pos.hash(), value);
+		}
+		return value;
+	}
 
 	void sort_moves(Position& pos, std::vector<Move>& moves) noexcept {
 		// sort moves based on MVV-LVA 
@@ -18,10 +179,10 @@ namespace Chess {
 			auto rhs_attacker = pos.piece_on(move_from(rhs));
 
 			if (lhs_captured != NO_PIECE) {
-				lhs_val = piecetype_values[lhs_captured] - piecetype_values[lhs_attacker] + 900;
+				lhs_val = piecetype_values[piece_type(lhs_captured)] - piecetype_values[piece_type(lhs_attacker)] + 900;
 			}
 			if (rhs_captured != NO_PIECE) {
-				rhs_val = piecetype_values[rhs_captured] - piecetype_values[rhs_attacker] + 900;
+				rhs_val = piecetype_values[piece_type(rhs_captured)] - piecetype_values[piece_type(rhs_attacker)] + 900;
 			}
 			
 			
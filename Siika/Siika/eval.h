@@ -7,6 +7,8 @@
 
 #include "chess.h"
 #include "position.h"
+#include "pawns.h"
+#include "nnue.h"
 
 namespace Chess {
 
@@ -18,14 +20,85 @@ namespace Chess {
 	constexpr i32 STALEMATE = 0;
 	constexpr i32 DRAW = 0;
 
-	inline Value evaluate(const Position& pos) {
-		if (pos.is_3x_repeat()) {
-			return DRAW;
+	// Direct-mapped cache of evaluations keyed by the position hash. Each
+	// thread has its own, sized when the thread first evaluates, unless
+	// another one is set for it.
+	class EvalCache {
+	public:
+		explicit EvalCache(size_t size_mb);
+
+		bool probe(u64 key, Value& value);
+		void store(u64 key, Value value);
+
+		u64 probes() const;
+		u64 hits() const;
+
+		static EvalCache& local();
+		static void set_size(size_t size_mb);
+
+		// local() returns cache on this thread, its own again after nullptr
+		static void set_local(EvalCache* cache);
+
+	private:
+		// The index bits of the key are implied by the slot
+		struct Entry {
+			u32 check;
+			Value value;
+		};
+
+		LargeVector<Entry> entries_;
+		u64 mask_;
+		u64 probes_;
+		u64 hits_;
+
+		static size_t size_mb_;
+	};
+
+	inline bool EvalCache::probe(u64 key, Value& value) {
+		if (entries_.empty()) {
+			return false;
 		}
+		probes_++;
+		const Entry& e = entries_[key & mask_];
+		if (e.check == static_cast<u32>(key >> 32)) {
+			hits_++;
+			value = e.value;
+			return true;
+		}
+		return false;
+	}
 
-		return pos.material_diff();
+	inline void EvalCache::store(u64 key, Value value) {
+		if (!entries_.empty()) {
+			entries_[key & mask_] = { static_cast<u32>(key >> 32), value };
+		}
 	}
 
+	inline u64 EvalCache::probes() const { return probes_; }
+	inline u64 EvalCache::hits() const { return hits_; }
+
+	// Evaluation tiers from cheap to expensive. The material tier is
+	// incremental, the pawn tier mostly a pawn table probe and the full
+	// tier adds mobility and king safety.
+	enum EvalTier { TIER_MATERIAL, TIER_PAWNS, TIER_FULL, TIER_COUNT };
+
+	// How many evaluations reached each tier, per thread
+	struct EvalStats {
+		u64 reached[TIER_COUNT];
+
+		static EvalStats& local();
+	};
+
+	// Returns early with a cheap estimate when it is outside the window by
+	// more than the remaining tiers can change it
+	Value evaluate(const Position& pos, Value alpha = VALUE_MIN, Value beta = VALUE_MAX);
+
+	// The classical evaluation as of a tier, without returning early
+	Value evaluate_tier(const Position& pos, EvalTier tier);
+
+	// How far the evaluation as of a tier may be from the full one
+	Value lazy_margin(EvalTier tier);
+
 	void sort_moves(Position& pos, std::vector<Move>& moves) noexcept;
 
 	constexpr Value mate(int plies_till_mate) {
@@ -45,6 +118,11 @@ namespace Chess {
 			return VALUE_MIN - value;
 		}
 	}
+
+	// Full moves to mate as UCI reports it, negative when getting mated
+	constexpr int mate_moves(Value value) {
+		return value > 0 ? (plies_till_mate(value) + 1) / 2 : plies_till_mate(value) / 2;
+	}
 }
 
 #endif // EVAL_H
\ No newline at end of file
@@ -0,0 +1,14 @@
+#include "evalparams.h"
+#include "tuned.h"
+
+namespace Chess {
+
+	static_assert(sizeof(TUNED_PARAMS) == sizeof(EvalParams), "tuned.h does not match EvalParams");
+
+	EvalParams eval_params;
+
+	EvalParams::EvalParams() {
+		int i = 0;
+		for_each([&i](const std::string&, i32& value) { value = TUNED_PARAMS[i++]; });
+	}
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#ifndef EVALPARAMS_H
+#define EVALPARAMS_H
+
+#include <string>
+
+#include "chess.h"
+#include "psqt.h"
+
+namespace Chess {
+
+	// Tunable evaluation weights. Every member is made of i32 so that the
+	// tuner can handle them as one list, in the order of for_each. The
+	// defaults come from tuned.h, which the tuner writes. Some entries are
+	// never read, such as passed pawns on the first and last rank or the
+	// mobility of pawns and kings, and for_each skips them if used_only.
+	struct EvalParams {
+		Score passed[RANK_COUNT];
+		Score isolated;
+		Score doubled;
+		Score backward;
+		Score shelter[3];
+		Score open_file;
+		Score mobility[PIECETYPE_COUNT];
+		i32 king_attack_units[PIECETYPE_COUNT];
+		i32 king_danger_max;
+
+		EvalParams();
+
+		template <typename F>
+		void for_each(F f, bool used_only = false);
+	};
+
+	// The weights the evaluation uses
+	extern EvalParams eval_params;
+
+	template <typename F>
+	void EvalParams::for_each(F f, bool used_only) {
+		auto score = [&f](const std::string& name, Score& s) {
+			f(name + ".mg", s.mg);
+			f(name + ".eg", s.eg);
+		};
+		auto is_piece = [used_only](int pt) {
+			return !used_only || (pt >= KNIGHT && pt <= QUEEN);
+		};
+
+		for (int r = RANK_1; r < RANK_COUNT; r++) {
+			if (!used_only || (r != RANK_1 && r != RANK_8)) {
+				score("passed[" + std::to_string(r) + "]", passed[r]);
+			}
+		}
+		score("isolated", isolated);
+		score("doubled", doubled);
+		score("backward", backward);
+		for (int i = 0; i < 3; i++) {
+			score("shelter[" + std::to_string(i) + "]", shelter[i]);
+		}
+		score("open_file", open_file);
+		for (int pt = NO_PIECETYPE; pt < PIECETYPE_COUNT; pt++) {
+			if (is_piece(pt)) {
+				score("mobility[" + std::to_string(pt) + "]", mobility[pt]);
+			}
+		}
+		for (int pt = NO_PIECETYPE; pt < PIECETYPE_COUNT; pt++) {
+			if (is_piece(pt)) {
+				f("king_attack_units[" + std::to_string(pt) + "]", king_attack_units[pt]);
+			}
+		}
+		f("king_danger_max", king_danger_max);
+	}
+}
+
+#endif // EVALPARAMS_H
@@ -1,4 +1,6 @@
 #include <iostream>
+#include <algorithm>
+#include <thread>
 
 #include "position.h"
 #include "bitboard.h"
@@ -6,10 +8,69 @@
 #include "debug.h"
 #include "eval.h"
 #include "util.h"
+#include "tune.h"
+#include "tablebase.h"
+#include "batch.h"
+#include "match.h"
+#include "pgn.h"
+#include "packed.h"
+#include "datagen.h"
+#include "server.h"
+#include "resultcache.h"
+#include "tt.h"
+#include "tools.h"
 
 using namespace Chess;
 
-int main() {
+int main(int argc, char* argv[]) {
+	std::vector<std::string> args(argv + 1, argv + argc);
+
+	if (!args.empty() && args[0] == "tune") {
+		return Tune::run({ args.begin() + 1, args.end() });
+	}
+	if (!args.empty() && args[0] == "analyze") {
+		return Batch::analyze({ args.begin() + 1, args.end() });
+	}
+	if (!args.empty() && args[0] == "solve") {
+		return Batch::solve({ args.begin() + 1, args.end() });
+	}
+	if (!args.empty() && args[0] == "pgn") {
+		return PGN::run({ args.begin() + 1, args.end() });
+	}
+	if (!args.empty() && args[0] == "pack") {
+		return Packed::pack({ args.begin() + 1, args.end() });
+	}
+	if (!args.empty() && args[0] == "unpack") {
+		return Packed::unpack({ args.begin() + 1, args.end() });
+	}
+	if (!args.empty() && args[0] == "datagen") {
+		return Datagen::run({ args.begin() + 1, args.end() });
+	}
+	if (!args.empty() && args[0] == "match") {
+		return Match::run({ args.begin() + 1, args.end() });
+	}
+	if (!args.empty() && args[0] == "cache") {
+		return ResultCache::run({ args.begin() + 1, args.end() });
+	}
+	if (!args.empty() && args[0] == "ttbench") {
+		return TranspositionTable::bench({ args.begin() + 1, args.end() });
+	}
+	if (!args.empty() && args[0] == "pagebench") {
+		return LargePages::bench({ args.begin() + 1, args.end() });
+	}
+	if (!args.empty() && args[0] == "server") {
+		return Server::run({ args.begin() + 1, args.end() });
+	}
+	if (!args.empty() && args[0] == "tbgen") {
+		// Siika tbgen [dir] [threads]
+		std::string dir = args.size() > 1 ? args[1] : ".";
+		int threads = std::max(1u, std::thread::hardware_concurrency());
+		if (args.size() > 2 && !Tools::parse_integer("threads", args[2], 1, Tools::MAX_THREADS, threads)) {
+			std::cerr << "usage: Siika tbgen [dir] [threads]\n";
+			return 1;
+		}
+		return Tablebases::generate(dir, threads) ? 0 : 1;
+	}
 
 	UCI::run();
 
@@ -0,0 +1,354 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#include "match.h"
+#include "epd.h"
+#include "eval.h"
+#include "nnue.h"
+#include "position.h"
+#include "search.h"
+#include "tools.h"
+
+namespace Chess {
+
+	namespace {
+		struct Engine {
+			std::string name;
+			SearchParameters sp;
+			bool limited = false;
+			int make_mode = MAKE_UNMAKE;
+			bool nnue = false;
+		};
+
+		struct Options {
+			std::string file;
+			size_t games = 1000;
+			int concurrency = std::max(1u, std::thread::hardware_concurrency());
+			double elo0 = 0.0, elo1 = 5.0;
+			double alpha = 0.05, beta = 0.05;
+			Engine engines[2];
+		};
+
+		// A status line after this many games
+		constexpr size_t REPORT_INTERVAL = 10;
+
+		// Bounds of the SPRT arguments
+		constexpr double MAX_ELO = 1000.0;
+		constexpr double MIN_ERROR_RATE = 0.001, MAX_ERROR_RATE = 0.5;
+
+		bool set_engine_option(Engine& engine, const std::string& key, const std::string& value) {
+			if (key == "name") {
+				engine.name = value;
+			}
+			else if (key == "depth") {
+				engine.limited = true;
+				return Tools::parse_integer(key, value, 1, MAX_SEARCH_DEPTH, engine.sp.max_depth);
+			}
+			else if (key == "nodes") {
+				engine.limited = true;
+				return Tools::parse_integer(key, value, 1, Tools::MAX_ARGUMENT, engine.sp.max_nodes);
+			}
+			else if (key == "movetime") {
+				engine.limited = true;
+				return Tools::parse_integer(key, value, 1, Tools::MAX_ARGUMENT, engine.sp.max_search_time_ms);
+			}
+			else if (key == "makemode" && (value == "copy" || value == "unmake")) {
+				engine.make_mode = value == "copy" ? COPY_MAKE : MAKE_UNMAKE;
+			}
+			else if (key == "eval" && (value == "classical" || value == "nnue")) {
+				engine.nnue = value == "nnue";
+			}
+			else {
+				std::cerr << "Unknown argument " << key << " " << value << "\n";
+				return false;
+			}
+			return true;
+		}
+
+		bool parse_options(const std::vector<std::string>& args, Options& options) {
+			options.engines[0].name = "A";
+			options.engines[1].name = "B";
+
+			std::vector<std::pair<std::string, std::string>> engine_options;
+			bool ok = true;
+			bool loaded = true;
+			for (size_t i = 0; ok && i < args.size(); i++) {
+				const std::string& arg = args[i];
+				bool has_value = i + 1 < args.size();
+
+				if (arg == "games" && has_value) {
+					ok = Tools::parse_integer(arg, args[++i], 1, Tools::MAX_ARGUMENT, options.games);
+				}
+				else if (arg == "concurrency" && has_value) {
+					ok = Tools::parse_integer(arg, args[++i], 1, Tools::MAX_THREADS, options.concurrency);
+				}
+				else if (arg == "elo0" && has_value) {
+					ok = Tools::parse_real(arg, args[++i], -MAX_ELO, MAX_ELO, options.elo0);
+				}
+				else if (arg == "elo1" && has_value) {
+					ok = Tools::parse_real(arg, args[++i], -MAX_ELO, MAX_ELO, options.elo1);
+				}
+				else if (arg == "alpha" && has_value) {
+					ok = Tools::parse_real(arg, args[++i], MIN_ERROR_RATE, MAX_ERROR_RATE, options.alpha);
+				}
+				else if (arg == "beta" && has_value) {
+					ok = Tools::parse_real(arg, args[++i], MIN_ERROR_RATE, MAX_ERROR_RATE, options.beta);
+				}
+				else if (Tools::parse_engine_option(args, i, loaded)) {
+					if (!loaded) {
+						return false;
+					}
+				}
+				else if (i == 0) {
+					options.file = arg;
+				}
+				else if (has_value) {
+					// applied once the network is known, so eval defaults to it
+					engine_options.emplace_back(arg, args[++i]);
+				}
+				else {
+					std::cerr << "Unknown argument " << arg << "\n";
+					return false;
+				}
+			}
+			if (!ok) {
+				return false;
+			}
+
+			for (auto& engine : options.engines) {
+				engine.nnue = NNUE::is_loaded();
+			}
+			for (const auto& option : engine_options) {
+				const std::string& key = option.first;
+				if (key.compare(0, 2, "a.") == 0 || key.compare(0, 2, "b.") == 0) {
+					ok = set_engine_option(options.engines[key[0] == 'a' ? 0 : 1], key.substr(2), option.second);
+				}
+				else if (key != "name") {
+					ok = set_engine_option(options.engines[0], key, option.second)
+						&& set_engine_option(options.engines[1], key, option.second);
+				}
+				else {
+					std::cerr << "Unknown argument " << key << " " << option.second << "\n";
+					ok = false;
+				}
+				if (!ok) {
+					return false;
+				}
+			}
+
+			for (auto& engine : options.engines) {
+				if (engine.nnue && !NNUE::is_loaded()) {
+					std::cerr << "Engine " << engine.name << " needs a network, give one with evalfile\n";
+					return false;
+				}
+				if (!engine.limited) {
+					engine.sp.max_nodes = Tools::DEFAULT_NODES;
+				}
+			}
+			return options.games > 0;
+		}
+
+		bool load_openings(const std::string& file, std::vector<std::string>& openings) {
+			if (file.empty()) {
+				openings.push_back(Position::DEFAULT);
+				return true;
+			}
+
+			std::ifstream in(file);
+			if (!in) {
+				std::cerr << "Could not open " << file << "\n";
+				return false;
+			}
+			std::string line;
+			size_t skipped = 0;
+			Position pos;
+			while (std::getline(in, line)) {
+				EPD epd;
+				if (epd.parse(line) && pos.set_legal(epd.fen)) {
+					openings.push_back(epd.fen);
+				}
+				else if (line.find_first_not_of(" \t\r") != std::string::npos) {
+					skipped++;
+				}
+			}
+			if (skipped > 0) {
+				std::cerr << "Skipped " << skipped << " lines of " << file << " that are not legal positions\n";
+			}
+			if (openings.empty()) {
+				std::cerr << "No openings in " << file << "\n";
+				return false;
+			}
+			return true;
+		}
+
+		// One side of the games a thread plays. The search gets its own copy
+		// of the game, with accumulators when it evaluates with the network.
+		struct Player {
+			const Engine& engine;
+			Tools::Worker worker;
+
+			explicit Player(const Engine& e) : engine(e), worker(e.nnue, e.make_mode) {
+			}
+
+			Move think(const Position& game) {
+				worker.pos = game;
+				return worker.search.run(worker.pos, engine.sp).bestmove;
+			}
+		};
+
+		// Points for white in half points, 2 for a win
+		int play_game(const std::string& fen, Player& white, Player& black, std::string& reason) {
+			Position pos(fen);
+			for (int ply = 0; ; ply++) {
+				auto moves = pos.legal_moves();
+				int points;
+				if (Tools::is_game_over(pos, moves, ply, reason, points)) {
+					return points;
+				}
+
+				Move move = (pos.turn() == WHITE ? white : black).think(pos);
+				if (std::find(moves.begin(), moves.end(), move) == moves.end()) {
+					reason = "illegal move";
+					return pos.turn() == WHITE ? 0 : 2;
+				}
+				pos.do_move(move);
+			}
+		}
+
+		// Wins, losses and draws of A, in games played
+		struct Stats {
+			size_t wins = 0, losses = 0, draws = 0;
+
+			size_t games() const { return wins + losses + draws; }
+			double score() const { return (wins + draws / 2.0) / games(); }
+
+			// Variance of the points of a single game
+			double variance() const {
+				double s = score();
+				return (wins * (1 - s) * (1 - s) + draws * (0.5 - s) * (0.5 - s) + losses * s * s) / games();
+			}
+		};
+
+		double expected_score(double elo) {
+			return 1.0 / (1.0 + std::pow(10.0, -elo / 400.0));
+		}
+
+		double elo_of(double score) {
+			score = std::min(std::max(score, 1e-6), 1.0 - 1e-6);
+			return -400.0 * std::log10(1.0 / score - 1.0);
+		}
+
+		// Log likelihood ratio of elo1 over elo0, in the normal approximation
+		// of the game outcomes. Until the outcomes vary a draw is added, as
+		// the variance would be zero.
+		double llr(Stats stats, double elo0, double elo1) {
+			if (stats.games() == 0) {
+				return 0.0;
+			}
+			if (stats.variance() <= 0.0) {
+				stats.draws++;
+			}
+			double s0 = expected_score(elo0), s1 = expected_score(elo1);
+			return stats.games() * (s1 - s0) * (2 * stats.score() - s0 - s1) / (2 * stats.variance());
+		}
+
+		void print_status(const Stats& stats, const Options& options, double lower, double upper, double seconds) {
+			double s = stats.score();
+			double margin = 1.96 * std::sqrt(stats.variance() / stats.games());
+			double elo = elo_of(s) + 0.0; // not -0.0 for an even score
+			double error = (elo_of(s + margin) - elo_of(s - margin)) / 2;
+
+			std::cout << "Score of " << options.engines[0].name << " vs " << options.engines[1].name << ": "
+				<< stats.wins << " - " << stats.losses << " - " << stats.draws
+				<< std::fixed << std::setprecision(3) << " [" << s << "] " << stats.games()
+				<< std::setprecision(1) << ", Elo " << elo << " +/- " << error
+				<< std::setprecision(2) << ", LLR " << llr(stats, options.elo0, options.elo1)
+				<< " (" << lower << ", " << upper << ")"
+				<< ", " << stats.games() / std::max(seconds, 1e-6) << " games/s" << std::endl;
+		}
+	}
+
+	int Match::run(const std::vector<std::string>& args) {
+		Options options;
+		std::vector<std::string> openings;
+		if (!parse_options(args, options)) {
+			std::cerr << "usage: Siika match [openings] [games N] [concurrency N] [elo0 E] [elo1 E] [alpha A] [beta B]"
+				" [evalfile FILE] [tbpath DIR] [[a.|b.]depth|nodes|movetime|makemode|eval VALUE] [a.|b.name NAME]\n";
+			return 1;
+		}
+		if (!load_openings(options.file, openings)) {
+			return 1;
+		}
+
+		// The evaluation cache is per thread and shared by both sides, which
+		// is only right when they evaluate the same way
+		if (options.engines[0].nnue != options.engines[1].nnue) {
+			EvalCache::set_size(0);
+		}
+
+		const double lower = std::log(options.beta / (1 - options.alpha));
+		const double upper = std::log((1 - options.beta) / options.alpha);
+
+		std::atomic<size_t> next_game{ 0 };
+		std::atomic<bool> is_decided{ false };
+		std::mutex mutex;
+		Stats stats;
+		Timer timer;
+
+		auto work = [&]() {
+			Player a(options.engines[0]), b(options.engines[1]);
+			while (!is_decided) {
+				size_t game = next_game++;
+				if (game >= options.games) {
+					return;
+				}
+
+				// each opening twice, with the colours swapped
+				const std::string& fen = openings[(game / 2) % openings.size()];
+				bool a_is_white = game % 2 == 0;
+				std::string reason;
+				int points = play_game(fen, a_is_white ? a : b, a_is_white ? b : a, reason);
+				int a_points = a_is_white ? points : 2 - points;
+
+				std::lock_guard<std::mutex> lock(mutex);
+				(a_points == 2 ? stats.wins : a_points == 0 ? stats.losses : stats.draws)++;
+				std::cout << "Game " << game + 1 << " " << (a_is_white ? a : b).engine.name << " vs " << (a_is_white ? b : a).engine.name << ": "
+					<< (points == 2 ? "1-0" : points == 0 ? "0-1" : "1/2-1/2") << " " << reason << "\n";
+
+				double ratio = llr(stats, options.elo0, options.elo1);
+				if (ratio <= lower || ratio >= upper) {
+					is_decided = true;
+				}
+				if (stats.games() % REPORT_INTERVAL == 0) {
+					print_status(stats, options, lower, upper, timer.get_elapsed_microseconds() / 1000000.0);
+				}
+			}
+		};
+
+		std::vector<std::thread> workers;
+		for (int i = 0; i < options.concurrency; i++) {
+			workers.emplace_back(work);
+		}
+		for (auto& worker : workers) {
+			worker.join();
+		}
+
+		if (stats.games() == 0) {
+			return 0;
+		}
+		if (stats.games() % REPORT_INTERVAL != 0) {
+			print_status(stats, options, lower, upper, timer.get_elapsed_microseconds() / 1000000.0);
+		}
+
+		double ratio = llr(stats, options.elo0, options.elo1);
+		std::cout << "SPRT elo0 " << options.elo0 << " elo1 " << options.elo1 << ": "
+			<< (ratio >= upper ? "H1 accepted" : ratio <= lower ? "H0 accepted" : "inconclusive") << "\n";
+		return 0;
+	}
+}
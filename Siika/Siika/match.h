@@ -0,0 +1,26 @@
+#pragma once
+
+#ifndef MATCH_H
+#define MATCH_H
+
+#include <string>
+#include <vector>
+
+namespace Chess {
+
+	// Games between two configurations of the engine in one process, played
+	// concurrently with a position and a search per game and side
+	namespace Match {
+		// Siika match [openings] [games N] [concurrency N] [elo0 E] [elo1 E]
+		//             [alpha A] [beta B] [evalfile FILE] [tbpath DIR]
+		//             [[a.|b.]depth N] [[a.|b.]nodes N] [[a.|b.]movetime MS]
+		//             [[a.|b.]makemode copy|unmake] [[a.|b.]eval classical|nnue]
+		//             [a.name NAME] [b.name NAME]
+		// Each opening is played with both colours. Options without a prefix
+		// set both engines. Stops when the SPRT of elo0 against elo1 accepts
+		// either, and reports the Elo difference of A over B.
+		int run(const std::vector<std::string>& args);
+	}
+}
+
+#endif // MATCH_H
@@ -0,0 +1,303 @@
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+#include "nnue.h"
+#include "position.h"
+
+#if defined(__AVX2__)
+#define USE_AVX2
+#include <immintrin.h>
+#elif defined(__SSE4_1__) || defined(__AVX__)
+#define USE_SSE41
+#include <smmintrin.h>
+#endif
+
+namespace Chess {
+
+	namespace {
+		// File header, followed by the layers in the order of Network, little endian
+		constexpr char MAGIC[8] = { 'S', 'I', 'I', 'K', 'A', 'N', 'N', 'E' };
+		constexpr u32 ARCHITECTURE = (NNUE::FEATURES << 12) ^ (NNUE::HALF_DIMENSIONS << 6) ^ NNUE::HIDDEN;
+
+		// Fixed point scales of the hidden layer and the output
+		constexpr int HIDDEN_SHIFT = 6;
+		constexpr int OUTPUT_SCALE = 16;
+
+		struct Network {
+			std::vector<i16> ft_biases;
+			LargeVector<i16> ft_weights{ LargePageAllocator<i16>("nnue weights") };
+			std::vector<i32> hidden_biases;
+			std::vector<i8> hidden_weights;
+			std::vector<i32> output_bias;
+			std::vector<i8> output_weights;
+
+			void allocate() {
+				ft_biases.assign(NNUE::HALF_DIMENSIONS, 0);
+				ft_weights.assign(static_cast<size_t>(NNUE::FEATURES) * NNUE::HALF_DIMENSIONS, 0);
+				hidden_biases.assign(NNUE::HIDDEN, 0);
+				hidden_weights.assign(NNUE::HIDDEN * 2 * NNUE::HALF_DIMENSIONS, 0);
+				output_bias.assign(1, 0);
+				output_weights.assign(NNUE::HIDDEN, 0);
+			}
+		} network;
+
+		bool loaded = false;
+
+		template <typename T, typename A>
+		bool read(std::istream& is, std::vector<T, A>& v) {
+			is.read(reinterpret_cast<char*>(v.data()), v.size() * sizeof(T));
+			return is.good();
+		}
+
+		template <typename T, typename A>
+		bool write(std::ostream& os, const std::vector<T, A>& v) {
+			os.write(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(T));
+			return os.good();
+		}
+
+		// Kings are not features, only the square of the own king is part of the index
+		inline int feature(int perspective, int king, int piece, int square) {
+			if (perspective == BLACK) {
+				king ^= 56;
+				square ^= 56;
+			}
+			int p = (piece_type(piece) - PAWN) * 2 + (piece_color(piece) != perspective);
+			return (king * 10 + p) * SQUARE_COUNT + square;
+		}
+
+		inline const i16* row(int feature) {
+			return &network.ft_weights[static_cast<size_t>(feature) * NNUE::HALF_DIMENSIONS];
+		}
+
+		inline void add_row(i16* acc, const i16* w) {
+#if defined(USE_AVX2)
+			for (int i = 0; i < NNUE::HALF_DIMENSIONS; i += 16) {
+				__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc + i));
+				__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w + i));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + i), _mm256_add_epi16(a, b));
+			}
+#elif defined(USE_SSE41)
+			for (int i = 0; i < NNUE::HALF_DIMENSIONS; i += 8) {
+				__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(acc + i));
+				__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(w + i));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(acc + i), _mm_add_epi16(a, b));
+			}
+#else
+			for (int i = 0; i < NNUE::HALF_DIMENSIONS; i++) {
+				acc[i] += w[i];
+			}
+#endif
+		}
+
+		inline void sub_row(i16* acc, const i16* w) {
+#if defined(USE_AVX2)
+			for (int i = 0; i < NNUE::HALF_DIMENSIONS; i += 16) {
+				__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc + i));
+				__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w + i));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + i), _mm256_sub_epi16(a, b));
+			}
+#elif defined(USE_SSE41)
+			for (int i = 0; i < NNUE::HALF_DIMENSIONS; i += 8) {
+				__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(acc + i));
+				__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(w + i));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(acc + i), _mm_sub_epi16(a, b));
+			}
+#else
+			for (int i = 0; i < NNUE::HALF_DIMENSIONS; i++) {
+				acc[i] -= w[i];
+			}
+#endif
+		}
+
+		// Clamps to [0, 127] and packs to bytes
+		inline void clipped_relu(const i16* in, u8* out) {
+#if defined(USE_AVX2)
+			const __m256i zero = _mm256_setzero_si256();
+			for (int i = 0; i < NNUE::HALF_DIMENSIONS; i += 32) {
+				__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+				__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i + 16));
+				// packs works within 128-bit lanes, the permute restores the order
+				__m256i packed = _mm256_max_epi8(_mm256_packs_epi16(a, b), zero);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_permute4x64_epi64(packed, 0xD8));
+			}
+#elif defined(USE_SSE41)
+			const __m128i zero = _mm_setzero_si128();
+			for (int i = 0; i < NNUE::HALF_DIMENSIONS; i += 16) {
+				__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+				__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 8));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_max_epi8(_mm_packs_epi16(a, b), zero));
+			}
+#else
+			for (int i = 0; i < NNUE::HALF_DIMENSIONS; i++) {
+				out[i] = static_cast<u8>(std::min(std::max(static_cast<int>(in[i]), 0), 127));
+			}
+#endif
+		}
+
+		// Dot product of unsigned inputs in [0, 127] and signed weights
+		inline i32 dot(const u8* in, const i8* w, int n) {
+#if defined(USE_AVX2)
+			const __m256i ones = _mm256_set1_epi16(1);
+			__m256i sum = _mm256_setzero_si256();
+			for (int i = 0; i < n; i += 32) {
+				__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+				__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w + i));
+				sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_maddubs_epi16(a, b), ones));
+			}
+			__m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+			s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+			s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+			return _mm_cvtsi128_si32(s);
+#elif defined(USE_SSE41)
+			const __m128i ones = _mm_set1_epi16(1);
+			__m128i sum = _mm_setzero_si128();
+			for (int i = 0; i < n; i += 16) {
+				__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+				__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(w + i));
+				sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_maddubs_epi16(a, b), ones));
+			}
+			sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+			sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+			return _mm_cvtsi128_si32(sum);
+#else
+			i32 sum = 0;
+			for (int i = 0; i < n; i++) {
+				sum += in[i] * w[i];
+			}
+			return sum;
+#endif
+		}
+
+		void refresh_perspective(const Position& pos, NNUE::Accumulator& acc, int perspective) {
+			i16* values = acc.values[color_index(perspective)];
+			std::memcpy(values, network.ft_biases.data(), sizeof(acc.values[0]));
+
+			int king = pos.king_square(perspective);
+			Bitboard b = pos.pieces() & ~pos.pieces(KING, WHITE) & ~pos.pieces(KING, BLACK);
+			while (b) {
+				int s = Bitboards::pop(b);
+				add_row(values, row(feature(perspective, king, pos.piece_on(s), s)));
+			}
+		}
+	}
+
+	bool NNUE::load(const std::string& file) {
+		std::ifstream ifs(file.c_str(), std::ios::binary);
+
+		char magic[sizeof(MAGIC)];
+		u32 architecture = 0;
+		ifs.read(magic, sizeof(magic));
+		ifs.read(reinterpret_cast<char*>(&architecture), sizeof(architecture));
+		if (!ifs.good() || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || architecture != ARCHITECTURE) {
+			return false;
+		}
+
+		Network next;
+		next.allocate();
+		if (!read(ifs, next.ft_biases) || !read(ifs, next.ft_weights)
+			|| !read(ifs, next.hidden_biases) || !read(ifs, next.hidden_weights)
+			|| !read(ifs, next.output_bias) || !read(ifs, next.output_weights)) {
+			return false;
+		}
+		std::swap(network, next);
+		loaded = true;
+		return true;
+	}
+
+	bool NNUE::save(const std::string& file) {
+		if (network.ft_weights.empty()) {
+			return false;
+		}
+
+		std::ofstream ofs(file.c_str(), std::ios::binary);
+		ofs.write(MAGIC, sizeof(MAGIC));
+		ofs.write(reinterpret_cast<const char*>(&ARCHITECTURE), sizeof(ARCHITECTURE));
+		return write(ofs, network.ft_biases) && write(ofs, network.ft_weights)
+			&& write(ofs, network.hidden_biases) && write(ofs, network.hidden_weights)
+			&& write(ofs, network.output_bias) && write(ofs, network.output_weights);
+	}
+
+	bool NNUE::is_loaded() {
+		return loaded;
+	}
+
+	void NNUE::init_random(u64 seed) {
+		auto next = [&seed]() {
+			seed ^= seed >> 12;
+			seed ^= seed << 25;
+			seed ^= seed >> 27;
+			return seed * 2685821657736338717ULL;
+		};
+		auto uniform = [&next](int range) {
+			return static_cast<int>(next() % (2 * range + 1)) - range;
+		};
+
+		network.allocate();
+		loaded = false;
+
+		for (auto& w : network.ft_biases) { w = static_cast<i16>(uniform(32)); }
+		for (auto& w : network.ft_weights) { w = static_cast<i16>(uniform(16)); }
+		for (auto& w : network.hidden_biases) { w = uniform(1024); }
+		for (auto& w : network.hidden_weights) { w = static_cast<i8>(uniform(32)); }
+		for (auto& w : network.output_bias) { w = uniform(1024); }
+		for (auto& w : network.output_weights) { w = static_cast<i8>(uniform(32)); }
+	}
+
+	void NNUE::refresh(const Position& pos, Accumulator& acc) {
+		refresh_perspective(pos, acc, WHITE);
+		refresh_perspective(pos, acc, BLACK);
+	}
+
+	// A king move changes every feature of its own perspective
+	void NNUE::update(const Position& pos, const Accumulator& prev, Accumulator& acc, const DirtyPieces& dirty) {
+		for (int perspective : { WHITE, BLACK }) {
+			bool king_moved = false;
+			for (int i = 0; i < dirty.count; i++) {
+				king_moved |= dirty.piece[i] == make_piece(KING, perspective);
+			}
+
+			if (king_moved) {
+				refresh_perspective(pos, acc, perspective);
+				continue;
+			}
+
+			int c = color_index(perspective);
+			int king = pos.king_square(perspective);
+			std::memcpy(acc.values[c], prev.values[c], sizeof(acc.values[c]));
+			for (int i = 0; i < dirty.count; i++) {
+				if (piece_type(dirty.piece[i]) == KING) {
+					continue;
+				}
+				if (dirty.from[i] != NO_SQUARE) {
+					sub_row(acc.values[c], row(feature(perspective, king, dirty.piece[i], dirty.from[i])));
+				}
+				if (dirty.to[i] != NO_SQUARE) {
+					add_row(acc.values[c], row(feature(perspective, king, dirty.piece[i], dirty.to[i])));
+				}
+			}
+		}
+	}
+
+	i32 NNUE::evaluate(const Position& pos) {
+		const Accumulator& acc = *pos.accumulator();
+		u8 input[2 * HALF_DIMENSIONS];
+		u8 hidden[HIDDEN];
+
+		clipped_relu(acc.values[color_index(pos.turn())], input);
+		clipped_relu(acc.values[color_index(pos.opponent())], input + HALF_DIMENSIONS);
+
+		for (int j = 0; j < HIDDEN; j++) {
+			i32 sum = network.hidden_biases[j] + dot(input, &network.hidden_weights[j * 2 * HALF_DIMENSIONS], 2 * HALF_DIMENSIONS);
+			hidden[j] = static_cast<u8>(std::min(std::max(sum >> HIDDEN_SHIFT, 0), 127));
+		}
+
+		i32 output = network.output_bias[0];
+		for (int j = 0; j < HIDDEN; j++) {
+			output += hidden[j] * network.output_weights[j];
+		}
+
+		return output / OUTPUT_SCALE;
+	}
+}
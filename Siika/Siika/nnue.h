@@ -0,0 +1,60 @@
+#pragma once
+
+#ifndef NNUE_H
+#define NNUE_H
+
+#include <string>
+
+#include "chess.h"
+
+namespace Chess {
+
+	class Position;
+
+	// Efficiently updatable network: HalfKP features into an int16
+	// accumulator per perspective, then two small int8 layers
+	namespace NNUE {
+
+		constexpr int FEATURES = SQUARE_COUNT * 10 * SQUARE_COUNT;
+		constexpr int HALF_DIMENSIONS = 256;
+		constexpr int HIDDEN = 32;
+
+		// First layer output for both perspectives, indexed by color_index
+		struct Accumulator {
+			i16 values[2][HALF_DIMENSIONS];
+		};
+
+		// Pieces changed by a move, from or to NO_SQUARE when put or taken
+		struct DirtyPieces {
+			int count;
+			int piece[3];
+			int from[3];
+			int to[3];
+
+			void add(int p, int f, int t) {
+				piece[count] = p;
+				from[count] = f;
+				to[count] = t;
+				count++;
+			}
+		};
+
+		// Reads a network in the format written by save, false on failure.
+		// The network in use is only replaced by a whole one, and must not
+		// be replaced during a search.
+		bool load(const std::string& file);
+		bool save(const std::string& file);
+		bool is_loaded();
+
+		// Random weights for testing the incremental updates, not for play
+		void init_random(u64 seed);
+
+		void refresh(const Position& pos, Accumulator& acc);
+		void update(const Position& pos, const Accumulator& prev, Accumulator& acc, const DirtyPieces& dirty);
+
+		// From the side to move's point of view, using the accumulator of the position
+		i32 evaluate(const Position& pos);
+	}
+}
+
+#endif // NNUE_H
@@ -0,0 +1,75 @@
+#include <iostream>
+
+#include "packed.h"
+#include "epd.h"
+
+namespace Chess {
+
+	int Packed::pack(const std::vector<std::string>& args) {
+		if (args.size() < 2) {
+			std::cerr << "usage: Siika pack <file|-> <out>\n";
+			return 1;
+		}
+
+		std::ifstream file;
+		if (args[0] != "-") {
+			file.open(args[0]);
+			if (!file) {
+				std::cerr << "Could not open " << args[0] << "\n";
+				return 1;
+			}
+		}
+		std::istream& in = args[0] == "-" ? std::cin : file;
+
+		RecordWriter<PackedPosition> writer;
+		if (!writer.open(args[1])) {
+			std::cerr << "Could not create " << args[1] << "\n";
+			return 1;
+		}
+
+		Position pos;
+		PackedPosition packed;
+		u64 written = 0, skipped = 0;
+		std::string line;
+		while (std::getline(in, line)) {
+			EPD epd;
+			if (!epd.parse(line)) {
+				continue;
+			}
+			if (pos.set_legal(epd.fen) && pos.pack(packed)) {
+				writer.write(packed);
+				written++;
+			}
+			else {
+				skipped++;
+			}
+		}
+		if (!writer.close()) {
+			std::cerr << "Could not write " << args[1] << "\n";
+			return 1;
+		}
+
+		std::cout << "Packed " << written << " positions";
+		if (skipped > 0) {
+			std::cout << ", skipped " << skipped << " that are not legal or have more than 32 pieces";
+		}
+		std::cout << "\n";
+		return 0;
+	}
+
+	int Packed::unpack(const std::vector<std::string>& args) {
+		RecordReader<PackedPosition> reader;
+		if (args.empty() || !reader.open(args[0])) {
+			std::cerr << (args.empty() ? "usage: Siika unpack <file>" : "Could not open " + args[0]) << "\n";
+			return 1;
+		}
+
+		Position pos;
+		PackedPosition packed;
+		while (reader.read(packed)) {
+			pos.set(packed);
+			std::cout << pos.fen() << "\n";
+		}
+		return 0;
+	}
+}
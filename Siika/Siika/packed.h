@@ -0,0 +1,171 @@
+#pragma once
+
+#ifndef PACKED_H
+#define PACKED_H
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "chess.h"
+#include "position.h"
+
+namespace Chess {
+
+	// Files of fixed size records such as PackedPosition, read and written
+	// a block at a time. Records are stored as they are in memory.
+	template <typename T>
+	class RecordWriter {
+	public:
+		static_assert(std::is_trivially_copyable<T>::value, "records are written as bytes");
+
+		explicit RecordWriter(size_t block_records = 1 << 15);
+		~RecordWriter();
+
+		// Appending keeps the records already in the file
+		bool open(const std::string& file, bool append = false);
+		bool close();
+
+		void write(const T& record);
+		bool flush();
+
+	private:
+		std::ofstream out_;
+		std::vector<T> buffer_;
+		size_t block_records_;
+	};
+
+	template <typename T>
+	class RecordReader {
+	public:
+		static_assert(std::is_trivially_copyable<T>::value, "records are read as bytes");
+
+		explicit RecordReader(size_t block_records = 1 << 15);
+
+		bool open(const std::string& file);
+		void close();
+
+		// Records in the file, a partial one at the end not counted
+		u64 count() const;
+
+		bool read(T& record);
+
+	private:
+		bool fill();
+
+		std::ifstream in_;
+		std::vector<T> buffer_;
+		size_t next_ = 0;
+		size_t block_records_;
+		u64 count_ = 0;
+		u64 remaining_ = 0;
+	};
+
+	template <typename T>
+	RecordWriter<T>::RecordWriter(size_t block_records) : block_records_(block_records) {
+		buffer_.reserve(block_records_);
+	}
+
+	template <typename T>
+	RecordWriter<T>::~RecordWriter() {
+		close();
+	}
+
+	template <typename T>
+	bool RecordWriter<T>::open(const std::string& file, bool append) {
+		close();
+		out_.open(file, std::ios::binary | (append ? std::ios::app : std::ios::trunc));
+		return out_.good();
+	}
+
+	template <typename T>
+	bool RecordWriter<T>::close() {
+		if (!out_.is_open()) {
+			return true;
+		}
+		bool ok = flush();
+		out_.close();
+		return ok;
+	}
+
+	template <typename T>
+	void RecordWriter<T>::write(const T& record) {
+		buffer_.push_back(record);
+		if (buffer_.size() == block_records_) {
+			flush();
+		}
+	}
+
+	template <typename T>
+	bool RecordWriter<T>::flush() {
+		out_.write(reinterpret_cast<const char*>(buffer_.data()), buffer_.size() * sizeof(T));
+		out_.flush();
+		buffer_.clear();
+		return out_.good();
+	}
+
+	template <typename T>
+	RecordReader<T>::RecordReader(size_t block_records) : block_records_(block_records) {}
+
+	template <typename T>
+	bool RecordReader<T>::open(const std::string& file) {
+		close();
+		in_.open(file, std::ios::binary | std::ios::ate);
+		if (!in_) {
+			return false;
+		}
+		count_ = remaining_ = static_cast<u64>(in_.tellg()) / sizeof(T);
+		in_.seekg(0);
+		return true;
+	}
+
+	template <typename T>
+	void RecordReader<T>::close() {
+		in_.close();
+		in_.clear();
+		buffer_.clear();
+		next_ = 0;
+		count_ = remaining_ = 0;
+	}
+
+	template <typename T>
+	u64 RecordReader<T>::count() const {
+		return count_;
+	}
+
+	template <typename T>
+	bool RecordReader<T>::read(T& record) {
+		if (next_ == buffer_.size() && !fill()) {
+			return false;
+		}
+		record = buffer_[next_++];
+		return true;
+	}
+
+	template <typename T>
+	bool RecordReader<T>::fill() {
+		size_t n = static_cast<size_t>(std::min<u64>(remaining_, block_records_));
+		buffer_.resize(n);
+		next_ = 0;
+		if (n == 0 || !in_.read(reinterpret_cast<char*>(buffer_.data()), n * sizeof(T))) {
+			buffer_.clear();
+			return false;
+		}
+		remaining_ -= n;
+		return true;
+	}
+
+	namespace Packed {
+		// Siika pack <file|-> <out>
+		// Writes the legal positions of an EPD or FEN file as packed positions
+		int pack(const std::vector<std::string>& args);
+
+		// Siika unpack <file>
+		// Prints the FEN of each packed position
+		int unpack(const std::vector<std::string>& args);
+	}
+}
+
+#endif // PACKED_H
@@ -0,0 +1,120 @@
+#include <cstdlib>
+#include <algorithm>
+
+#include "pawns.h"
+#include "evalparams.h"
+
+namespace Chess {
+
+	namespace {
+		template <int C>
+		Score evaluate_pawns(const Position& pos, Pawns::Entry& e) {
+			constexpr int Them = color_flip(C);
+			constexpr int Up = C == WHITE ? NORTH : SOUTH;
+
+			Bitboard ours = pos.pieces(PAWN, C);
+			Bitboard theirs = pos.pieces(PAWN, Them);
+			Bitboard their_attacks = Bitboards::pawn_attacks<Them>(theirs);
+			Score score = { 0, 0 };
+
+			e.passed[color_index(C)] = Bitboards::EMPTY;
+			e.attack_span[color_index(C)] = Bitboards::EMPTY;
+
+			Bitboard b = ours;
+			while (b) {
+				int s = Bitboards::pop(b);
+				int rank = C == WHITE ? square_rank(s) : RANK_8 - square_rank(s);
+
+				e.attack_span[color_index(C)] |= Bitboards::pawn_attack_span(C, s);
+
+				bool isolated = !(ours & Bitboards::adjacent_files(s));
+				bool doubled = ours & Bitboards::forward_file(C, s);
+				bool passed = !(theirs & Bitboards::passed_pawn_mask(C, s)) && !doubled;
+
+				// no own pawn beside or behind to support the advance, which is stopped by an enemy pawn
+				bool backward = !isolated
+					&& !(ours & (Bitboards::pawn_attack_span(Them, s) | (Bitboards::adjacent_files(s) & (Bitboards::RANK_1 << (8 * square_rank(s))))))
+					&& (their_attacks & Bitboards::make(s + Up));
+
+				if (passed) {
+					e.passed[color_index(C)] |= Bitboards::make(s);
+					score += eval_params.passed[rank];
+				}
+				if (isolated) {
+					score -= eval_params.isolated;
+				}
+				if (doubled) {
+					score -= eval_params.doubled;
+				}
+				if (backward) {
+					score -= eval_params.backward;
+				}
+			}
+
+			return score;
+		}
+
+		// Key 0 is that of no pawns, for which the empty entry is correct
+		const Pawns::Entry empty_entry = { 0, { 0, 0 }, { 0, 0 }, { 0, 0 }, { NO_SQUARE, NO_SQUARE }, { { 0, 0 }, { 0, 0 } } };
+
+		thread_local Pawns::Table table(Pawns::TABLE_SIZE);
+	}
+
+	Pawns::Table::Table(size_t size) : entries_(size, empty_entry, LargePageAllocator<Entry>("pawn table")) {
+	}
+
+	void Pawns::Table::clear() {
+		std::fill(entries_.begin(), entries_.end(), empty_entry);
+	}
+
+	Pawns::Entry* Pawns::Table::probe(const Position& pos) {
+		u32 key = pos.pawn_key();
+		Entry* e = &entries_[key & (entries_.size() - 1)];
+		if (e->key != key) {
+			*e = Pawns::evaluate(pos);
+		}
+		return e;
+	}
+
+	Pawns::Entry* Pawns::probe(const Position& pos) {
+		return table.probe(pos);
+	}
+
+	void Pawns::clear() {
+		table.clear();
+	}
+
+	Pawns::Entry Pawns::evaluate(const Position& pos) {
+		Entry e;
+		e.key = pos.pawn_key();
+		e.score = evaluate_pawns<WHITE>(pos, e) - evaluate_pawns<BLACK>(pos, e);
+		e.king_squares[0] = e.king_squares[1] = NO_SQUARE;
+		return e;
+	}
+
+	Score Pawns::shelter(const Position& pos, int color, int king_square) {
+		Bitboard ours = pos.pieces(PAWN, color);
+		Score score = { 0, 0 };
+
+		// by distance of the closest own pawn in front of the king, per file
+		// next to and on the king file
+		int kf = square_file(king_square);
+		for (int f = std::max(kf - 1, 0); f <= std::min(kf + 1, FILE_COUNT - 1); f++) {
+			int s = make_square(square_rank(king_square), f);
+			Bitboard front = ours & Bitboards::forward_file(color, s);
+
+			if (!front) {
+				score -= eval_params.open_file;
+				continue;
+			}
+
+			int distance = RANK_COUNT;
+			while (front) {
+				distance = std::min(distance, std::abs(square_rank(Bitboards::pop(front)) - square_rank(s)));
+			}
+			score += eval_params.shelter[std::min(distance, 3) - 1];
+		}
+
+		return score;
+	}
+}
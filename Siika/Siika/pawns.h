@@ -0,0 +1,64 @@
+#pragma once
+
+#ifndef PAWNS_H
+#define PAWNS_H
+
+#include <vector>
+
+#include "chess.h"
+#include "bitboard.h"
+#include "position.h"
+
+namespace Chess {
+
+	namespace Pawns {
+
+		// Pawn structure of one pawn key. The king shelter depends on the
+		// king square too and is recomputed when it changes.
+		struct Entry {
+			u32 key;
+			Score score;
+			Bitboard passed[2];
+			Bitboard attack_span[2];
+			int king_squares[2];
+			Score shelter[2];
+
+			Score king_shelter(const Position& pos, int color);
+		};
+
+		// Direct-mapped cache of pawn structure, one per thread
+		class Table {
+		public:
+			explicit Table(size_t size);
+			Entry* probe(const Position& pos);
+			void clear();
+
+		private:
+			LargeVector<Entry> entries_;
+		};
+
+		constexpr size_t TABLE_SIZE = 1 << 14;
+
+		// Probes the table of the calling thread
+		Entry* probe(const Position& pos);
+
+		// Empties the table of the calling thread, as after the weights changed
+		void clear();
+
+		// Pawn structure from scratch, without the table
+		Entry evaluate(const Position& pos);
+		Score shelter(const Position& pos, int color, int king_square);
+	}
+
+	inline Score Pawns::Entry::king_shelter(const Position& pos, int color) {
+		int c = color_index(color);
+		int k = pos.king_square(color);
+		if (king_squares[c] != k) {
+			king_squares[c] = k;
+			shelter[c] = Pawns::shelter(pos, color, k);
+		}
+		return shelter[c];
+	}
+}
+
+#endif // PAWNS_H
@@ -0,0 +1,349 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#include "pgn.h"
+#include "san.h"
+#include "tools.h"
+
+namespace Chess {
+
+	namespace {
+		// The replayed position starts over from its FEN this often, as it
+		// keeps at most MAX_PLYS plies and a caller may still search from it
+		constexpr int REBASE_PLIES = MAX_PLYS / 2;
+
+		// How many illegal moves the pgn command prints
+		constexpr int MAX_REPORTED_ERRORS = 10;
+
+		bool is_space(char c) {
+			return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+		}
+
+		bool is_line_start(const char* p, const char* base) {
+			return p == base || p[-1] == '\n';
+		}
+
+		const char* skip_space(const char* p, const char* end) {
+			while (p < end && is_space(*p)) {
+				p++;
+			}
+			return p;
+		}
+
+		const char* skip_past(const char* p, const char* end, char c) {
+			const char* found = static_cast<const char*>(std::memchr(p, c, end - p));
+			return found ? found + 1 : end;
+		}
+
+		// A result ends the movetext of a game
+		size_t result_length(const char* p, const char* end) {
+			for (const char* result : { "1-0", "0-1", "1/2-1/2", "*" }) {
+				size_t n = std::strlen(result);
+				if (static_cast<size_t>(end - p) >= n && std::memcmp(p, result, n) == 0 && (p + n == end || is_space(p[n]))) {
+					return n;
+				}
+			}
+			return 0;
+		}
+
+		bool is_token_end(char c) {
+			return is_space(c) || c == '{' || c == '}' || c == ';' || c == '(' || c == ')';
+		}
+	}
+
+	std::string PGN::Text::str() const {
+		return std::string(data, size);
+	}
+
+	bool PGN::Text::operator==(const char* s) const {
+		return std::strlen(s) == size && std::memcmp(data, s, size) == 0;
+	}
+
+	PGN::Text PGN::Game::tag(const char* name) const {
+		for (const auto& tag : tags) {
+			if (tag.name == name) {
+				return tag.value;
+			}
+		}
+		return Text();
+	}
+
+	bool PGN::Reader::open(const std::string& file) {
+		return file_.open(file);
+	}
+
+	void PGN::Reader::close() {
+		file_.close();
+	}
+
+	size_t PGN::Reader::size() const {
+		return file_.size();
+	}
+
+	// A tag at the start of a line after a line that is not a tag
+	bool PGN::Reader::is_game_start(size_t offset) const {
+		const char* base = reinterpret_cast<const char*>(file_.data());
+		const char* p = base + offset;
+		if (*p != '[' || !is_line_start(p, base)) {
+			return false;
+		}
+		while (p > base && is_space(p[-1])) {
+			p--;
+		}
+		while (p > base && p[-1] != '\n') {
+			p--;
+		}
+		return p == base + offset || *p != '[';
+	}
+
+	std::vector<size_t> PGN::Reader::split(int parts) const {
+		const char* base = reinterpret_cast<const char*>(file_.data());
+		std::vector<size_t> offsets = { 0 };
+		for (int i = 1; i < parts; i++) {
+			size_t offset = std::max(offsets.back(), size() / parts * i);
+			while (offset < size() && !is_game_start(offset)) {
+				offset = skip_past(base + offset, base + size(), '\n') - base;
+			}
+			offsets.push_back(offset);
+		}
+		offsets.push_back(size());
+		return offsets;
+	}
+
+	bool PGN::Reader::next(size_t& offset, size_t end, Game& game) const {
+		const char* base = reinterpret_cast<const char*>(file_.data());
+		const char* limit = base + size();
+		const char* p = base + offset;
+		if (offset == 0 && size() >= 3 && std::memcmp(p, "\xEF\xBB\xBF", 3) == 0) {
+			p += 3; // byte order mark
+		}
+		p = skip_space(p, limit);
+		offset = p - base;
+		if (offset >= end || p == limit) {
+			return false;
+		}
+
+		game.offset = offset;
+		game.tags.clear();
+		while (p < limit && *p == '[') {
+			Tag tag;
+			p = skip_space(p + 1, limit);
+			tag.name.data = p;
+			while (p < limit && !is_space(*p) && *p != '"' && *p != ']') {
+				p++;
+			}
+			tag.name.size = p - tag.name.data;
+
+			p = skip_past(p, limit, '"');
+			tag.value.data = p;
+			while (p < limit && *p != '"' && *p != '\n') {
+				p += *p == '\\' && p + 1 < limit ? 2 : 1;
+			}
+			tag.value.size = p - tag.value.data;
+
+			p = skip_space(skip_past(p, limit, '\n'), limit);
+			game.tags.push_back(tag);
+		}
+
+		// up to the result, or the next tag section if it is missing
+		const char* q = p;
+		while (q < limit) {
+			if (*q == '{') {
+				q = skip_past(q, limit, '}');
+			}
+			else if (*q == ';' || (*q == '%' && is_line_start(q, base))) {
+				q = skip_past(q, limit, '\n');
+			}
+			else if (*q == '[' && is_line_start(q, base)) {
+				break;
+			}
+			else if ((q == p || is_token_end(q[-1])) && result_length(q, limit)) {
+				q += result_length(q, limit);
+				break;
+			}
+			else {
+				q++;
+			}
+		}
+		game.movetext.data = p;
+		game.movetext.size = q - p;
+
+		offset = q - base;
+		return true;
+	}
+
+	void PGN::Reader::for_each(int threads, const std::function<void(const Game& game, int thread)>& job) const {
+		std::vector<size_t> offsets = split(threads);
+		std::vector<std::thread> workers;
+		for (int i = 0; i < threads; i++) {
+			workers.emplace_back([this, &offsets, &job, i]() {
+				Game game;
+				size_t offset = offsets[i];
+				while (next(offset, offsets[i + 1], game)) {
+					job(game, i);
+				}
+			});
+		}
+		for (auto& worker : workers) {
+			worker.join();
+		}
+	}
+
+	bool PGN::replay(const Game& game, Position& pos, const std::function<void(Position& pos, Move move)>& on_move) {
+		Text fen = game.tag("FEN");
+		if (fen.size > 0) {
+			if (!pos.set_legal(fen.str())) {
+				return false;
+			}
+		}
+		else {
+			pos.set_default();
+		}
+
+		const char* p = game.movetext.data;
+		const char* end = p + game.movetext.size;
+		int variation = 0;
+		int plies = 0;
+		while (p < end) {
+			if (is_space(*p) || *p == '}') {
+				p++;
+				continue;
+			}
+			if (*p == '{') {
+				p = skip_past(p, end, '}');
+				continue;
+			}
+			if (*p == ';') {
+				p = skip_past(p, end, '\n');
+				continue;
+			}
+			if (*p == '(' || *p == ')') {
+				variation = std::max(0, variation + (*p == '(' ? 1 : -1));
+				p++;
+				continue;
+			}
+
+			const char* token = p;
+			while (p < end && !is_token_end(*p)) {
+				p++;
+			}
+			if (variation > 0 || *token == '$') {
+				continue;
+			}
+			if (result_length(token, p)) {
+				break;
+			}
+
+			// move numbers may be written together with the move, "12.e4"
+			bool castling = *token == '0' && p - token > 1 && token[1] == '-';
+			if (std::isdigit(static_cast<unsigned char>(*token)) && !castling) {
+				while (token < p && std::isdigit(static_cast<unsigned char>(*token))) {
+					token++;
+				}
+			}
+			while (token < p && *token == '.') {
+				token++;
+			}
+			if (token == p) {
+				continue;
+			}
+
+			Move move = SAN::parse(pos, token, p - token);
+			if (move == NULLMOVE) {
+				return false;
+			}
+			if (on_move) {
+				on_move(pos, move);
+			}
+			pos.do_move(move);
+			if (++plies % REBASE_PLIES == 0) {
+				pos.set(pos.fen());
+			}
+		}
+		return true;
+	}
+
+	int PGN::run(const std::vector<std::string>& args) {
+		std::string file;
+		int threads = std::max(1u, std::thread::hardware_concurrency());
+		bool verify = false;
+		bool ok = true;
+		for (size_t i = 0; ok && i < args.size(); i++) {
+			if (args[i] == "threads" && i + 1 < args.size()) {
+				ok = Tools::parse_integer(args[i], args[i + 1], 1, Tools::MAX_THREADS, threads);
+				i++;
+			}
+			else if (args[i] == "verify") {
+				verify = true;
+			}
+			else if (file.empty()) {
+				file = args[i];
+			}
+		}
+
+		Reader reader;
+		if (!ok || file.empty() || !reader.open(file)) {
+			std::cerr << (!ok || file.empty() ? "usage: Siika pgn <file> [threads N] [verify]" : "Could not open " + file) << "\n";
+			return 1;
+		}
+
+		struct Count {
+			u64 games = 0, moves = 0, errors = 0, mismatches = 0;
+		};
+		std::vector<Count> counts(threads);
+		std::vector<Position> positions(threads);
+		std::atomic<int> reported{ 0 };
+		std::mutex mutex;
+
+		Timer timer;
+		reader.for_each(threads, [&](const Game& game, int thread) {
+			Count& count = counts[thread];
+			Position& pos = positions[thread];
+			bool ok = replay(game, pos, [&](Position& pos, Move move) {
+				count.moves++;
+				if (verify && SAN::parse(pos, SAN::to_string(pos, move)) != move) {
+					count.mismatches++;
+				}
+			});
+			count.games++;
+			if (!ok) {
+				count.errors++;
+				if (reported++ < MAX_REPORTED_ERRORS) {
+					Text fen = game.tag("FEN");
+					Position start;
+					std::lock_guard<std::mutex> lock(mutex);
+					if (fen.size > 0 && !start.set_legal(fen.str())) {
+						std::cerr << "Illegal FEN tag in the game at byte " << game.offset << ": " << fen.str() << "\n";
+					}
+					else {
+						std::cerr << "Illegal move in the game at byte " << game.offset << " after " << pos.fen() << "\n";
+					}
+				}
+			}
+		});
+		double seconds = std::max(timer.get_elapsed_microseconds() / 1000000.0, 1e-6);
+
+		Count total;
+		for (const auto& count : counts) {
+			total.games += count.games;
+			total.moves += count.moves;
+			total.errors += count.errors;
+			total.mismatches += count.mismatches;
+		}
+
+		std::cout << "Games " << total.games << ", moves " << total.moves << ", illegal " << total.errors;
+		if (verify) {
+			std::cout << ", SAN mismatches " << total.mismatches;
+		}
+		std::cout << "\n" << std::fixed << std::setprecision(2) << "Time " << seconds << " s, "
+			<< std::setprecision(1) << reader.size() / seconds / 1000000.0 << " MB/s, "
+			<< std::setprecision(0) << total.moves / seconds << " moves/s\n";
+		return total.errors == 0 && total.mismatches == 0 ? 0 : 1;
+	}
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#ifndef PGN_H
+#define PGN_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "chess.h"
+#include "position.h"
+#include "util.h"
+
+namespace Chess {
+
+	// Portable game notation read in place from a mapped file. A game starts
+	// at its tag section, so the file can be split at game starts and the
+	// parts read by several threads.
+	namespace PGN {
+		// Characters inside the mapped file
+		struct Text {
+			const char* data = nullptr;
+			size_t size = 0;
+
+			std::string str() const;
+			bool operator==(const char* s) const;
+		};
+
+		// The value is between the quotes, with its escapes kept
+		struct Tag {
+			Text name;
+			Text value;
+		};
+
+		struct Game {
+			size_t offset = 0;
+			std::vector<Tag> tags;
+			Text movetext;
+
+			// Empty when the game has no such tag
+			Text tag(const char* name) const;
+		};
+
+		class Reader {
+		public:
+			bool open(const std::string& file);
+			void close();
+			size_t size() const;
+
+			// parts + 1 offsets from 0 to size(), each other one at a game start
+			std::vector<size_t> split(int parts) const;
+
+			// Reads the game starting at offset if it starts before end, and
+			// moves offset past it
+			bool next(size_t& offset, size_t end, Game& game) const;
+
+			// Calls job with each game and the number of the thread reading it
+			void for_each(int threads, const std::function<void(const Game& game, int thread)>& job) const;
+
+		private:
+			bool is_game_start(size_t offset) const;
+
+			MappedFile file_;
+		};
+
+		// Sets pos to the start of the game, from the FEN tag if there is
+		// one, and plays the main line, calling on_move before each move.
+		// Comments, variations, move numbers and NAGs are skipped. Returns
+		// false for a FEN tag that is not a legal position, or at a move
+		// that is not legal, leaving pos before it.
+		bool replay(const Game& game, Position& pos, const std::function<void(Position& pos, Move move)>& on_move = nullptr);
+
+		// Siika pgn <file> [threads N] [verify]
+		// Replays every game and reports the games, moves and speed. verify
+		// checks that each move written in SAN reads back as the same move.
+		int run(const std::vector<std::string>& args);
+	}
+}
+
+#endif // PGN_H
@@ -1,5 +1,7 @@
 #include <sstream>
 #include <iostream>
+#include <algorithm>
+#include <cstring>
 
 #include "position.h"
 #include "debug.h"
@@ -7,19 +9,30 @@
 namespace Chess {
 
 	// Zobrist
+	// The numbers come from a generator of their own with a fixed seed, so
+	// that hashes are the same in every build and run, e.g. for keys kept
+	// in files
 	Zobrist::Zobrist() {
-		black_number = PRNG::get_64();
+		u64 state = 0x5EED5111CA5EED01ULL;
+		auto next = [&state]() {
+			state ^= state >> 12;
+			state ^= state << 25;
+			state ^= state >> 27;
+			return state * 2685821657736338717ULL;
+		};
+
+		black_number = next();
 
 		for (int i = 0; i < piece_numbers.size(); i++) {
-			piece_numbers[i] = PRNG::get_64();
+			piece_numbers[i] = next();
 		}
 
 		for (int i = 0; i < castling_numbers.size(); i++) {
-			castling_numbers[i] = PRNG::get_64();
+			castling_numbers[i] = next();
 		}
 
 		for (int i = 0; i < ep_file_numbers.size(); i++) {
-			ep_file_numbers[i] = PRNG::get_64();
+			ep_file_numbers[i] = next();
 		}
 	}
 
@@ -32,10 +45,14 @@ namespace Chess {
 		turn_ = WHITE;
 		fullmove_ = 1;
 		ply_ = 0;
-		undo_[0] = { NO_SQUARE, NO_CASTLINGS, NO_PIECE, 0, 0, 0, 0 };
-
-		squares_.fill(NO_PIECE);
-		bitboards_.fill(Bitboards::EMPTY);
+		undo_[0] = { 0, NO_SQUARE, NO_CASTLINGS, NO_PIECE, 0, 0 };
+
+		board_.by_type_.fill(Bitboards::EMPTY);
+		board_.by_color_.fill(Bitboards::EMPTY);
+		board_.squares_.fill(NO_PIECE);
+		board_.material_.fill(0);
+		board_.psq_ = { 0, 0 };
+		board_.phase_ = 0;
 	}
 
 	// Default starting position
@@ -47,54 +64,37 @@ namespace Chess {
 		set(fen);
 	}
 
-	void Position::set_default() noexcept {
-		turn_ = WHITE;
-		fullmove_ = 1;
-		ply_ = 0;
-
-		squares_ = {
-			4, 2, 3, 5, 6, 3, 2, 4,
-			1, 1, 1, 1, 1, 1, 1, 1,
-			16, 16, 16, 16, 16, 16, 16, 16,
-			16, 16, 16, 16, 16, 16, 16, 16,
-			16, 16, 16, 16, 16, 16, 16, 16,
-			16, 16, 16, 16, 16, 16, 16, 16,
-			9, 9, 9, 9, 9, 9, 9, 9,
-			12, 10, 11, 13, 14, 11, 10, 12
-		};
-		bitboards_ = {
-			0xFFFF,
-			0xFF00,
-			0x42,
-			0x24,
-			0x81,
-			0x8,
-			0x10,
-			0x0,
-			0xffff000000000000,
-			0xff000000000000,
-			0x4200000000000000,
-			0x2400000000000000,
-			0x8100000000000000,
-			0x800000000000000,
-			0x1000000000000000,
-			0x0,
-			0x0
-		};
-
-		undo_[0] = { NO_SQUARE, ALL_CASTLINGS, NO_PIECE, 0, 0, 0, 0 };
-		undo_[0].hash_ = calculate_hash();
+	// Copies only the used part of the undo stack
+	Position::Position(const Position& other) noexcept {
+		*this = other;
+	}
 
+	Position& Position::operator=(const Position& other) noexcept {
+		board_ = other.board_;
+		turn_ = other.turn_;
+		fullmove_ = other.fullmove_;
+		ply_ = other.ply_;
+		std::copy(other.undo_.begin(), other.undo_.begin() + other.ply_ + 1, undo_.begin());
+		attach(accumulators_);
+		return *this;
+	}
 
-		for (int i = 0; i < SQUARE_COUNT; i++) {
-			int p = piece_on(i);
-			material_[piece_color(p)] += piecetype_values[piece_type(p)];
+	void Position::attach(NNUE::Accumulator* accumulators) noexcept {
+		accumulators_ = accumulators;
+		if (accumulators_) {
+			NNUE::refresh(*this, accumulators_[ply_]);
 		}
 	}
 
+	void Position::set_default() noexcept {
+		set(DEFAULT);
+	}
+
 	void Position::set(const std::string& fen) noexcept {
+		NNUE::Accumulator* accumulators = accumulators_;
+		accumulators_ = nullptr;
 		reset();
-		Undo undo{ NO_SQUARE, NO_CASTLINGS, NO_PIECE, 0, 0 };
+		Undo undo{ 0, NO_SQUARE, NO_CASTLINGS, NO_PIECE, 0, 0 };
 
 		std::istringstream iss(fen);
 		std::string section;
@@ -141,10 +141,119 @@ namespace Chess {
 			undo.ep_ = make_square(r, f);
 		}
 
-		iss >> undo.halfmove_ >> fullmove_;
+		int halfmove = 0;
+		iss >> halfmove >> fullmove_;
+		undo.halfmove_ = halfmove;
+
+		undo_[0] = undo;
+		undo_[0].hash_ = calculate_hash();
+		undo_[0].pawn_key_ = calculate_pawn_key();
+
+		attach(accumulators);
+	}
+
+	bool Position::is_valid_fen(const std::string& fen) {
+		std::istringstream iss(fen);
+		std::string board, turn, castling, ep;
+		if (!(iss >> board >> turn >> castling >> ep)) {
+			return false;
+		}
+
+		int rank = 7, file = 0;
+		int kings[2] = { 0, 0 };
+		for (const auto c : board) {
+			if (c == '/') {
+				if (file != 8 || rank == 0) {
+					return false;
+				}
+				--rank;
+				file = 0;
+			}
+			else if (c >= '1' && c <= '8') {
+				file += c - '0';
+			}
+			else if (std::strchr("PNBRQKpnbrqk", c)) {
+				if ((c == 'P' || c == 'p') && (rank == 0 || rank == 7)) {
+					return false;
+				}
+				if (c == 'K') ++kings[0];
+				if (c == 'k') ++kings[1];
+				++file;
+			}
+			else {
+				return false;
+			}
+			if (file > 8) {
+				return false;
+			}
+		}
+		if (rank != 0 || file != 8 || kings[0] != 1 || kings[1] != 1) {
+			return false;
+		}
+
+		if (turn != "w" && turn != "b") {
+			return false;
+		}
+		if (castling != "-" && castling.find_first_not_of("KQkq") != std::string::npos) {
+			return false;
+		}
+		return ep == "-" || (ep.size() == 2 && ep[0] >= 'a' && ep[0] <= 'h' && (ep[1] == '3' || ep[1] == '6'));
+	}
+
+	bool Position::set_legal(const std::string& fen) {
+		if (!is_valid_fen(fen)) {
+			return false;
+		}
+		set(fen);
+		return !is_in_check(opponent());
+	}
+
+	void Position::set(const PackedPosition& packed) noexcept {
+		NNUE::Accumulator* accumulators = accumulators_;
+		accumulators_ = nullptr;
+		reset();
+		Undo undo{ 0, NO_SQUARE, NO_CASTLINGS, NO_PIECE, 0, 0 };
+
+		Bitboard b = packed.occupied;
+		for (int i = 0; b && i < 32; i++) {
+			int s = Bitboards::pop(b);
+			int piece = (packed.pieces[i / 2] >> (4 * (i & 1))) & 15;
+			if (piece_type(piece) != NO_PIECETYPE && piece_type(piece) < PIECETYPE_COUNT) {
+				put_piece(piece, s);
+			}
+		}
+
+		turn_ = packed.turn_and_castling & 1 ? BLACK : WHITE;
+		undo.cr_ = (packed.turn_and_castling >> 1) & ALL_CASTLINGS;
+		undo.ep_ = packed.en_passant < SQUARE_COUNT ? packed.en_passant : static_cast<u8>(NO_SQUARE);
+		undo.halfmove_ = packed.halfmove;
+		fullmove_ = packed.fullmove;
 
 		undo_[0] = undo;
 		undo_[0].hash_ = calculate_hash();
+		undo_[0].pawn_key_ = calculate_pawn_key();
+
+		attach(accumulators);
+	}
+
+	bool Position::pack(PackedPosition& packed) const noexcept {
+		packed = PackedPosition();
+		packed.occupied = pieces();
+
+		Bitboard b = pieces();
+		for (int i = 0; b; i++) {
+			if (i == 32) {
+				return false;
+			}
+			int s = Bitboards::pop(b);
+			packed.pieces[i / 2] |= static_cast<u8>(piece_on(s) << (4 * (i & 1)));
+		}
+
+		packed.turn_and_castling = static_cast<u8>((turn_ == BLACK ? 1 : 0) | (castling_rights() << 1));
+		packed.en_passant = static_cast<u8>(en_passant_square());
+		packed.halfmove = static_cast<u8>(halfmove());
+		packed.fullmove = static_cast<u16>(fullmove_);
+		return true;
 	}
 
 	std::string Position::fen() const noexcept {
@@ -230,16 +339,42 @@ namespace Chess {
 		return false;
 	}
 
-	void Position::update_attacks() noexcept {
-		Bitboard attacks = Bitboards::EMPTY;
-		
+	bool Position::is_insufficient_material() const noexcept {
+		if (board_.by_type_[PAWN] | board_.by_type_[ROOK] | board_.by_type_[QUEEN]) {
+			return false;
+		}
+		Bitboard knights = board_.by_type_[KNIGHT];
+		Bitboard bishops = board_.by_type_[BISHOP];
+		if (Bitboards::popcount(knights | bishops) <= 1) {
+			return true;
+		}
+		constexpr Bitboard LIGHT_SQUARES = 0x55AA55AA55AA55AA;
+		return !knights && (!(bishops & LIGHT_SQUARES) || !(bishops & ~LIGHT_SQUARES));
 	}
 
+	// Castling rights lost when a move starts or ends on the square
+	constexpr int castling_mask[SQUARE_COUNT] = {
+		WHITE_QUEENSIDE, 0, 0, 0, WHITE_KINGSIDE | WHITE_QUEENSIDE, 0, 0, WHITE_KINGSIDE,
+		0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0,
+		BLACK_QUEENSIDE, 0, 0, 0, BLACK_KINGSIDE | BLACK_QUEENSIDE, 0, 0, BLACK_KINGSIDE
+	};
+
+	template <int C>
 	void Position::do_move(Move move) noexcept {
+		constexpr int Up = C == WHITE ? NORTH : SOUTH;
+
 		int f = move_from(move);
 		int t = move_to(move);
 
-		Undo undo = { NO_SQUARE, castling_rights(), NO_PIECE, halfmove() + 1, hash() };
+		constexpr int Pawn = make_piece(PAWN, C);
+
+		Undo undo = { hash(), NO_SQUARE, static_cast<u8>(castling_rights()), NO_PIECE, static_cast<u8>(halfmove() + 1), pawn_key() };
+		dirty_.count = 0;
 
 		if (en_passant_square() != NO_SQUARE) {
 			undo.hash_ ^= zobrist_.ep_file_numbers[square_file(en_passant_square())];
@@ -251,8 +386,9 @@ namespace Chess {
 		switch (move_flags(move)) {
 		case PAWN_DOUBLE_PUSH: {
 			move_piece(f, t);
+			undo.pawn_key_ ^= pawn_hash(Pawn, f) ^ pawn_hash(Pawn, t);
 			undo.halfmove_ = 0;
-			undo.ep_ = (f + t) >> 1;
+			undo.ep_ = f + Up;
 			undo.hash_ ^= zobrist_.ep_file_numbers[square_file(undo.ep_)];
 		} break;
 		case KINGSIDE_CASTLE: {
@@ -268,9 +404,10 @@ namespace Chess {
 			undo.hash_ ^= piece_hash(f - 1);
 		} break;
 		case EN_PASSANT_CAPTURE: {
-			int capsq = t - pawn_up(turn());
+			int capsq = t - Up;
 			undo.hash_ ^= piece_hash(capsq);
 			undo.cap_ = piece_on(capsq);
+			undo.pawn_key_ ^= pawn_hash(Pawn, f) ^ pawn_hash(Pawn, t) ^ pawn_hash(undo.cap_, capsq);
 			undo.halfmove_ = 0;
 			take_piece(capsq);
 			move_piece(f, t);
@@ -282,21 +419,27 @@ namespace Chess {
 			undo.cap_ = piece_on(t);
 			if (undo.cap_ != NO_PIECE) {
 				undo.hash_ ^= piece_hash(t);
+				take_piece(t);
 			}
+			undo.pawn_key_ ^= pawn_hash(Pawn, f);
 			undo.halfmove_ = 0;
-			take_piece(t);
 			take_piece(f);
-			put_piece(make_piece(promotion_type(move), turn()), t);
+			put_piece(make_piece(promotion_type(move), C), t);
 		} break;
 		default: {
-			if (piece_type(piece_on(f)) == PAWN || piece_on(t) != NO_PIECE) {
+			if (piece_on(f) == Pawn) {
 				undo.halfmove_ = 0;
+				undo.pawn_key_ ^= pawn_hash(Pawn, f) ^ pawn_hash(Pawn, t);
 			}
 			undo.cap_ = piece_on(t);
 			if (undo.cap_ != NO_PIECE) {
+				undo.halfmove_ = 0;
 				undo.hash_ ^= piece_hash(t);
+				if (piece_type(undo.cap_) == PAWN) {
+					undo.pawn_key_ ^= pawn_hash(undo.cap_, t);
+				}
+				take_piece(t);
 			}
-			take_piece(t);
 			move_piece(f, t);
 		}
 		}
@@ -305,29 +448,12 @@ namespace Chess {
 		undo.hash_ ^= piece_hash(t);
 
 		// xor castlings
-		undo.hash_ ^= zobrist_.castling_numbers[castling_rights()];
-
-		if (f == A1 || t == A1) {
-			undo.cr_ &= ~(WHITE_QUEENSIDE);
+		int lost_rights = undo.cr_ & (castling_mask[f] | castling_mask[t]);
+		if (lost_rights) {
+			undo.hash_ ^= zobrist_.castling_numbers[undo.cr_];
+			undo.cr_ &= ~lost_rights;
+			undo.hash_ ^= zobrist_.castling_numbers[undo.cr_];
 		}
-		if (f == H1 || t == H1) {
-			undo.cr_ &= ~(WHITE_KINGSIDE);
-		}
-		if (f == E1) {
-			undo.cr_ &= ~(WHITE_KINGSIDE | WHITE_QUEENSIDE);
-		}
-
-		if (f == A8 || t == A8) {
-			undo.cr_ &= ~(BLACK_QUEENSIDE);
-		}
-		if (f == H8 || t == H8) {
-			undo.cr_ &= ~(BLACK_KINGSIDE);
-		}
-		if (f == E8) {
-			undo.cr_ &= ~(BLACK_KINGSIDE | BLACK_QUEENSIDE);
-		}
-
-		undo.hash_ ^= zobrist_.castling_numbers[undo.cr_];
 
 		// xor color
 		undo.hash_ ^= zobrist_.black_number;
@@ -335,16 +461,26 @@ namespace Chess {
 		ply_++;
 		undo_[ply_] = undo;
 
-		if (turn() == BLACK) fullmove_++;
-		turn_ = opponent();
+		if (accumulators_) {
+			NNUE::update(*this, accumulators_[ply_ - 1], accumulators_[ply_], dirty_);
+		}
+
+		if (C == BLACK) fullmove_++;
+		turn_ = color_flip(C);
 	}
 
+	template <int C>
 	void Position::undo_move(Move move) noexcept {
+		constexpr int Up = C == WHITE ? NORTH : SOUTH;
+
 		int f = move_from(move);
 		int t = move_to(move);
 
-		if (turn() == WHITE) fullmove_--;
-		turn_ = opponent();
+		if (C == BLACK) fullmove_--;
+		turn_ = C;
+
+		// the accumulator of the previous ply is still valid, the changes are not needed
+		dirty_.count = 0;
 
 		switch (move_flags(move)) {
 		case PAWN_DOUBLE_PUSH: {
@@ -359,7 +495,7 @@ namespace Chess {
 			move_piece(f - 1, f - 4);
 		} break;
 		case EN_PASSANT_CAPTURE: {
-			int capsq = t - pawn_up(turn());
+			int capsq = t - Up;
 			put_piece(captured_piece(), capsq);
 			move_piece(t, f);
 		} break;
@@ -368,111 +504,316 @@ namespace Chess {
 		case PROMOTION_BISHOP:
 		case PROMOTION_KNIGHT: {
 			take_piece(t);
-			put_piece(captured_piece(), t);
-			put_piece(make_piece(PAWN, turn()), f);
+			if (captured_piece() != NO_PIECE) {
+				put_piece(captured_piece(), t);
+			}
+			put_piece(make_piece(PAWN, C), f);
 		} break;
 		default: {
 			move_piece(t, f);
-			put_piece(captured_piece(), t);
+			if (captured_piece() != NO_PIECE) {
+				put_piece(captured_piece(), t);
+			}
 		}
 		}
 		ply_--;
 	}
 
+	template void Position::do_move<WHITE>(Move move) noexcept;
+	template void Position::do_move<BLACK>(Move move) noexcept;
+	template void Position::undo_move<WHITE>(Move move) noexcept;
+	template void Position::undo_move<BLACK>(Move move) noexcept;
+
+	template <int T>
 	void Position::knight_moves(Bitboard p, Bitboard target, std::vector<Move>& moves) const noexcept {
 		while (p) {
 			int from = Bitboards::pop(p);
-			//Bitboard attacks = Bitboards::knight_attacks(Bitboards::make(from)) & target;
 			Bitboard attacks = Bitboards::knight_attacks(from) & target;
 			while (attacks) {
 				int to = Bitboards::pop(attacks);
-				moves.push_back(make_move(from, to));
+				add_move<T>(make_move(from, to), moves);
 			}
 		}
 	}
 
+	template <int T>
 	void Position::bishop_moves(Bitboard p, Bitboard target, Bitboard empty, std::vector<Move>& moves) const noexcept {
 		while (p) {
 			int from = Bitboards::pop(p);
-			Bitboard attacks = Bitboards::bishop_attacks(Bitboards::make(from), empty) & target;
+			Bitboard attacks = Bitboards::bishop_attacks(from, empty) & target;
 			while (attacks) {
 				int to = Bitboards::pop(attacks);
-				moves.push_back(make_move(from, to));
+				add_move<T>(make_move(from, to), moves);
 			}
 		}
 	}
 
+	template <int T>
 	void Position::rook_moves(Bitboard p, Bitboard target, Bitboard empty, std::vector<Move>& moves) const noexcept {
 		while (p) {
 			int from = Bitboards::pop(p);
-			Bitboard attacks = Bitboards::rook_attacks(Bitboards::make(from), empty) & target;
+			Bitboard attacks = Bitboards::rook_attacks(from, empty) & target;
 			while (attacks) {
 				int to = Bitboards::pop(attacks);
-				moves.push_back(make_move(from, to));
+				add_move<T>(make_move(from, to), moves);
 			}
 		}
 	}
 
+	template <int T>
 	void Position::king_moves(Bitboard p, Bitboard target, std::vector<Move>& moves) const noexcept {
 		while (p) {
 			int from = Bitboards::pop(p);
-			//Bitboard attacks = Bitboards::king_attacks(Bitboards::make(from)) & target;
 			Bitboard attacks = Bitboards::king_attacks(from) & target;
 			while (attacks) {
 				int to = Bitboards::pop(attacks);
-				moves.push_back(make_move(from, to));
+				add_move<T>(make_move(from, to), moves);
 			}
 		}
 	}
 
+	template <int C, int T>
 	void Position::castling_moves(std::vector<Move>& moves) const noexcept {
+		constexpr int King = C == WHITE ? E1 : E8;
+		constexpr int Kingside = C == WHITE ? WHITE_KINGSIDE : BLACK_KINGSIDE;
+		constexpr int Queenside = C == WHITE ? WHITE_QUEENSIDE : BLACK_QUEENSIDE;
+
+		if (!(castling_rights() & (Kingside | Queenside)) || is_square_attacked(King, C)) {
+			return;
+		}
+
+		if (castling_rights() & Kingside) {
+			if (piece_on(King + 1) == NO_PIECE && piece_on(King + 2) == NO_PIECE) {
+				if (!is_square_attacked(King + 1, C) && !is_square_attacked(King + 2, C)) {
+					add_move<T>(make_move(King, King + 2, KINGSIDE_CASTLE), moves);
+				}
+			}
+		}
+		if (castling_rights() & Queenside) {
+			if (piece_on(King - 1) == NO_PIECE && piece_on(King - 2) == NO_PIECE && piece_on(King - 3) == NO_PIECE) {
+				if (!is_square_attacked(King - 1, C) && !is_square_attacked(King - 2, C)) {
+					add_move<T>(make_move(King, King - 2, QUEENSIDE_CASTLE), moves);
+				}
+			}
+		}
+	}
+
+	template <int C, int T>
+	void Position::generate(std::vector<Move>& moves) const noexcept {
+		constexpr int us = C;
+		constexpr int them = color_flip(C);
+		Bitboard target;
+
+		switch (T) {
+		case CAPTURES: target = pieces(them); break;
+		case QUIETS:
+		case QUIET_CHECKS: target = empty(); break;
+		case EVASIONS: {
+			Bitboard checking = checkers();
+			// only the king can escape a double check
+			king_moves<T>(pieces(KING, us), ~pieces(us), moves);
+			if (Bitboards::more_than_one(checking)) {
+				return;
+			}
+			int checker = Bitboards::lsb(checking);
+			target = Bitboards::between(king_square(us), checker) | Bitboards::make(checker);
+		} break;
+		default: target = ~pieces(us);
+		}
+
+		Bitboard pawns = pieces(PAWN, us);
+		Bitboard knights = pieces(KNIGHT, us);
+		Bitboard bishops = pieces(BISHOP, us) | pieces(QUEEN, us);
+		Bitboard rooks = pieces(ROOK, us) | pieces(QUEEN, us);
+
+		pawn_moves<C, T>(pawns, target, moves);
+
+		if (T == QUIET_CHECKS) {
+			// pieces that do not uncover a check can only check from the checking squares
+			int ksq = king_square(them);
+			Bitboard discoverers = blockers_for_king(them) & pieces(us);
+			Bitboard queens = pieces(QUEEN, us) & ~discoverers;
+			Bitboard queen_checks = Bitboards::queen_attacks(ksq, empty());
+
+			knight_moves<T>(knights & ~discoverers, target & Bitboards::knight_attacks(ksq), moves);
+			bishop_moves<T>(bishops & ~discoverers & ~queens, target & Bitboards::bishop_attacks(ksq, empty()), empty(), moves);
+			rook_moves<T>(rooks & ~discoverers & ~queens, target & Bitboards::rook_attacks(ksq, empty()), empty(), moves);
+			bishop_moves<T>(queens, target & queen_checks, empty(), moves);
+			rook_moves<T>(queens, target & queen_checks, empty(), moves);
+
+			knights &= discoverers;
+			bishops &= discoverers;
+			rooks &= discoverers;
+		}
+
+		knight_moves<T>(knights, target, moves);
+		bishop_moves<T>(bishops, target, empty(), moves);
+		rook_moves<T>(rooks, target, empty(), moves);
+
+		if (T != EVASIONS) {
+			king_moves<T>(pieces(KING, us), target, moves);
+		}
+		if (T == QUIETS || T == QUIET_CHECKS || T == ALL) {
+			castling_moves<C, T>(moves);
+		}
+	}
+
+	bool Position::is_pseudo_legal(Move move) const noexcept {
 		int us = turn();
 		int them = opponent();
+		int from = move_from(move);
+		int to = move_to(move);
+		int piece = piece_on(from);
 
-		if (!is_square_attacked(king_square(us), us)) {
-			if ((us == WHITE && castling_rights() & WHITE_KINGSIDE) || (us == BLACK && castling_rights() & BLACK_KINGSIDE)) {
-				if (!is_square_attacked(king_square(us) + 1, us) && !is_square_attacked(king_square(us) + 2, us)) {
-					if (piece_on(king_square(us) + 1) == NO_PIECE && piece_on(king_square(us) + 2) == NO_PIECE) {
-						moves.push_back(make_move(king_square(us), king_square(us) + 2, KINGSIDE_CASTLE));
-					}
+		if (piece == NO_PIECE || piece_color(piece) != us || (pieces(us) & Bitboards::make(to))) {
+			return false;
+		}
+
+		int up = pawn_up(us);
+		Bitboard promrank = us == WHITE ? Bitboards::RANK_8 : Bitboards::RANK_1;
+		Bitboard captures = us == WHITE ?
+			Bitboards::pawn_attacks<WHITE>(Bitboards::make(from)) :
+			Bitboards::pawn_attacks<BLACK>(Bitboards::make(from));
+
+		switch (move_flags(move)) {
+		case NORMAL_MOVE: {
+			switch (piece_type(piece)) {
+			case PAWN:
+				if (Bitboards::make(to) & promrank) {
+					return false;
 				}
+				return (to == from + up && piece_on(to) == NO_PIECE) || (captures & pieces(them) & Bitboards::make(to));
+			case KNIGHT: return Bitboards::knight_attacks(from) & Bitboards::make(to);
+			case BISHOP: return Bitboards::bishop_attacks(from, empty()) & Bitboards::make(to);
+			case ROOK: return Bitboards::rook_attacks(from, empty()) & Bitboards::make(to);
+			case QUEEN: return Bitboards::queen_attacks(from, empty()) & Bitboards::make(to);
+			case KING: return Bitboards::king_attacks(from) & Bitboards::make(to);
 			}
-			if ((us == WHITE && castling_rights() & WHITE_QUEENSIDE) || (us == BLACK && castling_rights() & BLACK_QUEENSIDE)) {
-				if (!is_square_attacked(king_square(us) - 1, us) && !is_square_attacked(king_square(us) - 2, us)) {
-					if (piece_on(king_square(us) - 1) == NO_PIECE &&
-						piece_on(king_square(us) - 2) == NO_PIECE &&
-						piece_on(king_square(us) - 3) == NO_PIECE) {
-						moves.push_back(make_move(king_square(us), king_square(us) - 2, QUEENSIDE_CASTLE));
-					}
-				}
+			return false;
+		}
+		case PAWN_DOUBLE_PUSH: {
+			Bitboard homerank = us == WHITE ? Bitboards::RANK_2 : Bitboards::RANK_7;
+			return piece_type(piece) == PAWN && (Bitboards::make(from) & homerank) && to == from + up + up &&
+				piece_on(from + up) == NO_PIECE && piece_on(to) == NO_PIECE;
+		}
+		case EN_PASSANT_CAPTURE: {
+			return piece_type(piece) == PAWN && to == en_passant_square() && (captures & Bitboards::make(to));
+		}
+		case PROMOTION_QUEEN:
+		case PROMOTION_ROOK:
+		case PROMOTION_BISHOP:
+		case PROMOTION_KNIGHT: {
+			if (piece_type(piece) != PAWN || !(Bitboards::make(to) & promrank)) {
+				return false;
+			}
+			return (to == from + up && piece_on(to) == NO_PIECE) || (captures & pieces(them) & Bitboards::make(to));
+		}
+		case KINGSIDE_CASTLE:
+		case QUEENSIDE_CASTLE: {
+			bool kingside = move_flags(move) == KINGSIDE_CASTLE;
+			int right = us == WHITE ?
+				(kingside ? WHITE_KINGSIDE : WHITE_QUEENSIDE) :
+				(kingside ? BLACK_KINGSIDE : BLACK_QUEENSIDE);
+			int king = us == WHITE ? E1 : E8;
+			int rook = kingside ? king + 3 : king - 4;
+			int step = kingside ? 1 : -1;
+
+			if (piece_type(piece) != KING || from != king || to != king + step + step ||
+				!(castling_rights() & right) || piece_on(rook) != make_piece(ROOK, us) ||
+				(Bitboards::between(king, rook) & pieces())) {
+				return false;
 			}
+			// same conditions as in castling_moves
+			return !is_square_attacked(king, us) && !is_square_attacked(king + step, us) && !is_square_attacked(to, us);
+		}
 		}
+
+		return false;
+	}
+
+	bool Position::is_legal(Move move) const noexcept {
+		return is_legal(move, blockers_for_king(turn()), checkers());
+	}
+
+	bool Position::is_legal(Move move, Bitboard pinned, Bitboard checkers) const noexcept {
+		int us = turn();
+		int them = opponent();
+		int from = move_from(move);
+		int to = move_to(move);
+		int ksq = king_square(us);
+
+		switch (move_flags(move)) {
+		case KINGSIDE_CASTLE:
+		case QUEENSIDE_CASTLE:
+			// attacked squares are already checked when generating
+			return true;
+		case EN_PASSANT_CAPTURE: {
+			int capsq = to - pawn_up(us);
+			Bitboard occupied = (pieces() ^ Bitboards::make(from) ^ Bitboards::make(capsq)) | Bitboards::make(to);
+			return !(attackers_to(ksq, occupied) & pieces(them) & occupied);
+		}
+		}
+
+		if (from == ksq) {
+			return !(attackers_to(to, pieces() ^ Bitboards::make(from)) & pieces(them));
+		}
+
+		if (checkers) {
+			if (Bitboards::more_than_one(checkers)) {
+				return false;
+			}
+			// capture the checker or block the check
+			int checker = Bitboards::lsb(checkers);
+			if (to != checker && !(Bitboards::between(ksq, checker) & Bitboards::make(to))) {
+				return false;
+			}
+		}
+
+		return !(pinned & Bitboards::make(from)) || Bitboards::aligned(from, to, ksq);
+	}
+
+	Bitboard Position::checkers() const noexcept {
+		return attackers_to(king_square(), pieces()) & pieces(opponent());
 	}
 
-	bool Position::is_legal(Move move) noexcept {
-		do_move(move);
-		bool is_legal = !is_square_attacked(king_square(opponent()), opponent());
-		undo_move(move);
-		return is_legal;
+	Bitboard Position::blockers_for_king(int color) const noexcept {
+		int ksq = king_square(color);
+		int them = color_flip(color);
+
+		Bitboard snipers =
+			(Bitboards::bishop_attacks(ksq, Bitboards::ALL) & (pieces(BISHOP, them) | pieces(QUEEN, them))) |
+			(Bitboards::rook_attacks(ksq, Bitboards::ALL) & (pieces(ROOK, them) | pieces(QUEEN, them)));
+		Bitboard occupied = pieces() ^ snipers;
+		Bitboard blockers = Bitboards::EMPTY;
+
+		while (snipers) {
+			int s = Bitboards::pop(snipers);
+			Bitboard b = Bitboards::between(ksq, s) & occupied;
+			if (b && !Bitboards::more_than_one(b)) {
+				blockers |= b;
+			}
+		}
+
+		return blockers;
 	}
 
 	bool Position::is_square_attacked(int square, int defender) const noexcept {
-		Bitboard b = Bitboards::make(square);
 		int attacker = color_flip(defender);
 
-		if (Bitboards::bishop_attacks(b, empty()) & (pieces(BISHOP, attacker) | pieces(QUEEN, attacker))) {
+		if (Bitboards::bishop_attacks(square, empty()) & (pieces(BISHOP, attacker) | pieces(QUEEN, attacker))) {
 			return true;
 		}
-		if (Bitboards::rook_attacks(b, empty()) & (pieces(ROOK, attacker) | pieces(QUEEN, attacker))) {
+		if (Bitboards::rook_attacks(square, empty()) & (pieces(ROOK, attacker) | pieces(QUEEN, attacker))) {
 			return true;
 		}
-		if (Bitboards::knight_attacks(b) & pieces(KNIGHT, attacker)) {
+		if (Bitboards::knight_attacks(square) & pieces(KNIGHT, attacker)) {
 			return true;
 		}
-		if (Bitboards::king_attacks(b) & pieces(KING, attacker)) {
+		if (Bitboards::king_attacks(square) & pieces(KING, attacker)) {
 			return true;
 		}
 
+		Bitboard b = Bitboards::make(square);
 		if (defender == WHITE) {
 			if (Bitboards::pawn_attacks<WHITE>(b) & pieces(PAWN, attacker)) {
 				return true;
@@ -488,59 +829,222 @@ namespace Chess {
 		return false;
 	}
 
-	std::vector<Move> Position::legal_moves(bool only_captures) noexcept {
+	Bitboard Position::attackers_to(int square, Bitboard occupied) const noexcept {
+		Bitboard b = Bitboards::make(square);
+		Bitboard bishops = pieces(BISHOP, WHITE) | pieces(BISHOP, BLACK) | pieces(QUEEN, WHITE) | pieces(QUEEN, BLACK);
+		Bitboard rooks = pieces(ROOK, WHITE) | pieces(ROOK, BLACK) | pieces(QUEEN, WHITE) | pieces(QUEEN, BLACK);
+
+		return
+			(Bitboards::pawn_attacks<BLACK>(b) & pieces(PAWN, WHITE)) |
+			(Bitboards::pawn_attacks<WHITE>(b) & pieces(PAWN, BLACK)) |
+			(Bitboards::knight_attacks(square) & (pieces(KNIGHT, WHITE) | pieces(KNIGHT, BLACK))) |
+			(Bitboards::king_attacks(square) & (pieces(KING, WHITE) | pieces(KING, BLACK))) |
+			(Bitboards::bishop_attacks(square, ~occupied) & bishops) |
+			(Bitboards::rook_attacks(square, ~occupied) & rooks);
+	}
+
+	Value Position::see(Move move) const noexcept {
+		int from = move_from(move);
+		int to = move_to(move);
+		int flags = move_flags(move);
 
+		if (flags == KINGSIDE_CASTLE || flags == QUEENSIDE_CASTLE) {
+			return 0;
+		}
+
+		constexpr Bitboard Promranks = Bitboards::RANK_1 | Bitboards::RANK_8;
+		constexpr Value Promotion_gain = piecetype_values[QUEEN] - piecetype_values[PAWN];
+
+		Value gain[32];
+		int d = 0;
+
+		Bitboard occupied = pieces() ^ Bitboards::make(from);
+		int victim = piece_type(piece_on(from));
+
+		gain[0] = piecetype_values[piece_type(piece_on(to))];
+		if (flags == EN_PASSANT_CAPTURE) {
+			gain[0] = piecetype_values[PAWN];
+			occupied ^= Bitboards::make(to - pawn_up(piece_color(piece_on(from))));
+		}
+		else if (is_promotion(move)) {
+			victim = promotion_type(move);
+			gain[0] += piecetype_values[victim] - piecetype_values[PAWN];
+		}
+
+		Bitboard bishops = pieces(BISHOP, WHITE) | pieces(BISHOP, BLACK) | pieces(QUEEN, WHITE) | pieces(QUEEN, BLACK);
+		Bitboard rooks = pieces(ROOK, WHITE) | pieces(ROOK, BLACK) | pieces(QUEEN, WHITE) | pieces(QUEEN, BLACK);
+		Bitboard attackers = attackers_to(to, occupied) & occupied;
+		int side = piece_color(piece_on(from));
+
+		while (true) {
+			side = color_flip(side);
+			Bitboard side_attackers = attackers & pieces(side);
+			if (!side_attackers) {
+				break;
+			}
+
+			// least valuable attacker
+			int type = PAWN;
+			Bitboard b;
+			while (!(b = side_attackers & pieces(type, side))) {
+				type++;
+			}
+
+			occupied ^= b & (~b + 1);
+
+			// x-rays behind the attacker
+			if (type == PAWN || type == BISHOP || type == QUEEN) {
+				attackers |= Bitboards::bishop_attacks(to, ~occupied) & bishops;
+			}
+			if (type == ROOK || type == QUEEN) {
+				attackers |= Bitboards::rook_attacks(to, ~occupied) & rooks;
+			}
+			attackers &= occupied;
+
+			// king can not capture into a defended square
+			if (type == KING && (attackers & pieces(color_flip(side)))) {
+				break;
+			}
+
+			d++;
+			gain[d] = piecetype_values[victim] - gain[d - 1];
+			victim = type;
+
+			if (type == PAWN && (Bitboards::make(to) & Promranks)) {
+				gain[d] += Promotion_gain;
+				victim = QUEEN;
+			}
+		}
+
+		for (; d > 0; d--) {
+			gain[d - 1] = -std::max(-gain[d - 1], gain[d]);
+		}
+
+		return gain[0];
 	}
 
-	std::vector<Move> Position::legal_moves(bool only_captures) noexcept {
-		std::vector<Move> pseudo_legal;
-		pseudo_legal.reserve(32);
+	bool Position::see_ge(Move move, Value threshold) const noexcept {
+		constexpr Bitboard Promranks = Bitboards::RANK_1 | Bitboards::RANK_8;
 
+		// quick answers for plain captures, otherwise do the full exchange
+		if (move_flags(move) == NORMAL_MOVE && !(Bitboards::make(move_to(move)) & Promranks)) {
+			Value swap = piecetype_values[piece_type(piece_on(move_to(move)))] - threshold;
+			if (swap < 0) {
+				return false;
+			}
+			if (piecetype_values[piece_type(piece_on(move_from(move)))] <= swap) {
+				return true;
+			}
+		}
 
-		// First caps
-		Bitboard target = pieces(opponent());
-		turn() == WHITE ? pawn_moves<WHITE>(pieces(PAWN, turn()), target, pseudo_legal) : pawn_moves<BLACK>(pieces(PAWN, turn()), target, pseudo_legal);
-		knight_moves(pieces(KNIGHT, turn()), target, pseudo_legal);
-		bishop_moves(pieces(BISHOP, turn()) | pieces(QUEEN, turn()), target, empty(), pseudo_legal);
-		rook_moves(pieces(ROOK, turn()) | pieces(QUEEN, turn()), target, empty(), pseudo_legal);
-		king_moves(pieces(KING, turn()), target, pseudo_legal);
+		return see(move) >= threshold;
+	}
+
+	template <int T>
+	std::vector<Move> Position::legal_moves() noexcept {
+		std::vector<Move> moves;
+		moves.reserve(T == ALL || T == QUIETS ? 48 : 16);
 
-		if (!only_captures) {
-			target = empty();
-			turn() == WHITE ? pawn_moves<WHITE>(pieces(PAWN, turn()), target, pseudo_legal) : pawn_moves<BLACK>(pieces(PAWN, turn()), target, pseudo_legal);
-			knight_moves(pieces(KNIGHT, turn()), target, pseudo_legal);
-			bishop_moves(pieces(BISHOP, turn()) | pieces(QUEEN, turn()), target, empty(), pseudo_legal);
-			rook_moves(pieces(ROOK, turn()) | pieces(QUEEN, turn()), target, empty(), pseudo_legal);
-			king_moves(pieces(KING, turn()), target, pseudo_legal);
-			castling_moves(pseudo_legal);
+		turn() == WHITE ? generate_legal<WHITE, T>(moves) : generate_legal<BLACK, T>(moves);
+
+		return moves;
+	}
+
+	template <int C, int T>
+	void Position::generate_legal(std::vector<Move>& moves) const noexcept {
+		Bitboard pinned = blockers_for_king(C) & pieces(C);
+		Bitboard checking = checkers();
+
+		if ((T == ALL || T == EVASIONS) && checking) {
+			generate<C, EVASIONS>(moves);
 		}
-		/*Bitboard target = 0;
-		if (only_captures) {
-			target = pieces(opponent());
+		else if (T == EVASIONS) {
+			generate<C, ALL>(moves);
 		}
 		else {
-			target = ~pieces(turn());
+			generate<C, T>(moves);
 		}
-		turn() == WHITE ? pawn_moves<WHITE>(pieces(PAWN, turn()), target, pseudo_legal) : pawn_moves<BLACK>(pieces(PAWN, turn()), target, pseudo_legal);
-		knight_moves(pieces(KNIGHT, turn()), target, pseudo_legal);
-		bishop_moves(pieces(BISHOP, turn()) | pieces(QUEEN, turn()), target, empty(), pseudo_legal);
-		rook_moves(pieces(ROOK, turn()) | pieces(QUEEN, turn()), target, empty(), pseudo_legal);
-		king_moves(pieces(KING, turn()), target, pseudo_legal);
-		if (!only_captures) {
-			castling_moves(pseudo_legal);
-		}*/
-		
 
-		std::vector<Move> legal;
-		legal.reserve(32);
+		moves.erase(std::remove_if(moves.begin(), moves.end(), [&](Move move) {
+			return !is_legal(move, pinned, checking);
+		}), moves.end());
+	}
 
-		for (const auto move : pseudo_legal) {
-			if (is_legal(move)) {
-				legal.push_back(move);
+	template std::vector<Move> Position::legal_moves<CAPTURES>() noexcept;
+	template std::vector<Move> Position::legal_moves<QUIETS>() noexcept;
+	template std::vector<Move> Position::legal_moves<EVASIONS>() noexcept;
+	template std::vector<Move> Position::legal_moves<QUIET_CHECKS>() noexcept;
+	template std::vector<Move> Position::legal_moves<ALL>() noexcept;
+
+	bool Position::gives_check(Move move) const noexcept {
+		int us = turn();
+		int from = move_from(move);
+		int to = move_to(move);
+		int ksq = king_square(opponent());
+		int type = piece_type(piece_on(from));
+
+		Bitboard occupied = (pieces() ^ Bitboards::make(from)) | Bitboards::make(to);
+		Bitboard bishops = pieces(BISHOP, us) | pieces(QUEEN, us);
+		Bitboard rooks = pieces(ROOK, us) | pieces(QUEEN, us);
+
+		switch (move_flags(move)) {
+		case KINGSIDE_CASTLE:
+		case QUEENSIDE_CASTLE: {
+			bool kingside = move_flags(move) == KINGSIDE_CASTLE;
+			int rook_from = kingside ? from + 3 : from - 4;
+			int rook_to = kingside ? from + 1 : from - 1;
+			occupied = (occupied ^ Bitboards::make(rook_from)) | Bitboards::make(rook_to);
+			return Bitboards::rook_attacks(rook_to, ~occupied) & Bitboards::make(ksq);
+		}
+		case EN_PASSANT_CAPTURE: {
+			// the captured pawn may uncover a check as well
+			occupied ^= Bitboards::make(to - pawn_up(us));
+			rooks &= occupied;
+			bishops &= occupied;
+			if ((Bitboards::bishop_attacks(ksq, ~occupied) & bishops) || (Bitboards::rook_attacks(ksq, ~occupied) & rooks)) {
+				return true;
 			}
+		} break;
+		case PROMOTION_QUEEN:
+		case PROMOTION_ROOK:
+		case PROMOTION_BISHOP:
+		case PROMOTION_KNIGHT:
+			type = promotion_type(move);
+			break;
 		}
 
-		return legal;
+		// direct check
+		Bitboard k = Bitboards::make(ksq);
+		switch (type) {
+		case PAWN:
+			if ((us == WHITE ? Bitboards::pawn_attacks<WHITE>(Bitboards::make(to)) : Bitboards::pawn_attacks<BLACK>(Bitboards::make(to))) & k) {
+				return true;
+			}
+			break;
+		case KNIGHT:
+			if (Bitboards::knight_attacks(to) & k) {
+				return true;
+			}
+			break;
+		case BISHOP:
+			if (Bitboards::bishop_attacks(to, ~occupied) & k) {
+				return true;
+			}
+			break;
+		case ROOK:
+			if (Bitboards::rook_attacks(to, ~occupied) & k) {
+				return true;
+			}
+			break;
+		case QUEEN:
+			if (Bitboards::queen_attacks(to, ~occupied) & k) {
+				return true;
+			}
+			break;
+		}
+
+		// discovered check
+		return (blockers_for_king(opponent()) & Bitboards::make(from)) && !Bitboards::aligned(from, to, ksq);
 	}
 
 	u64 Position::calculate_hash() const {
@@ -564,4 +1068,36 @@ namespace Chess {
 		return hash;
 	}
 
+	u32 Position::calculate_pawn_key() const {
+		u32 key = 0;
+		Bitboard pawns = board_.by_type_[PAWN];
+		while (pawns) {
+			int s = Bitboards::pop(pawns);
+			key ^= pawn_hash(piece_on(s), s);
+		}
+		return key;
+	}
+
+	Score Position::calculate_psq_score() const {
+		Score score = { 0, 0 };
+		for (int s = A1; s < SQUARE_COUNT; s++) {
+			int p = piece_on(s);
+			if (p != NO_PIECE) {
+				score += PSQT::get(p, s);
+			}
+		}
+		return score;
+	}
+
+	int Position::calculate_phase() const {
+		int phase = 0;
+		for (int s = A1; s < SQUARE_COUNT; s++) {
+			int p = piece_on(s);
+			if (p != NO_PIECE) {
+				phase += PSQT::phase(p);
+			}
+		}
+		return phase;
+	}
+
 }
\ No newline at end of file
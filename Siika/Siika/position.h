@@ -9,12 +9,23 @@
 
 #include "chess.h"
 #include "bitboard.h"
+#include "psqt.h"
+#include "nnue.h"
 #include "util.h"
 
 namespace Chess {
 
 	constexpr int MAX_PLYS = 512;
 
+	// Move generation types. CAPTURES includes all promotions and QUIETS the
+	// rest, QUIET_CHECKS the quiets that give check. EVASIONS expects the side
+	// to move to be in check.
+	enum GenType { CAPTURES, QUIETS, EVASIONS, QUIET_CHECKS, ALL };
+
+	// How a move is taken back: make/unmake reverses it, copy-make copies
+	// back the board saved before the move.
+	enum MakeMode { MAKE_UNMAKE, COPY_MAKE };
+
 	typedef i32 Value;
 	constexpr Value piecetype_values[PIECETYPE_COUNT] = {
 			0, 100, 300, 300, 500, 900, 50000
@@ -30,24 +41,75 @@ namespace Chess {
 		std::array<u64, FILE_COUNT> ep_file_numbers;
 	};
 
+	// A position in 32 bytes: the occupied squares, then a nibble per piece
+	// in square order, the low nibble first. Unused bits are zero, so that
+	// equal positions pack to equal bytes.
+	struct PackedPosition {
+		u64 occupied;
+		std::array<u8, 16> pieces;
+		u16 fullmove;
+		u8 turn_and_castling; // black to move in bit 0, the rights above it
+		u8 en_passant;
+		u8 halfmove;
+		std::array<u8, 3> unused;
+	};
+
+	static_assert(sizeof(PackedPosition) == 32, "PackedPosition should be 32 bytes");
+
 	class Position {
 	public:
 		static const std::string DEFAULT;
 
+		// Board state, kept together so that it fits in a few cache lines.
+		// by_type_[NO_PIECETYPE] holds all pieces, by_color_ is indexed by color_index.
+		struct Board {
+			std::array<Bitboard, PIECETYPE_COUNT> by_type_;
+			std::array<Bitboard, 2> by_color_;
+			std::array<u8, SQUARE_COUNT> squares_;
+			std::array<Value, 2> material_;
+			Score psq_;
+			int phase_;
+		};
+
 		Position() noexcept;
 		Position(const std::string& fen) noexcept;
+		Position(const Position& other) noexcept;
+		Position& operator=(const Position& other) noexcept;
 		void set_default() noexcept;
 		void set(const std::string& fen) noexcept;
 
+		// The fen has a board of 8 ranks with one king a side and no pawns
+		// on the back ranks, then the turn, castling and en passant fields.
+		// set expects a valid fen.
+		static bool is_valid_fen(const std::string& fen);
+
+		// Sets a valid fen, false when it is not one or the side to move
+		// can capture the king
+		bool set_legal(const std::string& fen);
+		void set(const PackedPosition& packed) noexcept;
+
+		// False when there are more than 32 pieces to pack
+		bool pack(PackedPosition& packed) const noexcept;
+
+		// Keeps accumulators[ply] up to date for NNUE evaluation, which
+		// needs MAX_PLYS of them. A copy is not attached.
+		void attach(NNUE::Accumulator* accumulators) noexcept;
+		const NNUE::Accumulator* accumulator() const noexcept;
+
 		std::string fen() const noexcept;
 
 		int turn() const noexcept;
 		int opponent() const noexcept;
 		int fullmove() const noexcept;
 		u64 hash() const noexcept;
+		u32 pawn_key() const noexcept;
 
 		bool is_3x_repeat() const noexcept;
 
+		// Neither side can mate: bare kings, a single minor piece, or only
+		// bishops all on squares of one colour
+		bool is_insufficient_material() const noexcept;
+
 		int en_passant_square() const noexcept;
 		int castling_rights() const noexcept;
 		int halfmove() const noexcept;
@@ -56,6 +118,13 @@ namespace Chess {
 		Value material(int color) const noexcept;
 		Value material_diff() const noexcept;
 
+		// Piece-square score for white and the game phase, both incremental
+		Score psq_score() const noexcept;
+		int phase() const noexcept;
+		Score calculate_psq_score() const;
+		int calculate_phase() const;
+		u32 calculate_pawn_key() const;
+
 		int piece_on(int square) const noexcept;
 		int king_square() const noexcept;
 		int king_square(int color) const noexcept;
@@ -71,60 +140,108 @@ namespace Chess {
 		void do_move(Move move) noexcept;
 		void undo_move(Move move) noexcept;
 
-		std::vector<Move> legal_moves(bool only_captures = false) noexcept;
+		// Either mode, the board is saved to snapshot only for copy-make
+		template <int M>
+		void do_move(Move move, Board& snapshot) noexcept;
+		template <int M>
+		void undo_move(Move move, const Board& snapshot) noexcept;
+
+		template <int T = ALL>
+		std::vector<Move> legal_moves() noexcept;
+
+		bool gives_check(Move move) const noexcept;
 
 		bool is_in_check() const noexcept;
 		bool is_in_check(int color) const noexcept;
 
+		Bitboard attackers_to(int square, Bitboard occupied) const noexcept;
+		Bitboard checkers() const noexcept;
+		Bitboard blockers_for_king(int color) const noexcept;
+
+		// Validation of moves that do not come from the generator, e.g. killers.
+		// is_legal expects a pseudo-legal move.
+		bool is_pseudo_legal(Move move) const noexcept;
+		bool is_legal(Move move) const noexcept;
+
+		// Static exchange evaluation of the capture sequence on the move's target square
+		Value see(Move move) const noexcept;
+		bool see_ge(Move move, Value threshold) const noexcept;
+
 	private:
 		void reset() noexcept;
 		int captured_piece() const noexcept;
 
 		template <int C>
+		void do_move(Move move) noexcept;
+		template <int C>
+		void undo_move(Move move) noexcept;
+
+		template <int C, int T>
+		void generate_legal(std::vector<Move>& moves) const noexcept;
+		template <int C, int T>
+		void generate(std::vector<Move>& moves) const noexcept;
+		template <int T>
+		void add_move(Move move, std::vector<Move>& moves) const noexcept;
+
+		template <int C, int T>
 		void pawn_moves(Bitboard p, Bitboard target, std::vector<Move>& moves) const noexcept;
+		template <int T>
 		void knight_moves(Bitboard p, Bitboard target, std::vector<Move>& moves) const noexcept;
+		template <int T>
 		void bishop_moves(Bitboard p, Bitboard target, Bitboard empty, std::vector<Move>& moves) const noexcept;
+		template <int T>
 		void rook_moves(Bitboard p, Bitboard target, Bitboard empty, std::vector<Move>& moves) const noexcept;
+		template <int T>
 		void king_moves(Bitboard p, Bitboard target, std::vector<Move>& moves) const noexcept;
+		template <int C, int T>
 		void castling_moves(std::vector<Move>& moves) const noexcept;
 
-		bool is_legal(Move move) noexcept;
+		bool is_legal(Move move, Bitboard pinned, Bitboard checkers) const noexcept;
 		bool is_square_attacked(int square, int defender) const noexcept;
 
 		u64 calculate_hash() const;
 		inline u64 piece_hash(int square) const {
 			return zobrist_.piece_numbers[piece_on(square) * SQUARE_COUNT + square];
 		}
-		
-		void update_opponent_attacks() noexcept;
+		// The pawn key uses the low half of the piece numbers
+		static inline u32 pawn_hash(int piece, int square) {
+			return static_cast<u32>(zobrist_.piece_numbers[piece * SQUARE_COUNT + square]);
+		}
 
 	private:
+		// Irreversible state, one per ply
+		struct Undo {
+			u64 hash_;
+			u8 ep_;
+			u8 cr_;
+			u8 cap_;
+			u8 halfmove_;
+			u32 pawn_key_;
+		};
+
+		static_assert(sizeof(Board) <= 3 * 64, "Board should fit in three cache lines");
+		static_assert(sizeof(Undo) == 16, "Undo should be 16 bytes");
+
+		Board board_;
 		int turn_;
 		int fullmove_;
-		std::array<int, SQUARE_COUNT> squares_;
+		int ply_;
 
-		std::array<Bitboard, PIECE_COUNT> bitboards_;
+		// NNUE accumulators indexed by ply, owned by the caller of attach
+		NNUE::Accumulator* accumulators_ = nullptr;
+		NNUE::DirtyPieces dirty_;
 
-		int ply_;
-		struct Undo {
-			unsigned char ep_;
-			unsigned char cr_;
-			unsigned char cap_;
-			unsigned char halfmove_;
-			u64 hash_;
-			Bitboard opponent_attacks_;
-			int checkers_;
-		} undo_[MAX_PLYS];
+		// Only undo_[0..ply_] is valid, which is all a copy takes
+		std::array<Undo, MAX_PLYS> undo_;
 
 		static Zobrist zobrist_;
-
-		Value material_[NO_COLOR + 1] = { 0 };
 	};
 
 	inline int Position::turn() const noexcept { return turn_; }
 	inline int Position::opponent() const noexcept { return color_flip(turn_); }
 	inline int Position::fullmove() const noexcept { return fullmove_; }
 	inline u64 Position::hash() const noexcept { return undo_[ply_].hash_; }
+	inline u32 Position::pawn_key() const noexcept { return undo_[ply_].pawn_key_; }
 
 	inline int Position::en_passant_square() const noexcept { return undo_[ply_].ep_; }
 	inline int Position::castling_rights() const noexcept { return undo_[ply_].cr_; }
@@ -132,47 +249,77 @@ namespace Chess {
 	inline int Position::captured_piece() const noexcept { return undo_[ply_].cap_; }
 
 	inline Value Position::material() const noexcept { return material(turn()); }
-	inline Value Position::material(int color) const noexcept { return material_[color]; }
+	inline Value Position::material(int color) const noexcept { return board_.material_[color_index(color)]; }
 	inline Value Position::material_diff() const noexcept { return material() - material(opponent()); }
 
+	inline Score Position::psq_score() const noexcept { return board_.psq_; }
+	inline int Position::phase() const noexcept { return board_.phase_; }
+
+
+	inline const NNUE::Accumulator* Position::accumulator() const noexcept {
+		return accumulators_ ? &accumulators_[ply_] : nullptr;
+	}
 
 	inline int Position::piece_on(int square) const noexcept {
-		return squares_[square];
+		return board_.squares_[square];
 	}
 
 	inline int Position::king_square() const noexcept { return king_square(turn()); }
 	inline int Position::king_square(int color) const noexcept { return Bitboards::lsb(pieces(KING, color)); }
 
 	inline void Position::put_piece(int piece, int square) noexcept {
-		squares_[square] = piece;
+		Bitboard b = Bitboards::make(square);
+		int c = color_index(piece_color(piece));
 
-		bitboards_[piece] |= Bitboards::make(square);
-		bitboards_[piece_color(piece)] |= Bitboards::make(square);
+		board_.squares_[square] = piece;
+		board_.by_type_[NO_PIECETYPE] |= b;
+		board_.by_type_[piece_type(piece)] |= b;
+		board_.by_color_[c] |= b;
 
 		// material
-		material_[piece_color(piece)] += piecetype_values[piece_type(piece)];
+		board_.material_[c] += piecetype_values[piece_type(piece)];
+		board_.psq_ += PSQT::get(piece, square);
+		board_.phase_ += PSQT::phase(piece);
+
+		if (accumulators_) {
+			dirty_.add(piece, NO_SQUARE, square);
+		}
 	}
 
 	inline void Position::take_piece(int square) noexcept {
-		int piece = squares_[square];
-		squares_[square] = NO_PIECE;
+		Bitboard b = Bitboards::make(square);
+		int piece = board_.squares_[square];
+		int c = color_index(piece_color(piece));
 
-		bitboards_[piece] &= ~Bitboards::make(square);
-		bitboards_[piece_color(piece)] &= ~Bitboards::make(square);
+		board_.squares_[square] = NO_PIECE;
+		board_.by_type_[NO_PIECETYPE] ^= b;
+		board_.by_type_[piece_type(piece)] ^= b;
+		board_.by_color_[c] ^= b;
 
 		// material
-		material_[piece_color(piece)] -= piecetype_values[piece_type(piece)];
+		board_.material_[c] -= piecetype_values[piece_type(piece)];
+		board_.psq_ -= PSQT::get(piece, square);
+		board_.phase_ -= PSQT::phase(piece);
+
+		if (accumulators_) {
+			dirty_.add(piece, square, NO_SQUARE);
+		}
 	}
 
 	inline void Position::move_piece(int from, int to) noexcept {
-		int piece = squares_[from];
-		squares_[to] = squares_[from];
-		squares_[from] = NO_PIECE;
-
 		Bitboard fromto = Bitboards::make(from) | Bitboards::make(to);
+		int piece = board_.squares_[from];
+
+		board_.squares_[to] = piece;
+		board_.squares_[from] = NO_PIECE;
+		board_.by_type_[NO_PIECETYPE] ^= fromto;
+		board_.by_type_[piece_type(piece)] ^= fromto;
+		board_.by_color_[color_index(piece_color(piece))] ^= fromto;
+		board_.psq_ += PSQT::get(piece, to) - PSQT::get(piece, from);
 
-		bitboards_[piece] ^= fromto;
-		bitboards_[piece_color(piece)] ^= fromto;
+		if (accumulators_) {
+			dirty_.add(piece, from, to);
+		}
 	}
 
 	inline Bitboard Position::empty() const noexcept {
@@ -180,31 +327,75 @@ namespace Chess {
 	}
 
 	inline Bitboard Position::pieces() const noexcept {
-		return bitboards_[WHITE] | bitboards_[BLACK];
+		return board_.by_type_[NO_PIECETYPE];
 	}
 
 	inline Bitboard Position::pieces(int color) const noexcept {
-		return bitboards_[color];
+		return board_.by_color_[color_index(color)];
 	}
 
 	inline Bitboard Position::pieces(int type, int color) const noexcept {
-		return bitboards_[make_piece(type, color)];
+		return board_.by_type_[type] & board_.by_color_[color_index(color)];
+	}
+
+	// Quiet checks are filtered here, the other types only by their targets
+	template <int T>
+	inline void Position::add_move(Move move, std::vector<Move>& moves) const noexcept {
+		if (T != QUIET_CHECKS || gives_check(move)) {
+			moves.push_back(move);
+		}
 	}
 
-	template <int C>
+	// target limits the destination squares only for evasions
+	template <int C, int T>
 	void Position::pawn_moves(Bitboard p, Bitboard target, std::vector<Move>& moves) const noexcept {
-		Bitboard enemy = pieces(opponent());
-		Bitboard dest, prom;
+		constexpr bool Quiets = T == QUIETS || T == QUIET_CHECKS || T == EVASIONS || T == ALL;
+		constexpr bool Captures = T == CAPTURES || T == EVASIONS || T == ALL;
 
 		constexpr int Up = C == WHITE ? NORTH : SOUTH;
 		constexpr Bitboard Homerank = C == WHITE ? Bitboards::RANK_2 : Bitboards::RANK_7;
 		constexpr Bitboard Promrank = C == WHITE ? Bitboards::RANK_8 : Bitboards::RANK_1;
 
-		// single push
-		dest = Bitboards::shift<Up>(p) & empty() & target;
+		Bitboard enemy = pieces(color_flip(C));
+		Bitboard empty_squares = empty();
+		Bitboard dest, prom;
+
+		if (T == EVASIONS) {
+			enemy &= target;
+		}
+
+		// pushes
+		dest = Bitboards::shift<Up>(p) & empty_squares;
 		prom = dest & Promrank;
 		dest ^= prom;
 
+		if (Quiets) {
+			Bitboard dbl = Bitboards::shift<Up>(Bitboards::shift<Up>(p & Homerank) & empty_squares) & empty_squares;
+
+			if (T == EVASIONS) {
+				dest &= target;
+				dbl &= target;
+			}
+
+			while (dest) {
+				int to = Bitboards::pop(dest);
+				add_move<T>(make_move(to - Up, to), moves);
+			}
+
+			while (dbl) {
+				int to = Bitboards::pop(dbl);
+				add_move<T>(make_move(to - Up - Up, to, PAWN_DOUBLE_PUSH), moves);
+			}
+		}
+
+		if (!Captures) {
+			return;
+		}
+
+		// promotions
+		if (T == EVASIONS) {
+			prom &= target;
+		}
 		while (prom) {
 			int to = Bitboards::pop(prom);
 			moves.push_back(make_move(to - Up, to, PROMOTION_QUEEN));
@@ -213,26 +404,13 @@ namespace Chess {
 			moves.push_back(make_move(to - Up, to, PROMOTION_KNIGHT));
 		}
 
-		while (dest) {
-			int to = Bitboards::pop(dest);
-			moves.push_back(make_move(to - Up, to));
-		}
-
-		// double push
-		dest = Bitboards::shift<Up>(p & Homerank) & empty();
-		dest = Bitboards::shift<Up>(dest) & empty() & target;
-		while (dest) {
-			int to = Bitboards::pop(dest);
-			moves.push_back(make_move(to - Up - Up, to, PAWN_DOUBLE_PUSH));
-		}
-
 		// caps
 		int ep = en_passant_square();
 		Bitboard epbb = Bitboards::EMPTY;
 		if (ep != NO_SQUARE) { epbb = Bitboards::make(ep); }
 
 		// east
-		dest = Bitboards::shift<Up + EAST>(p) & target;
+		dest = Bitboards::shift<Up + EAST>(p);
 		if (epbb & dest) {
 			moves.push_back(make_move(ep - Up - EAST, ep, EN_PASSANT_CAPTURE));
 		}
@@ -254,7 +432,7 @@ namespace Chess {
 		}
 
 		// west
-		dest = Bitboards::shift<Up + WEST>(p) & target;
+		dest = Bitboards::shift<Up + WEST>(p);
 		if (epbb & dest) {
 			moves.push_back(make_move(ep - Up - WEST, ep, EN_PASSANT_CAPTURE));
 		}
@@ -276,12 +454,41 @@ namespace Chess {
 		}
 	}
 
+	inline void Position::do_move(Move move) noexcept {
+		turn() == WHITE ? do_move<WHITE>(move) : do_move<BLACK>(move);
+	}
+
+	inline void Position::undo_move(Move move) noexcept {
+		turn() == WHITE ? undo_move<BLACK>(move) : undo_move<WHITE>(move);
+	}
+
+	template <int M>
+	inline void Position::do_move(Move move, Board& snapshot) noexcept {
+		if (M == COPY_MAKE) {
+			snapshot = board_;
+		}
+		do_move(move);
+	}
+
+	template <int M>
+	inline void Position::undo_move(Move move, const Board& snapshot) noexcept {
+		if (M == COPY_MAKE) {
+			board_ = snapshot;
+			turn_ = color_flip(turn_);
+			if (turn_ == BLACK) fullmove_--;
+			ply_--;
+		}
+		else {
+			undo_move(move);
+		}
+	}
+
 	inline bool Position::is_in_check() const noexcept {
 		return is_in_check(turn());
 	}
 
 	inline bool Position::is_in_check(int color) const noexcept {
-		return is_square_attacked(king_square(), turn());
+		return is_square_attacked(king_square(color), color);
 	}
 }
 
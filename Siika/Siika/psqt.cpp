@@ -0,0 +1,135 @@
+#include "psqt.h"
+
+namespace Chess {
+
+	std::array<std::array<Score, SQUARE_COUNT>, PIECE_COUNT> PSQT::table_;
+	bool PSQT::initialized_ = PSQT::initialize();
+
+	namespace {
+		// Tables from white's point of view with a8 first, mostly from
+		// Tomasz Michniewski's simplified evaluation function
+		constexpr i32 pawn_mg[SQUARE_COUNT] = {
+			  0,  0,  0,  0,  0,  0,  0,  0,
+			 50, 50, 50, 50, 50, 50, 50, 50,
+			 10, 10, 20, 30, 30, 20, 10, 10,
+			  5,  5, 10, 25, 25, 10,  5,  5,
+			  0,  0,  0, 20, 20,  0,  0,  0,
+			  5, -5,-10,  0,  0,-10, -5,  5,
+			  5, 10, 10,-20,-20, 10, 10,  5,
+			  0,  0,  0,  0,  0,  0,  0,  0
+		};
+
+		constexpr i32 pawn_eg[SQUARE_COUNT] = {
+			  0,  0,  0,  0,  0,  0,  0,  0,
+			 80, 80, 80, 80, 80, 80, 80, 80,
+			 50, 50, 50, 50, 50, 50, 50, 50,
+			 30, 30, 30, 30, 30, 30, 30, 30,
+			 15, 15, 15, 15, 15, 15, 15, 15,
+			  5,  5,  5,  5,  5,  5,  5,  5,
+			  0,  0,  0,  0,  0,  0,  0,  0,
+			  0,  0,  0,  0,  0,  0,  0,  0
+		};
+
+		constexpr i32 knight[SQUARE_COUNT] = {
+			-50,-40,-30,-30,-30,-30,-40,-50,
+			-40,-20,  0,  0,  0,  0,-20,-40,
+			-30,  0, 10, 15, 15, 10,  0,-30,
+			-30,  5, 15, 20, 20, 15,  5,-30,
+			-30,  0, 15, 20, 20, 15,  0,-30,
+			-30,  5, 10, 15, 15, 10,  5,-30,
+			-40,-20,  0,  5,  5,  0,-20,-40,
+			-50,-40,-30,-30,-30,-30,-40,-50
+		};
+
+		constexpr i32 bishop[SQUARE_COUNT] = {
+			-20,-10,-10,-10,-10,-10,-10,-20,
+			-10,  0,  0,  0,  0,  0,  0,-10,
+			-10,  0,  5, 10, 10,  5,  0,-10,
+			-10,  5,  5, 10, 10,  5,  5,-10,
+			-10,  0, 10, 10, 10, 10,  0,-10,
+			-10, 10, 10, 10, 10, 10, 10,-10,
+			-10,  5,  0,  0,  0,  0,  5,-10,
+			-20,-10,-10,-10,-10,-10,-10,-20
+		};
+
+		constexpr i32 rook_mg[SQUARE_COUNT] = {
+			  0,  0,  0,  0,  0,  0,  0,  0,
+			  5, 10, 10, 10, 10, 10, 10,  5,
+			 -5,  0,  0,  0,  0,  0,  0, -5,
+			 -5,  0,  0,  0,  0,  0,  0, -5,
+			 -5,  0,  0,  0,  0,  0,  0, -5,
+			 -5,  0,  0,  0,  0,  0,  0, -5,
+			 -5,  0,  0,  0,  0,  0,  0, -5,
+			  0,  0,  0,  5,  5,  0,  0,  0
+		};
+
+		constexpr i32 rook_eg[SQUARE_COUNT] = {
+			  5,  5,  5,  5,  5,  5,  5,  5,
+			 10, 10, 10, 10, 10, 10, 10, 10,
+			  0,  0,  0,  0,  0,  0,  0,  0,
+			  0,  0,  0,  0,  0,  0,  0,  0,
+			  0,  0,  0,  0,  0,  0,  0,  0,
+			  0,  0,  0,  0,  0,  0,  0,  0,
+			  0,  0,  0,  0,  0,  0,  0,  0,
+			  0,  0,  0,  0,  0,  0,  0,  0
+		};
+
+		constexpr i32 queen[SQUARE_COUNT] = {
+			-20,-10,-10, -5, -5,-10,-10,-20,
+			-10,  0,  0,  0,  0,  0,  0,-10,
+			-10,  0,  5,  5,  5,  5,  0,-10,
+			 -5,  0,  5,  5,  5,  5,  0, -5,
+			  0,  0,  5,  5,  5,  5,  0, -5,
+			-10,  5,  5,  5,  5,  5,  0,-10,
+			-10,  0,  5,  0,  0,  0,  0,-10,
+			-20,-10,-10, -5, -5,-10,-10,-20
+		};
+
+		constexpr i32 king_mg[SQUARE_COUNT] = {
+			-30,-40,-40,-50,-50,-40,-40,-30,
+			-30,-40,-40,-50,-50,-40,-40,-30,
+			-30,-40,-40,-50,-50,-40,-40,-30,
+			-30,-40,-40,-50,-50,-40,-40,-30,
+			-20,-30,-30,-40,-40,-30,-30,-20,
+			-10,-20,-20,-20,-20,-20,-20,-10,
+			 20, 20,  0,  0,  0,  0, 20, 20,
+			 20, 30, 10,  0,  0, 10, 30, 20
+		};
+
+		constexpr i32 king_eg[SQUARE_COUNT] = {
+			-50,-40,-30,-20,-20,-30,-40,-50,
+			-30,-20,-10,  0,  0,-10,-20,-30,
+			-30,-10, 20, 30, 30, 20,-10,-30,
+			-30,-10, 30, 40, 40, 30,-10,-30,
+			-30,-10, 30, 40, 40, 30,-10,-30,
+			-30,-10, 20, 30, 30, 20,-10,-30,
+			-30,-30,  0,  0,  0,  0,-30,-30,
+			-50,-30,-30,-30,-30,-30,-30,-50
+		};
+
+		constexpr const i32* mg_tables[PIECETYPE_COUNT] = {
+			nullptr, pawn_mg, knight, bishop, rook_mg, queen, king_mg
+		};
+
+		constexpr const i32* eg_tables[PIECETYPE_COUNT] = {
+			nullptr, pawn_eg, knight, bishop, rook_eg, queen, king_eg
+		};
+	}
+
+	bool PSQT::initialize() {
+		for (auto& t : table_) {
+			t.fill({ 0, 0 });
+		}
+
+		for (int pt = PAWN; pt <= KING; pt++) {
+			for (int s = A1; s <= H8; s++) {
+				// the tables are written rank 8 first
+				Score score = { mg_tables[pt][s ^ 56], eg_tables[pt][s ^ 56] };
+				table_[make_piece(pt, WHITE)][s] = score;
+				table_[make_piece(pt, BLACK)][s ^ 56] = -score;
+			}
+		}
+
+		return true;
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#ifndef PSQT_H
+#define PSQT_H
+
+#include <array>
+#include <algorithm>
+
+#include "chess.h"
+
+namespace Chess {
+
+	// Midgame and endgame halves of an evaluation term
+	struct Score {
+		i32 mg;
+		i32 eg;
+
+		Score& operator+=(Score s) { mg += s.mg; eg += s.eg; return *this; }
+		Score& operator-=(Score s) { mg -= s.mg; eg -= s.eg; return *this; }
+		bool operator==(Score s) const { return mg == s.mg && eg == s.eg; }
+		bool operator!=(Score s) const { return !(*this == s); }
+	};
+
+	inline Score operator+(Score a, Score b) { return a += b; }
+	inline Score operator-(Score a, Score b) { return a -= b; }
+	inline Score operator-(Score s) { return { -s.mg, -s.eg }; }
+
+	// Game phase from the non-pawn material, full at the start of the game
+	constexpr int PHASE_MAX = 24;
+	constexpr int piecetype_phases[PIECETYPE_COUNT] = {
+			0, 0, 1, 1, 2, 4, 0
+	};
+
+	// Piece-square tables, white pieces positive and black pieces negative
+	class PSQT {
+	public:
+		static Score get(int piece, int square);
+		static int phase(int piece);
+
+		// Interpolates between the midgame and endgame values by game phase
+		static i32 taper(Score s, int phase);
+
+		PSQT() = delete;
+	private:
+		static std::array<std::array<Score, SQUARE_COUNT>, PIECE_COUNT> table_;
+		static bool initialized_;
+		static bool initialize();
+	};
+
+	inline Score PSQT::get(int piece, int square) {
+		return table_[piece][square];
+	}
+
+	inline int PSQT::phase(int piece) {
+		return piecetype_phases[piece_type(piece)];
+	}
+
+	inline i32 PSQT::taper(Score s, int phase) {
+		phase = std::min(phase, PHASE_MAX);
+		return (s.mg * phase + s.eg * (PHASE_MAX - phase)) / PHASE_MAX;
+	}
+}
+
+#endif // PSQT_H
@@ -0,0 +1,246 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+
+#include "resultcache.h"
+
+namespace Chess {
+
+	ResultCache::~ResultCache() {
+		close();
+	}
+
+	ResultCache::Header ResultCache::header() {
+		return { { 'S', 'I', 'I', 'K', 'A', 'R', 'C', '\0' }, 1, static_cast<u32>(sizeof(Record)) };
+	}
+
+	// FNV-1a over the bytes before the checksum
+	u32 ResultCache::checksum(const Record& record) {
+		const u8* bytes = reinterpret_cast<const u8*>(&record);
+		u32 hash = 2166136261u;
+		for (size_t i = 0; i < offsetof(Record, checksum); i++) {
+			hash = (hash ^ bytes[i]) * 16777619u;
+		}
+		return hash;
+	}
+
+	// The move counters do not matter
+	bool ResultCache::same_position(const PackedPosition& a, const PackedPosition& b) {
+		return a.occupied == b.occupied && a.pieces == b.pieces
+			&& a.turn_and_castling == b.turn_and_castling && a.en_passant == b.en_passant;
+	}
+
+	const ResultCache::Record& ResultCache::record(size_t i) const {
+		if (i < mapped_count_) {
+			return reinterpret_cast<const Record*>(file_.data() + sizeof(Header))[i];
+		}
+		return written_[i - mapped_count_];
+	}
+
+	bool ResultCache::open(const std::string& file) {
+		close();
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		const Header expected = header();
+		std::FILE* f = std::fopen(file.c_str(), "ab");
+		if (!f) {
+			return false;
+		}
+		bool ok = std::fseek(f, 0, SEEK_END) == 0;
+		if (ok && std::ftell(f) == 0) {
+			ok = std::fwrite(&expected, sizeof(expected), 1, f) == 1;
+		}
+		ok = std::fclose(f) == 0 && ok;
+		if (!ok || !file_.open(file)) {
+			return false;
+		}
+		if (file_.size() < sizeof(Header) || std::memcmp(file_.data(), &expected, sizeof(Header)) != 0) {
+			std::cerr << file << " is not a result cache\n";
+			file_.close();
+			return false;
+		}
+
+		// Records from the first one with a wrong checksum on are those of
+		// an interrupted write
+		size_t count = (file_.size() - sizeof(Header)) / sizeof(Record);
+		mapped_count_ = count;
+		size_t valid = 0;
+		while (valid < count && checksum(record(valid)) == record(valid).checksum) {
+			valid++;
+		}
+		u64 valid_size = sizeof(Header) + valid * sizeof(Record);
+		if (valid_size != file_.size()) {
+			file_.close();
+			if (!truncate_file(file, valid_size) || !file_.open(file)) {
+				mapped_count_ = 0;
+				return false;
+			}
+		}
+		mapped_count_ = valid;
+
+		for (size_t i = 0; i < mapped_count_; i++) {
+			index_[record(i).key] = i;
+		}
+
+		out_ = std::fopen(file.c_str(), "ab");
+		if (!out_) {
+			file_.close();
+			index_.clear();
+			mapped_count_ = 0;
+			return false;
+		}
+		return true;
+	}
+
+	void ResultCache::close() {
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (out_) {
+			std::fclose(out_);
+			out_ = nullptr;
+		}
+		file_.close();
+		mapped_count_ = 0;
+		written_.clear();
+		index_.clear();
+	}
+
+	bool ResultCache::is_open() const {
+		std::lock_guard<std::mutex> lock(mutex_);
+		return out_ != nullptr;
+	}
+
+	size_t ResultCache::size() const {
+		std::lock_guard<std::mutex> lock(mutex_);
+		return index_.size();
+	}
+
+	bool ResultCache::probe(const Position& pos, u32 depth, SearchResult& result) {
+		PackedPosition packed;
+		if (!pos.pack(packed)) {
+			return false;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto it = index_.find(pos.hash());
+		if (it == index_.end()) {
+			return false;
+		}
+		const Record& r = record(it->second);
+		if (!same_position(r.pos, packed) || r.depth < depth || r.bound != BOUND_EXACT || r.pv_length == 0) {
+			return false;
+		}
+
+		result = SearchResult();
+		result.bestmove = r.pv[0];
+		result.value = r.value;
+		result.depth = r.depth;
+		result.pv.assign(r.pv.begin(), r.pv.begin() + r.pv_length);
+		return true;
+	}
+
+	// Each record is flushed as it is written, and writing stops after a
+	// failed write so that nothing follows a partial record
+	void ResultCache::store(const Position& pos, const SearchResult& result, Bound bound) {
+		if (result.bestmove == NULLMOVE || result.pv.empty()) {
+			return;
+		}
+		Record r;
+		std::memset(&r, 0, sizeof(r));
+		if (!pos.pack(r.pos)) {
+			return;
+		}
+		r.key = pos.hash();
+		r.value = result.value;
+		r.depth = static_cast<u16>(std::min<u32>(result.depth, UINT16_MAX));
+		r.bound = bound;
+		r.pv_length = static_cast<u8>(std::min<size_t>(result.pv.size(), MAX_PV));
+		std::copy(result.pv.begin(), result.pv.begin() + r.pv_length, r.pv.begin());
+		r.checksum = checksum(r);
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!out_) {
+			return;
+		}
+		auto it = index_.find(r.key);
+		if (it != index_.end()) {
+			const Record& known = record(it->second);
+			if (same_position(known.pos, r.pos) && known.depth >= r.depth && (known.bound == BOUND_EXACT || bound != BOUND_EXACT)) {
+				return;
+			}
+		}
+
+		if (std::fwrite(&r, sizeof(r), 1, out_) != 1 || std::fflush(out_) != 0) {
+			std::fclose(out_);
+			out_ = nullptr;
+			return;
+		}
+		written_.push_back(r);
+		index_[r.key] = mapped_count_ + written_.size() - 1;
+	}
+
+	// The compacted file is written next to the old one and then takes
+	// its place, so an interrupted compaction leaves the old file as it was
+	bool ResultCache::compact(const std::string& file) {
+		ResultCache cache;
+		if (!cache.open(file)) {
+			return false;
+		}
+
+		std::string temp = file + ".compact";
+		std::FILE* out = std::fopen(temp.c_str(), "wb");
+		if (!out) {
+			return false;
+		}
+		const Header h = header();
+		bool ok = std::fwrite(&h, sizeof(h), 1, out) == 1;
+		for (size_t i = 0; i < cache.mapped_count_ && ok; i++) {
+			const Record& r = cache.record(i);
+			if (cache.index_[r.key] == i) {
+				ok = std::fwrite(&r, sizeof(r), 1, out) == 1;
+			}
+		}
+		ok = std::fclose(out) == 0 && ok;
+		cache.close();
+
+		if (!ok) {
+			std::remove(temp.c_str());
+			return false;
+		}
+#ifdef _WIN32
+		// rename does not replace an existing file on Windows
+		std::remove(file.c_str());
+#endif
+		return std::rename(temp.c_str(), file.c_str()) == 0;
+	}
+
+	int ResultCache::run(const std::vector<std::string>& args) {
+		if (args.size() != 2 || (args[0] != "compact" && args[0] != "info")) {
+			std::cerr << "usage: Siika cache <compact|info> <file>\n";
+			return 1;
+		}
+		const std::string& file = args[1];
+
+		u64 records = 0;
+		size_t positions = 0;
+		{
+			ResultCache cache;
+			if (!cache.open(file)) {
+				std::cerr << "Could not open " << file << "\n";
+				return 1;
+			}
+			records = cache.mapped_count_;
+			positions = cache.size();
+		}
+		std::cout << "Positions " << positions << ", records " << records << "\n";
+
+		if (args[0] == "compact") {
+			if (!compact(file)) {
+				std::cerr << "Could not compact " << file << "\n";
+				return 1;
+			}
+			std::cout << "Dropped " << records - positions << " records\n";
+		}
+		return 0;
+	}
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include <array>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "chess.h"
+#include "position.h"
+#include "search.h"
+#include "util.h"
+
+namespace Chess {
+
+	// Search results kept on disk from one run to the next, keyed by the
+	// Zobrist hash and checked against the whole position. The file is a
+	// header followed by records, each new result appended as one record
+	// that replaces the earlier ones of its position. Records carry a
+	// checksum, and a last record cut short by a crash is cut off when the
+	// file is opened again. Results are only as good as the evaluation
+	// they were searched with, so each network wants a file of its own.
+	// Probing and storing may be done from several threads.
+	class ResultCache {
+	public:
+		static constexpr int MAX_PV = 22;
+
+		ResultCache() = default;
+		~ResultCache();
+		ResultCache(const ResultCache&) = delete;
+		ResultCache& operator=(const ResultCache&) = delete;
+
+		// Creates the file if there is none
+		bool open(const std::string& file);
+		void close();
+		bool is_open() const;
+
+		// Exact results searched to at least depth
+		bool probe(const Position& pos, u32 depth, SearchResult& result);
+
+		// Appended unless a result at least as deep is already known
+		void store(const Position& pos, const SearchResult& result, Bound bound = BOUND_EXACT);
+
+		// Positions with a result
+		size_t size() const;
+
+		// Rewrites the file with only the latest record of each position
+		static bool compact(const std::string& file);
+
+		// Siika cache compact <file>
+		// Siika cache info <file>
+		static int run(const std::vector<std::string>& args);
+
+	private:
+		struct Header {
+			std::array<char, 8> magic;
+			u32 version;
+			u32 record_size;
+		};
+
+		// The best move is the first move of the principal variation
+		struct Record {
+			u64 key;
+			PackedPosition pos;
+			Value value;
+			u16 depth;
+			u8 bound;
+			u8 pv_length;
+			std::array<Move, MAX_PV> pv;
+			u32 checksum;
+		};
+
+		static_assert(sizeof(Header) == 16, "Header should be 16 bytes");
+		static_assert(sizeof(Record) == 96, "Record should be 96 bytes");
+
+		static Header header();
+		static u32 checksum(const Record& record);
+		static bool same_position(const PackedPosition& a, const PackedPosition& b);
+
+		// The records of the file when it was opened, then those written
+		const Record& record(size_t i) const;
+
+		MappedFile file_;
+		size_t mapped_count_ = 0;
+		std::vector<Record> written_;
+		std::FILE* out_ = nullptr;
+
+		// Index of the latest record of each key
+		std::unordered_map<u64, size_t> index_;
+		mutable std::mutex mutex_;
+	};
+}
+
+#endif // RESULTCACHE_H
@@ -0,0 +1,224 @@
+#include <algorithm>
+#include <cctype>
+
+#include "san.h"
+#include "bitboard.h"
+
+namespace Chess {
+
+	namespace {
+		constexpr char piece_letters[PIECETYPE_COUNT] = { ' ', ' ', 'N', 'B', 'R', 'Q', 'K' };
+
+		int letter_type(char c) {
+			switch (c) {
+			case 'N': return KNIGHT;
+			case 'B': return BISHOP;
+			case 'R': return ROOK;
+			case 'Q': return QUEEN;
+			case 'K': return KING;
+			default: return NO_PIECETYPE;
+			}
+		}
+
+		bool is_file(char c) { return c >= 'a' && c <= 'h'; }
+		bool is_rank(char c) { return c >= '1' && c <= '8'; }
+
+		// The mover's pieces of a type that attack the square, which are
+		// the ones that may move there unless it is a pawn
+		Bitboard attackers(const Position& pos, int type, int square) {
+			Bitboard empty = pos.empty();
+			Bitboard attacks;
+			switch (type) {
+			case KNIGHT: attacks = Bitboards::knight_attacks(square); break;
+			case BISHOP: attacks = Bitboards::bishop_attacks(square, empty); break;
+			case ROOK: attacks = Bitboards::rook_attacks(square, empty); break;
+			case QUEEN: attacks = Bitboards::queen_attacks(square, empty); break;
+			case KING: attacks = Bitboards::king_attacks(square); break;
+			default: return 0;
+			}
+			return attacks & pos.pieces(type, pos.turn());
+		}
+
+		bool is_valid(const Position& pos, Move move) {
+			return pos.is_pseudo_legal(move) && pos.is_legal(move);
+		}
+	}
+
+	// Pieces of the mover's type that could also go to the target legally
+	// tell whether the origin needs to be given
+	std::string SAN::to_string(Position& pos, Move move) {
+		int from = move_from(move);
+		int to = move_to(move);
+		int type = piece_type(pos.piece_on(from));
+		std::string san;
+
+		if (move_flags(move) == KINGSIDE_CASTLE) {
+			san = "O-O";
+		}
+		else if (move_flags(move) == QUEENSIDE_CASTLE) {
+			san = "O-O-O";
+		}
+		else {
+			bool capture = pos.piece_on(to) != NO_PIECE || move_flags(move) == EN_PASSANT_CAPTURE;
+
+			if (type == PAWN) {
+				if (capture) {
+					san += static_cast<char>('a' + square_file(from));
+				}
+			}
+			else {
+				san += piece_letters[type];
+
+				// the file if it tells the pieces apart, else the rank, else both
+				bool ambiguous = false, same_file = false, same_rank = false;
+				Bitboard others = attackers(pos, type, to) & ~Bitboards::make(from);
+				while (others) {
+					int other_from = Bitboards::pop(others);
+					if (pos.is_legal(make_move(other_from, to))) {
+						ambiguous = true;
+						same_file = same_file || square_file(other_from) == square_file(from);
+						same_rank = same_rank || square_rank(other_from) == square_rank(from);
+					}
+				}
+				if (ambiguous) {
+					if (!same_file) {
+						san += static_cast<char>('a' + square_file(from));
+					}
+					else if (!same_rank) {
+						san += static_cast<char>('1' + square_rank(from));
+					}
+					else {
+						san += static_cast<char>('a' + square_file(from));
+						san += static_cast<char>('1' + square_rank(from));
+					}
+				}
+			}
+
+			if (capture) {
+				san += 'x';
+			}
+			san += static_cast<char>('a' + square_file(to));
+			san += static_cast<char>('1' + square_rank(to));
+
+			if (is_promotion(move)) {
+				san += '=';
+				san += piece_letters[promotion_type(move)];
+			}
+		}
+
+		if (pos.gives_check(move)) {
+			pos.do_move(move);
+			san += pos.legal_moves().empty() ? '#' : '+';
+			pos.undo_move(move);
+		}
+		return san;
+	}
+
+	Move SAN::parse(Position& pos, const std::string& str) {
+		return parse(pos, str.data(), str.size());
+	}
+
+	// Builds the one move the text can mean and checks it, instead of
+	// generating the legal moves
+	Move SAN::parse(Position& pos, const char* str, size_t length) {
+		// the letters that matter, marks and separators dropped
+		char s[8];
+		size_t n = 0;
+		for (size_t i = 0; i < length; i++) {
+			char c = str[i] == '0' ? 'O' : str[i];
+			if (c == 'x' || c == ':' || c == '=' || c == '+' || c == '#' || c == '!' || c == '?' || c == '-') {
+				continue;
+			}
+			if (n == sizeof(s)) {
+				return NULLMOVE;
+			}
+			s[n++] = c;
+		}
+
+		int us = pos.turn();
+		if ((n == 2 || n == 3) && std::count(s, s + n, 'O') == static_cast<int>(n)) {
+			int king = pos.king_square(us);
+			Move move = n == 2 ? make_move(king, king + 2, KINGSIDE_CASTLE) : make_move(king, king - 2, QUEENSIDE_CASTLE);
+			return is_valid(pos, move) ? move : NULLMOVE;
+		}
+
+		const char* p = s;
+		const char* end = s + n;
+		int type = PAWN;
+		if (p != end && letter_type(*p) != NO_PIECETYPE) {
+			type = letter_type(*p++);
+		}
+
+		int flags = NORMAL_MOVE;
+		if (type == PAWN && end - p >= 3 && is_rank(end[-2])) {
+			int promotion = letter_type(static_cast<char>(std::toupper(end[-1])));
+			if (promotion == NO_PIECETYPE || promotion == KING) {
+				return NULLMOVE;
+			}
+			flags = PROMOTION | (promotion << 13);
+			end--;
+		}
+
+		if (end - p < 2 || !is_file(end[-2]) || !is_rank(end[-1])) {
+			return NULLMOVE;
+		}
+		int to = make_square(end[-1] - '1', end[-2] - 'a');
+		end -= 2;
+
+		// what is left tells the moving piece apart
+		int from_file = -1, from_rank = -1;
+		for (; p != end; p++) {
+			if (is_file(*p)) {
+				from_file = *p - 'a';
+			}
+			else if (is_rank(*p)) {
+				from_rank = *p - '1';
+			}
+			else {
+				return NULLMOVE;
+			}
+		}
+
+		if (type == PAWN) {
+			int up = pawn_up(us);
+			if (square_rank(to) == (us == WHITE ? RANK_1 : RANK_8)) {
+				return NULLMOVE;
+			}
+			Move move;
+			if (from_file >= 0 && from_file != square_file(to)) {
+				int from = make_square(square_rank(to - up), from_file);
+				if (flags == NORMAL_MOVE && to == pos.en_passant_square() && pos.piece_on(to) == NO_PIECE) {
+					flags = EN_PASSANT_CAPTURE;
+				}
+				move = make_move(from, to, flags);
+			}
+			else if (square_rank(to) == (us == WHITE ? RANK_4 : RANK_5) && pos.piece_on(to - up) == NO_PIECE) {
+				move = make_move(to - up - up, to, PAWN_DOUBLE_PUSH);
+			}
+			else {
+				move = make_move(to - up, to, flags);
+			}
+			// other pieces may make the same move
+			bool origin_fits = pos.piece_on(move_from(move)) == make_piece(PAWN, us)
+				&& (from_rank < 0 || square_rank(move_from(move)) == from_rank);
+			return origin_fits && is_valid(pos, move) ? move : NULLMOVE;
+		}
+
+		Move found = NULLMOVE;
+		Bitboard candidates = attackers(pos, type, to);
+		while (candidates) {
+			int from = Bitboards::pop(candidates);
+			Move move = make_move(from, to);
+			if ((from_file >= 0 && square_file(from) != from_file)
+				|| (from_rank >= 0 && square_rank(from) != from_rank)
+				|| !is_valid(pos, move)) {
+				continue;
+			}
+			if (found != NULLMOVE) {
+				return NULLMOVE;
+			}
+			found = move;
+		}
+		return found;
+	}
+}
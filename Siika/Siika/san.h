@@ -0,0 +1,25 @@
+#pragma once
+
+#ifndef SAN_H
+#define SAN_H
+
+#include <string>
+
+#include "chess.h"
+#include "position.h"
+
+namespace Chess {
+
+	// Standard algebraic notation, e.g. "Nbd7", "exd6", "e8=Q+", "O-O"
+	namespace SAN {
+		std::string to_string(Position& pos, Move move);
+
+		// Accepts missing or extra capture and check marks, annotations such
+		// as "!?", zeros for castling and promotions without '='. Returns
+		// NULLMOVE for illegal or ambiguous moves.
+		Move parse(Position& pos, const std::string& str);
+		Move parse(Position& pos, const char* str, size_t length);
+	}
+}
+
+#endif // SAN_H
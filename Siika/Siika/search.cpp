@@ -0,0 +1,360 @@
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+
+#include "search.h"
+#include "uci.h"
+#include "tablebase.h"
+#include "tt.h"
+
+namespace Chess {
+
+	Search::Search(const std::atomic<bool>& is_searching, int make_mode, TranspositionTable* tt)
+		: is_searching_(is_searching), make_mode_(make_mode), tt_(tt), nodes_(0), self_depth_(0),
+		pv_table_(MAX_PLYS * MAX_PLYS, NULLMOVE), pv_length_(MAX_PLYS + 1, 0),
+		max_nodes_(REALLY_BIG_NUMBER), max_time_us_(REALLY_BIG_NUMBER), next_time_check_(0), stopped_(false) {
+	}
+
+	std::vector<Move> Search::root_pv() const {
+		return std::vector<Move>(pv_table_.begin(), pv_table_.begin() + pv_length_[0]);
+	}
+
+	void Search::update_pv(int depth, Move move) {
+		Move* row = &pv_table_[depth * MAX_PLYS];
+		const Move* child = row + MAX_PLYS;
+		int length = pv_length_[depth + 1];
+		row[0] = move;
+		std::copy(child, child + length, row + 1);
+		pv_length_[depth] = length + 1;
+	}
+
+	// Without a clock there is no time limit
+	u64 Search::allocated_time_us(const Position& pos, const SearchParameters& sp) {
+		constexpr int moves_to_go = 28;
+		u64 player_time_ms = pos.turn() == WHITE ? sp.wtime_ms : sp.btime_ms;
+		if (player_time_ms == 0 || player_time_ms == REALLY_BIG_NUMBER) {
+			return REALLY_BIG_NUMBER;
+		}
+		return player_time_ms * 1000 / moves_to_go;
+	}
+
+	namespace {
+		thread_local const Search::Pause* local_pause = nullptr;
+	}
+
+	void Search::set_pause(const Pause* pause) {
+		local_pause = pause;
+	}
+
+	bool Search::is_stopped() {
+		if (!stopped_) {
+			if (local_pause && nodes_ >= next_time_check_) {
+				(*local_pause)(is_searching_);
+			}
+			stopped_ = !is_searching_.load() || nodes_ >= max_nodes_;
+			if (!stopped_ && nodes_ >= next_time_check_) {
+				next_time_check_ = nodes_ + 1024;
+				stopped_ = timer_.get_elapsed_microseconds() >= max_time_us_;
+			}
+		}
+		return stopped_;
+	}
+
+	SearchResult Search::run(Position& pos, const SearchParameters& sp, const std::function<void(const SearchResult&)>& on_depth) {
+		constexpr double ad_hoc_ratio = 12.0;
+		auto allocated_time_usecs = allocated_time_us(pos, sp);
+
+		nodes_ = 0;
+		max_nodes_ = sp.max_nodes;
+		max_time_us_ = sp.max_search_time_ms == REALLY_BIG_NUMBER ? REALLY_BIG_NUMBER : sp.max_search_time_ms * 1000;
+		next_time_check_ = 0;
+		stopped_ = false;
+		timer_.reset();
+		if (tt_) {
+			tt_->new_search();
+		}
+
+		SearchResult result;
+		Move tb_move;
+		if (Tablebases::probe_root(pos, tb_move, result.value)) {
+			result.bestmove = tb_move;
+			result.pv.assign(1, tb_move);
+			result.depth = 1;
+			result.tablebase_hit = true;
+			if (on_depth) {
+				on_depth(result);
+			}
+			return result;
+		}
+
+		for (u32 i = 1; i <= sp.max_depth; i++) {
+			self_depth_ = 0;
+
+			Timer depth_timer;
+			Value val = make_mode_ == COPY_MAKE
+				? negamax_ab<COPY_MAKE>(pos, VALUE_MIN, VALUE_MAX, 0, i)
+				: negamax_ab<MAKE_UNMAKE>(pos, VALUE_MIN, VALUE_MAX, 0, i);
+			auto depth_time = depth_timer.get_elapsed_microseconds();
+
+			// a depth cut short is only used when there is nothing better
+			if (stopped_ && result.bestmove != NULLMOVE) {
+				break;
+			}
+
+			auto pv = root_pv();
+			extend_pv(pos, pv, i);
+			result.bestmove = pv.empty() ? NULLMOVE : pv.front();
+			result.value = val;
+			result.depth = i;
+			result.seldepth = self_depth_;
+			result.nodes = nodes_;
+			result.time_us = timer_.get_elapsed_microseconds();
+			result.pv = pv;
+			if (on_depth) {
+				on_depth(result);
+			}
+
+			auto predicted_time = (Timer::Microseconds)(ad_hoc_ratio * depth_time);
+			if (is_stopped() || result.time_us > allocated_time_usecs) {
+				break;
+			}
+			if (allocated_time_usecs != REALLY_BIG_NUMBER && (result.time_us + predicted_time) > (allocated_time_usecs + allocated_time_usecs * 0.3)) {
+				break;
+			}
+		}
+
+		result.nodes = nodes_;
+		result.time_us = timer_.get_elapsed_microseconds();
+		return result;
+	}
+
+	// Cut-offs from the table leave the principal variation short, and the
+	// best moves stored for the positions after it carry it on
+	void Search::extend_pv(Position& pos, std::vector<Move>& pv, u32 length) {
+		if (!tt_ || pv.empty() || pv.size() >= length) {
+			return;
+		}
+		for (const auto move : pv) {
+			pos.do_move(move);
+		}
+		TranspositionTable::Data entry;
+		while (pv.size() < length && tt_->probe(pos.hash(), entry) && entry.move != NULLMOVE
+			&& pos.is_pseudo_legal(entry.move) && pos.is_legal(entry.move)) {
+			pv.push_back(entry.move);
+			pos.do_move(entry.move);
+		}
+		for (size_t i = pv.size(); i-- > 0;) {
+			pos.undo_move(pv[i]);
+		}
+	}
+
+	void Search::print(std::ostream& out, const SearchResult& r) {
+		auto nps = r.time_us > 0 ? 1000000.0 * r.nodes / r.time_us : 0.0;
+
+		out << "info depth " << r.depth << " ";
+		out << "seldepth " << r.seldepth << " ";
+		out << "nodes " << r.nodes << " nps " << (u64)nps << " ";
+		if (is_mate(r.value)) {
+			out << "score mate " << mate_moves(r.value);
+		}
+		else {
+			out << "score cp " << r.value;
+		}
+
+		out << " pv";
+		for (const auto move : r.pv) {
+			out << " " << UCI::move_to_string(move);
+		}
+		out << std::endl;
+
+		if (r.tablebase_hit) {
+			out << "info string tablebase hit" << std::endl;
+		}
+	}
+
+	SearchResult Search::think(Position& pos, const SearchParameters& sp, std::ostream& out) {
+		auto allocated_time_usecs = allocated_time_us(pos, sp);
+		if (allocated_time_usecs != REALLY_BIG_NUMBER) {
+			out << "(time allocated: " << (double)(allocated_time_usecs / 1000000.0) << " s)" << std::endl;
+		}
+
+		// the tiers counted are those of this search alone
+		EvalStats::local() = EvalStats();
+		SearchResult result = run(pos, sp, [&out](const SearchResult& r) { print(out, r); });
+
+		const EvalCache& cache = EvalCache::local();
+		if (cache.probes() > 0) {
+			out << "info string eval cache hits " << cache.hits() << " of " << cache.probes()
+				<< " (" << std::setprecision(3) << 100.0 * cache.hits() / cache.probes() << "%)" << std::endl;
+		}
+
+		const EvalStats& stats = EvalStats::local();
+		if (stats.reached[TIER_MATERIAL] > 0) {
+			out << "info string eval tiers material " << stats.reached[TIER_MATERIAL]
+				<< " pawns " << stats.reached[TIER_PAWNS] << " full " << stats.reached[TIER_FULL] << std::endl;
+		}
+
+		out << "bestmove " << UCI::move_to_string(result.bestmove) << std::endl;
+		out << "(time: " << (double)(result.time_us / 1000000.0) << " s)" << std::endl;
+		return result;
+	}
+
+	Value Search::quiet(Position& pos) {
+		Value value = quiescence_search<MAKE_UNMAKE>(pos, VALUE_MIN, VALUE_MAX, 0, false);
+		for (const auto move : root_pv()) {
+			pos.do_move(move);
+		}
+		return value;
+	}
+
+	template <int M>
+	Value Search::negamax_ab(Position& pos, Value alpha, Value beta, int depth, int max_depth) {
+		
+		pv_length_[depth] = 0;
+		if (depth > self_depth_) {
+			self_depth_ = depth;
+		}
+
+		Value tb_value;
+		if (depth > 0 && Tablebases::probe(pos, depth, tb_value)) {
+			return tb_value;
+		}
+
+		if (depth >= max_depth) {
+			// the quiet line belongs to this ply's variation
+			Value value = quiescence_search<M>(pos, alpha, beta, depth + 1, true);
+			const Move* child = &pv_table_[(depth + 1) * MAX_PLYS];
+			std::copy(child, child + pv_length_[depth + 1], &pv_table_[depth * MAX_PLYS]);
+			pv_length_[depth] = pv_length_[depth + 1];
+			return value;
+		}
+		nodes_++;
+
+		// a stored value deep enough ends the search of the node, except
+		// at the root which needs its move
+		int remaining = max_depth - depth;
+		Move tt_move = NULLMOVE;
+		TranspositionTable::Data entry;
+		if (tt_ && tt_->probe(pos.hash(), entry)) {
+			tt_move = entry.move;
+			Value value = TranspositionTable::value_from_tt(entry.value, depth);
+			if (depth > 0 && entry.depth >= remaining
+				&& (entry.bound == BOUND_EXACT || (entry.bound == BOUND_LOWER && value >= beta) || (entry.bound == BOUND_UPPER && value <= alpha))) {
+				if (tt_move != NULLMOVE && pos.is_pseudo_legal(tt_move) && pos.is_legal(tt_move)) {
+					pv_length_[depth + 1] = 0;
+					update_pv(depth, tt_move);
+				}
+				return std::min(std::max(value, alpha), beta);
+			}
+		}
+
+		auto moves = pos.legal_moves();
+		sort_moves(pos, moves);
+		auto first = std::find(moves.begin(), moves.end(), tt_move);
+		if (first != moves.end()) {
+			std::rotate(moves.begin(), first, first + 1);
+		}
+
+		const Value original_alpha = alpha;
+		Move best = NULLMOVE;
+		Position::Board snapshot;
+		for (const auto move : moves) {
+			pos.do_move<M>(move, snapshot);
+			Value value = -negamax_ab<M>(pos, -beta, -alpha, depth + 1, max_depth);
+			pos.undo_move<M>(move, snapshot);
+
+			if (value >= beta) {
+				if (tt_ && !is_stopped()) {
+					tt_->store(pos.hash(), move, TranspositionTable::value_to_tt(beta, depth), remaining, BOUND_LOWER);
+				}
+				return beta;
+			}
+			if (value > alpha) {
+				alpha = value;
+				best = move;
+				update_pv(depth, move);
+			}
+			if (is_stopped()) {
+				return alpha;
+			}
+		}
+
+		if (moves.empty()) {
+			if (pos.is_in_check()) {
+				return mate(depth);
+			}
+			else {
+				return STALEMATE;
+			}
+		}
+
+		if (tt_) {
+			tt_->store(pos.hash(), best, TranspositionTable::value_to_tt(alpha, depth), remaining, alpha > original_alpha ? BOUND_EXACT : BOUND_UPPER);
+		}
+		return alpha;
+	}
+
+	template <int M>
+	Value Search::quiescence_search(Position& pos, Value alpha, Value beta, int depth, bool checks) {
+
+		pv_length_[depth] = 0;
+		if (depth > self_depth_) {
+			self_depth_ = depth;
+		}
+		Value standing_pat = evaluate(pos, alpha, beta);
+
+		// the table has a row for each ply
+		if (depth >= MAX_PLYS - 1) {
+			return std::min(std::max(standing_pat, alpha), beta);
+		}
+
+		if (standing_pat >= beta) {
+			return beta;
+		}
+		if (alpha < standing_pat) {
+			alpha = standing_pat;
+		}
+
+		auto in_check = pos.is_in_check();
+		auto moves = in_check ? pos.legal_moves<EVASIONS>() : pos.legal_moves<CAPTURES>();
+
+		sort_moves(pos, moves);
+
+		// quiet checks only on the first ply so that the search stays finite
+		if (checks && !in_check) {
+			auto quiet_checks = pos.legal_moves<QUIET_CHECKS>();
+			moves.insert(moves.end(), quiet_checks.begin(), quiet_checks.end());
+		}
+
+		Position::Board snapshot;
+		for (const auto move : moves) {
+			// losing captures can not raise alpha in a quiet search
+			if (!in_check && !pos.see_ge(move, 0)) {
+				continue;
+			}
+
+			pos.do_move<M>(move, snapshot);
+			Value value = -quiescence_search<M>(pos, -beta, -alpha, depth + 1, false);
+			pos.undo_move<M>(move, snapshot);
+
+			if (value >= beta) {
+				return beta;
+			}
+			if (value > alpha) {
+				alpha = value;
+				update_pv(depth, move);
+			}
+		}
+
+		if (moves.empty()) {
+			if (in_check) {
+				return mate(depth);
+			}
+		}
+		else {
+			nodes_++;
+		}
+
+		return alpha;
+	}
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <atomic>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#include "chess.h"
+#include "position.h"
+#include "eval.h"
+
+namespace Chess {
+
+	constexpr u32 MAX_SEARCH_DEPTH = MAX_PLYS - 1;
+	constexpr u64 REALLY_BIG_NUMBER = UINT64_MAX;
+
+	struct SearchParameters {
+		u64 wtime_ms = 0, btime_ms = 0;
+		u64 winc_ms = 0, binc_ms = 0;
+		u32 max_depth = MAX_SEARCH_DEPTH;
+		bool ponder = false;
+		u64 max_nodes = REALLY_BIG_NUMBER;
+		u64 max_search_time_ms = REALLY_BIG_NUMBER;
+		bool search_for_mate = false;
+		u32 search_for_mate_in_n = 0;
+		bool is_sudden_death = true;
+		u32 moves_to_go = 0;
+		std::vector<Move> searchmoves;
+	};
+
+	class TranspositionTable;
+
+	// How a stored value relates to the true one
+	enum Bound : u8 { BOUND_NONE, BOUND_UPPER, BOUND_LOWER, BOUND_EXACT };
+
+	struct SearchResult {
+		Move bestmove = NULLMOVE;
+		Value value = 0;
+		u32 depth = 0;
+		u32 seldepth = 0;
+		u64 nodes = 0;
+		u64 time_us = 0;
+		bool tablebase_hit = false;
+		std::vector<Move> pv;
+	};
+
+	// State of one search, so that several can run in parallel. The search
+	// stops when is_searching is cleared. Searches may share a
+	// transposition table.
+	class Search {
+	public:
+		// Called now and then while searching on the thread it is set for,
+		// so that a scheduler can have the search wait for its turn
+		typedef std::function<void(const std::atomic<bool>& is_searching)> Pause;
+
+		// The heap memory of a search, its principal variation table
+		static constexpr size_t MEMORY_BYTES = MAX_PLYS * MAX_PLYS * sizeof(Move) + (MAX_PLYS + 1) * sizeof(int);
+
+		explicit Search(const std::atomic<bool>& is_searching, int make_mode = MAKE_UNMAKE, TranspositionTable* tt = nullptr);
+
+		// Iterative deepening within the limits of sp. Node and move time
+		// limits are hard, the clock time is shared out between the moves
+		// to go. on_depth is called after each finished depth.
+		SearchResult run(Position& pos, const SearchParameters& sp, const std::function<void(const SearchResult&)>& on_depth = nullptr);
+
+		// As run, printing the info lines and the best move to out
+		SearchResult think(Position& pos, const SearchParameters& sp, std::ostream& out = std::cout);
+
+		// The info line of a finished depth
+		static void print(std::ostream& out, const SearchResult& r);
+
+		// Plays the principal variation of a quiescence search, which leaves
+		// a quiet position, and returns its value
+		Value quiet(Position& pos);
+
+		u64 nodes() const;
+
+		static void set_pause(const Pause* pause);
+
+		template <int M>
+		Value negamax_ab(Position& pos, Value alpha, Value beta, int depth, int max_depth);
+		template <int M>
+		Value quiescence_search(Position& pos, Value alpha, Value beta, int depth, bool checks = false);
+
+	private:
+		static u64 allocated_time_us(const Position& pos, const SearchParameters& sp);
+		bool is_stopped();
+		void extend_pv(Position& pos, std::vector<Move>& pv, u32 length);
+
+		// Triangular principal variation: the row of a ply holds the best
+		// line found from it, the move raising alpha followed by the row
+		// of the next ply
+		std::vector<Move> root_pv() const;
+		void update_pv(int depth, Move move);
+
+		const std::atomic<bool>& is_searching_;
+		int make_mode_;
+		TranspositionTable* tt_;
+		u64 nodes_;
+		u32 self_depth_;
+		std::vector<Move> pv_table_;
+		std::vector<int> pv_length_;
+
+		Timer timer_;
+		u64 max_nodes_;
+		u64 max_time_us_;
+		u64 next_time_check_;
+		bool stopped_;
+	};
+
+	inline u64 Search::nodes() const {
+		return nodes_;
+	}
+}
+
+#endif // SEARCH_H
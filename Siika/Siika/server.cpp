@@ -0,0 +1,428 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <winsock2.h>
+#include <afunix.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "server.h"
+#include "tools.h"
+#include "uci.h"
+
+namespace Chess {
+
+	namespace {
+#ifdef _WIN32
+		typedef SOCKET Socket;
+		const Socket NO_SOCKET = INVALID_SOCKET;
+
+		void close_socket(Socket s) { closesocket(s); }
+		void stop_reading(Socket s) { shutdown(s, SD_RECEIVE); }
+#else
+		typedef int Socket;
+		const Socket NO_SOCKET = -1;
+
+		void close_socket(Socket s) { ::close(s); }
+		void stop_reading(Socket s) { shutdown(s, SHUT_RD); }
+#endif
+
+		struct Options {
+			std::string path;
+			int workers = std::max(1u, std::thread::hardware_concurrency());
+			size_t sessions = 16;
+			size_t memory_mb = 16;
+			size_t hash_mb = UCI::DEFAULT_HASH_MB;
+			std::string shared_hash;
+		};
+
+		// A longer line ends the session
+		constexpr size_t MAX_LINE = 1 << 20;
+
+		// Waits after a failed accept, doubling up to the longest
+		constexpr int ACCEPT_RETRY_MS = 10;
+		constexpr int ACCEPT_RETRY_MAX_MS = 1000;
+
+		bool parse_options(const std::vector<std::string>& args, Options& options) {
+			bool ok = true;
+			for (size_t i = 0; ok && i < args.size(); i++) {
+				const std::string& arg = args[i];
+				bool has_value = i + 1 < args.size();
+
+				if (arg == "workers" && has_value) {
+					ok = Tools::parse_integer(arg, args[++i], 1, Tools::MAX_THREADS, options.workers);
+				}
+				else if (arg == "sessions" && has_value) {
+					ok = Tools::parse_integer(arg, args[++i], 1, Tools::MAX_ARGUMENT, options.sessions);
+				}
+				else if (arg == "memory" && has_value) {
+					ok = Tools::parse_integer(arg, args[++i], 1, UCI::MAX_HASH_MB, options.memory_mb);
+				}
+				else if (arg == "hash" && has_value) {
+					ok = Tools::parse_integer(arg, args[++i], 1, UCI::MAX_HASH_MB, options.hash_mb);
+				}
+				else if (arg == "sharedhash" && has_value) {
+					options.shared_hash = args[++i];
+				}
+				else if (Tools::parse_engine_option(args, i, ok)) {
+					if (!ok) {
+						return false;
+					}
+				}
+				else if (arg == "book" && has_value) {
+					if (!UCI::open_book(args[++i])) {
+						std::cerr << "Could not load book " << args[i] << "\n";
+						return false;
+					}
+				}
+				else if (arg == "cache" && has_value) {
+					if (!UCI::open_results(args[++i])) {
+						std::cerr << "Could not open " << args[i] << "\n";
+						return false;
+					}
+				}
+				else if (i == 0) {
+					options.path = arg;
+				}
+				else {
+					std::cerr << "Unknown argument " << arg << "\n";
+					return false;
+				}
+			}
+			return ok && !options.path.empty();
+		}
+
+		// Lets a fixed number of searches run at a time, each on a thread
+		// of its own. While others wait, a search gives up its turn at the
+		// first pause after a time slice, and the waiting searches take
+		// their turns in order. A stopped search does not wait, it only has
+		// a best move to find.
+		class Scheduler {
+		public:
+			explicit Scheduler(int workers) : free_(workers) {}
+
+			// Searches of sessions still open have to finish first
+			~Scheduler() {
+				std::unique_lock<std::mutex> lock(mutex_);
+				turn_.wait(lock, [this]() { return threads_ == 0; });
+			}
+
+			void submit(const std::function<void()>& job) {
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+					threads_++;
+				}
+				std::thread([this, job]() {
+					Turn turn;
+					Search::Pause pause = [this, &turn](const std::atomic<bool>& is_searching) {
+						take_turn(turn, is_searching);
+					};
+					Search::set_pause(&pause);
+					job();
+					Search::set_pause(nullptr);
+
+					std::lock_guard<std::mutex> lock(mutex_);
+					free_ += turn.held;
+					threads_--;
+					turn_.notify_all();
+				}).detach();
+			}
+
+		private:
+			struct Turn {
+				bool held = false;
+				Timer since;
+			};
+
+			void take_turn(Turn& turn, const std::atomic<bool>& is_searching) {
+				if (turn.held) {
+					if (waiting_.load(std::memory_order_relaxed) == 0 || turn.since.get_elapsed_microseconds() < TIME_SLICE_US) {
+						return;
+					}
+					std::lock_guard<std::mutex> lock(mutex_);
+					free_++;
+					turn.held = false;
+					turn_.notify_all();
+				}
+
+				std::unique_lock<std::mutex> lock(mutex_);
+				u64 ticket = next_ticket_++;
+				queue_.push_back(ticket);
+				waiting_++;
+				while (free_ == 0 || queue_.front() != ticket) {
+					if (!is_searching.load()) {
+						queue_.erase(std::find(queue_.begin(), queue_.end(), ticket));
+						waiting_--;
+						turn_.notify_all();
+						return;
+					}
+					// a stop is not signalled, so it is looked for now and then
+					turn_.wait_for(lock, std::chrono::milliseconds(10));
+				}
+				queue_.pop_front();
+				waiting_--;
+				free_--;
+				turn.held = true;
+				turn.since.reset();
+				turn_.notify_all();
+			}
+
+			static constexpr u64 TIME_SLICE_US = 50000;
+
+			std::mutex mutex_;
+			std::condition_variable turn_;
+			int free_;
+			int threads_ = 0;
+			std::deque<u64> queue_;
+			u64 next_ticket_ = 0;
+			std::atomic<int> waiting_{ 0 };
+		};
+
+		// The socket stays open while a search of the session may still
+		// write to it. Lines are sent whole, so that those of a search and
+		// of the session do not mix.
+		struct Connection {
+			Socket socket;
+			std::mutex mutex;
+
+			explicit Connection(Socket socket) : socket(socket) {}
+			~Connection() { close_socket(socket); }
+
+			// Nothing is sent once the client has gone
+			void send_line(const std::string& line) {
+				std::lock_guard<std::mutex> lock(mutex);
+				size_t sent = 0;
+				while (sent < line.size()) {
+					int n = send(socket, line.data() + sent, static_cast<int>(line.size() - sent), 0);
+					if (n <= 0) {
+						return;
+					}
+					sent += n;
+				}
+			}
+		};
+
+		// Stream buffer of one writer, sending each line when it ends
+		class LineBuffer : public std::streambuf {
+		public:
+			explicit LineBuffer(Connection& connection) : connection_(connection) {}
+			~LineBuffer() { sync(); }
+
+		protected:
+			int_type overflow(int_type c) override {
+				if (!traits_type::eq_int_type(c, traits_type::eof())) {
+					line_ += traits_type::to_char_type(c);
+					if (line_.back() == '\n') {
+						sync();
+					}
+				}
+				return traits_type::not_eof(c);
+			}
+
+			int sync() override {
+				if (!line_.empty()) {
+					connection_.send_line(line_);
+					line_.clear();
+				}
+				return 0;
+			}
+
+		private:
+			Connection& connection_;
+			std::string line_;
+		};
+
+		// The searches of the session go to the scheduler, each writing
+		// through a buffer of its own
+		void serve(const std::shared_ptr<Connection>& connection, Scheduler& scheduler, size_t cache_mb) {
+			LineBuffer buffer(*connection);
+			std::ostream out(&buffer);
+			UCI session(out, [connection, &scheduler](const UCI::SearchJob& job) {
+				scheduler.submit([connection, job]() {
+					LineBuffer buffer(*connection);
+					std::ostream out(&buffer);
+					job(out);
+				});
+			}, cache_mb);
+
+			std::string pending;
+			char data[4096];
+			while (true) {
+				int n = recv(connection->socket, data, sizeof(data), 0);
+				if (n <= 0) {
+					return;
+				}
+				pending.append(data, n);
+
+				size_t start = 0, end;
+				while ((end = pending.find('\n', start)) != std::string::npos) {
+					std::string line = pending.substr(start, end - start);
+					if (!line.empty() && line.back() == '\r') {
+						line.pop_back();
+					}
+					start = end + 1;
+					if (!session.command(line)) {
+						return;
+					}
+				}
+				pending.erase(0, start);
+				if (pending.size() > MAX_LINE) {
+					return;
+				}
+			}
+		}
+
+		volatile std::sig_atomic_t stopping = 0;
+		Socket listener = NO_SOCKET;
+
+		// Closing the listener ends the wait for connections
+		void on_signal(int) {
+			stopping = 1;
+			close_socket(listener);
+		}
+
+		// Left behind by a server that did not end cleanly
+		void remove_stale_socket(const std::string& path) {
+#ifndef _WIN32
+			struct stat st;
+			if (stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+				unlink(path.c_str());
+			}
+#endif
+		}
+
+		bool listen_on(const std::string& path) {
+			sockaddr_un address;
+			std::memset(&address, 0, sizeof(address));
+			address.sun_family = AF_UNIX;
+			if (path.size() >= sizeof(address.sun_path)) {
+				std::cerr << "Socket path is too long: " << path << "\n";
+				return false;
+			}
+			std::memcpy(address.sun_path, path.c_str(), path.size());
+
+			remove_stale_socket(path);
+			listener = socket(AF_UNIX, SOCK_STREAM, 0);
+			if (listener == NO_SOCKET
+				|| bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+				|| listen(listener, SOMAXCONN) != 0) {
+				std::cerr << "Could not listen on " << path << "\n";
+				if (listener != NO_SOCKET) {
+					close_socket(listener);
+				}
+				return false;
+			}
+			return true;
+		}
+	}
+
+	int Server::run(const std::vector<std::string>& args) {
+		Options options;
+		if (!parse_options(args, options)) {
+			std::cerr << "usage: Siika server <socket> [workers N] [sessions N] [memory MB] [hash MB] [sharedhash NAME]"
+				" [evalfile FILE] [tbpath DIR] [book FILE] [cache FILE]\n";
+			return 1;
+		}
+		if (!UCI::set_hash(options.hash_mb, options.shared_hash)) {
+			std::cerr << "Could not set up the transposition table\n";
+			return 1;
+		}
+
+		// What is left of the memory of a session after its search and its
+		// input line is for the evaluation cache
+		size_t fixed_mb = (UCI::search_bytes() + MAX_LINE + (1 << 20) - 1) >> 20;
+		if (options.memory_mb <= fixed_mb) {
+			std::cerr << "The memory of a session should be more than " << fixed_mb << " MB\n";
+			return 1;
+		}
+		size_t cache_mb = options.memory_mb - fixed_mb;
+
+#ifdef _WIN32
+		WSADATA wsa;
+		if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+			std::cerr << "Could not start Winsock\n";
+			return 1;
+		}
+#else
+		// A client that has gone shows as a failed send
+		std::signal(SIGPIPE, SIG_IGN);
+#endif
+		if (!listen_on(options.path)) {
+			return 1;
+		}
+		std::signal(SIGINT, on_signal);
+		std::signal(SIGTERM, on_signal);
+		std::cout << "Listening on " << options.path << " with " << options.workers << " workers, up to "
+			<< options.sessions << " sessions of " << options.memory_mb << " MB, "
+			<< cache_mb << " MB of it for the evaluation cache" << std::endl;
+
+		Scheduler scheduler(options.workers);
+		std::mutex mutex;
+		std::condition_variable closed;
+		std::vector<Socket> open;
+
+		// Out of descriptors, say, accept fails until a session ends
+		int retry_ms = ACCEPT_RETRY_MS;
+		while (!stopping) {
+			Socket client = accept(listener, nullptr, nullptr);
+			if (client == NO_SOCKET) {
+				if (!stopping) {
+					std::this_thread::sleep_for(std::chrono::milliseconds(retry_ms));
+					retry_ms = std::min(retry_ms * 2, ACCEPT_RETRY_MAX_MS);
+				}
+				continue;
+			}
+			retry_ms = ACCEPT_RETRY_MS;
+			auto connection = std::make_shared<Connection>(client);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (open.size() >= options.sessions) {
+				connection->send_line("info string the server is full\n");
+				continue;
+			}
+			open.push_back(client);
+			std::thread([connection, &scheduler, cache_mb, &mutex, &closed, &open]() {
+				serve(connection, scheduler, cache_mb);
+
+				std::lock_guard<std::mutex> lock(mutex);
+				open.erase(std::find(open.begin(), open.end(), connection->socket));
+				closed.notify_all();
+			}).detach();
+		}
+
+		// The sessions end as if their clients had gone, still sending the
+		// best moves of their searches
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			for (auto socket : open) {
+				stop_reading(socket);
+			}
+			closed.wait(lock, [&open]() { return open.empty(); });
+		}
+		std::remove(options.path.c_str());
+#ifdef _WIN32
+		WSACleanup();
+#endif
+		std::cout << "Stopped" << std::endl;
+		return 0;
+	}
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <string>
+#include <vector>
+
+namespace Chess {
+
+	// UCI sessions over a local socket, one for each connection. At most
+	// workers searches of all sessions run at a time, taking turns in time
+	// slices when more are waiting. The network, the tablebases, the book,
+	// the result cache and the transposition table are set up once and
+	// shared.
+	namespace Server {
+		// Siika server <socket> [workers N] [sessions N] [memory MB] [hash MB]
+		//              [sharedhash NAME] [evalfile FILE] [tbpath DIR] [book FILE]
+		//              [cache FILE]
+		// At most sessions connections are served at a time, each with up
+		// to memory MB for its search, its input and its evaluation cache.
+		int run(const std::vector<std::string>& args);
+	}
+}
+
+#endif // SERVER_H
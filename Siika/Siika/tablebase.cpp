@@ -0,0 +1,769 @@
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "tablebase.h"
+#include "bitboard.h"
+#include "eval.h"
+
+namespace Chess {
+
+	namespace {
+		constexpr int TABLE_COUNT = 35;
+		constexpr int MAX_SLOTS = Tablebases::MAX_PIECES;
+		constexpr int MAX_OTHERS = MAX_SLOTS - 2;
+
+		constexpr char MAGIC[8] = { 'S', 'I', 'I', 'K', 'A', 'T', 'B', '1' };
+
+		struct Header {
+			char magic[8];
+			char name[8];
+			u64 size;
+		};
+
+		// Pieces are indexed in slots: the white king, the black king, then
+		// the others as listed in the table. White is the stronger side.
+		struct Table {
+			char name[8];
+			int count;
+			int types[MAX_OTHERS];
+			int colors[MAX_OTHERS];
+			bool has_pawns;
+			bool identical;
+			u32 key;
+			u64 size;
+			const u8* data;
+			MappedFile file;
+		};
+
+		std::array<Table, TABLE_COUNT> tables;
+		std::array<int, SQUARE_COUNT> triangle_index;
+		int max_pieces_ = 0;
+
+		// White king squares of pawnless tables
+		constexpr int king_triangle[10] = { A1, B1, C1, D1, B2, C2, D2, C3, D3, D4 };
+
+		constexpr int flip_file(int square) { return square ^ 7; }
+		constexpr int flip_rank(int square) { return square ^ 56; }
+		constexpr int flip_diagonal(int square) { return (square >> 3) | ((square & 7) << 3); }
+
+		int slot_type(const Table& t, int slot) {
+			return slot < 2 ? KING : t.types[slot - 2];
+		}
+
+		int slot_color(const Table& t, int slot) {
+			return slot == 0 ? WHITE : slot == 1 ? BLACK : t.colors[slot - 2];
+		}
+
+		// One side's pieces besides the king from the strongest down, in
+		// base 8. More pieces or a larger code make the stronger side.
+		int side_code(const int* types, int count) {
+			int code = 0;
+			for (int i = 0; i < count; i++) {
+				code = code * 8 + types[i];
+			}
+			return code;
+		}
+
+		int side_code(const Position& pos, int color, int& count) {
+			int code = 0;
+			count = 0;
+			for (int type = QUEEN; type >= PAWN; type--) {
+				Bitboard b = pos.pieces(type, color);
+				while (b) {
+					Bitboards::pop(b);
+					code = code * 8 + type;
+					count++;
+				}
+			}
+			return code;
+		}
+
+		bool is_stronger(int count, int code, int other_count, int other_code) {
+			return count != other_count ? count > other_count : code >= other_code;
+		}
+
+		void set_table(Table& t, const std::vector<int>& white, const std::vector<int>& black) {
+			constexpr char letters[PIECETYPE_COUNT] = { ' ', 'P', 'N', 'B', 'R', 'Q', 'K' };
+
+			std::string name = "K";
+			t.count = 0;
+			for (const auto type : white) {
+				name += letters[type];
+				t.types[t.count] = type;
+				t.colors[t.count++] = WHITE;
+			}
+			name += "K";
+			for (const auto type : black) {
+				name += letters[type];
+				t.types[t.count] = type;
+				t.colors[t.count++] = BLACK;
+			}
+			std::memset(t.name, 0, sizeof(t.name));
+			std::memcpy(t.name, name.c_str(), name.size());
+
+			t.has_pawns = std::count(t.types, t.types + t.count, PAWN) > 0;
+			t.identical = t.count == 2 && t.types[0] == t.types[1] && t.colors[0] == t.colors[1];
+			t.key = side_code(white.data(), static_cast<int>(white.size())) * 64 + side_code(black.data(), static_cast<int>(black.size()));
+
+			t.size = (t.has_pawns ? 32 : 10) * 64;
+			for (int i = 0; i < t.count; i++) {
+				t.size *= t.types[i] == PAWN ? 48 : 64;
+			}
+			t.data = nullptr;
+		}
+
+		// All material up to four pieces, ordered so that captures and
+		// promotions lead to tables earlier in the list
+		bool initialize() {
+			constexpr int types[5] = { QUEEN, ROOK, BISHOP, KNIGHT, PAWN };
+
+			std::vector<std::pair<std::vector<int>, std::vector<int>>> materials;
+			for (int i = 0; i < 5; i++) {
+				materials.push_back({ { types[i] }, {} });
+			}
+			for (int i = 0; i < 5; i++) {
+				for (int j = i; j < 5; j++) {
+					materials.push_back({ { types[i], types[j] }, {} });
+					materials.push_back({ { types[i] }, { types[j] } });
+				}
+			}
+
+			auto pawns = [](const std::pair<std::vector<int>, std::vector<int>>& m) {
+				return std::count(m.first.begin(), m.first.end(), PAWN) + std::count(m.second.begin(), m.second.end(), PAWN);
+			};
+			std::stable_sort(materials.begin(), materials.end(), [&pawns](const std::pair<std::vector<int>, std::vector<int>>& a, const std::pair<std::vector<int>, std::vector<int>>& b) {
+				auto a_count = a.first.size() + a.second.size();
+				auto b_count = b.first.size() + b.second.size();
+				return a_count != b_count ? a_count < b_count : pawns(a) < pawns(b);
+			});
+
+			for (int i = 0; i < TABLE_COUNT; i++) {
+				set_table(tables[i], materials[i].first, materials[i].second);
+			}
+
+			triangle_index.fill(-1);
+			for (int i = 0; i < 10; i++) {
+				triangle_index[king_triangle[i]] = i;
+			}
+			return true;
+		}
+
+		bool initialized = initialize();
+
+		template <typename F>
+		void transform(int* squares, int count, F f) {
+			for (int i = 0; i < count; i++) {
+				squares[i] = f(squares[i]);
+			}
+		}
+
+		u64 encode(const Table& t, const int* squares) {
+			int others[MAX_OTHERS];
+			std::copy(squares + 2, squares + 2 + t.count, others);
+			if (t.identical && others[0] > others[1]) {
+				std::swap(others[0], others[1]);
+			}
+
+			u64 index = t.has_pawns
+				? square_rank(squares[0]) * 4 + square_file(squares[0])
+				: triangle_index[squares[0]];
+			index = index * 64 + squares[1];
+			for (int i = 0; i < t.count; i++) {
+				index = t.types[i] == PAWN ? index * 48 + (others[i] - A2) : index * 64 + others[i];
+			}
+			return index;
+		}
+
+		void decode(const Table& t, u64 index, int* squares) {
+			for (int i = t.count - 1; i >= 0; i--) {
+				if (t.types[i] == PAWN) {
+					squares[2 + i] = static_cast<int>(index % 48) + A2;
+					index /= 48;
+				}
+				else {
+					squares[2 + i] = static_cast<int>(index % 64);
+					index /= 64;
+				}
+			}
+			squares[1] = static_cast<int>(index % 64);
+			index /= 64;
+			squares[0] = t.has_pawns
+				? make_square(static_cast<int>(index / 4), static_cast<int>(index % 4))
+				: king_triangle[index];
+		}
+
+		// The white king is mirrored to files a-d, and without pawns into the
+		// a1-d1-d4 triangle. On the diagonal both images are possible, the
+		// smaller index is used so that all images of a position share one.
+		u64 index(const Table& t, const int* in) {
+			int squares[MAX_SLOTS];
+			int count = 2 + t.count;
+			std::copy(in, in + count, squares);
+
+			if (square_file(squares[0]) > FILE_D) {
+				transform(squares, count, flip_file);
+			}
+			if (t.has_pawns) {
+				return encode(t, squares);
+			}
+
+			if (square_rank(squares[0]) > RANK_4) {
+				transform(squares, count, flip_rank);
+			}
+			if (square_rank(squares[0]) > square_file(squares[0])) {
+				transform(squares, count, flip_diagonal);
+			}
+			u64 result = encode(t, squares);
+			if (square_rank(squares[0]) == square_file(squares[0])) {
+				transform(squares, count, flip_diagonal);
+				result = std::min(result, encode(t, squares));
+			}
+			return result;
+		}
+
+		bool is_attacked(const Table& t, const int* squares, int target, int by) {
+			Bitboard empty = Bitboards::ALL;
+			for (int i = 0; i < 2 + t.count; i++) {
+				empty ^= Bitboards::make(squares[i]);
+			}
+
+			for (int i = 0; i < 2 + t.count; i++) {
+				if (slot_color(t, i) != by) {
+					continue;
+				}
+				int from = squares[i];
+				Bitboard attacks = Bitboards::EMPTY;
+				switch (slot_type(t, i)) {
+				case PAWN: attacks = by == WHITE ? Bitboards::pawn_attacks<WHITE>(Bitboards::make(from)) : Bitboards::pawn_attacks<BLACK>(Bitboards::make(from)); break;
+				case KNIGHT: attacks = Bitboards::knight_attacks(from); break;
+				case BISHOP: attacks = Bitboards::bishop_attacks(from, empty); break;
+				case ROOK: attacks = Bitboards::rook_attacks(from, empty); break;
+				case QUEEN: attacks = Bitboards::queen_attacks(from, empty); break;
+				case KING: attacks = Bitboards::king_attacks(from); break;
+				}
+				if (attacks & Bitboards::make(target)) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// Squares of the pieces in slot order. With flip the colors are
+		// swapped and the board mirrored, so that white is the stronger side.
+		void position_squares(const Table& t, const Position& pos, bool flip, int* squares) {
+			int white = flip ? BLACK : WHITE;
+			int mirror = flip ? 56 : 0;
+
+			squares[0] = pos.king_square(white) ^ mirror;
+			squares[1] = pos.king_square(color_flip(white)) ^ mirror;
+			Bitboard taken = Bitboards::EMPTY;
+			for (int i = 0; i < t.count; i++) {
+				int color = t.colors[i] == WHITE ? white : color_flip(white);
+				int square = Bitboards::lsb(pos.pieces(t.types[i], color) & ~taken);
+				taken |= Bitboards::make(square);
+				squares[2 + i] = square ^ mirror;
+			}
+		}
+
+		const Table* find_table(const Position& pos, bool& flip) {
+			int white_count, black_count;
+			int white_code = side_code(pos, WHITE, white_count);
+			int black_code = side_code(pos, BLACK, black_count);
+
+			flip = !is_stronger(white_count, white_code, black_count, black_code);
+			u32 key = flip ? black_code * 64 + white_code : white_code * 64 + black_code;
+			for (const auto& t : tables) {
+				if (t.key == key) {
+					return &t;
+				}
+			}
+			return nullptr;
+		}
+
+		bool is_en_passant_possible(const Position& pos) {
+			int ep = pos.en_passant_square();
+			if (ep == NO_SQUARE) {
+				return false;
+			}
+			Bitboard b = Bitboards::make(ep);
+			Bitboard capturers = pos.turn() == WHITE
+				? Bitboards::pawn_attacks<BLACK>(b) & pos.pieces(PAWN, WHITE)
+				: Bitboards::pawn_attacks<WHITE>(b) & pos.pieces(PAWN, BLACK);
+			return capturers != Bitboards::EMPTY;
+		}
+
+		// The table byte of the position, or -1 when it is not in the tables
+		int probe_byte(const Position& pos) {
+			int count = Bitboards::popcount(pos.pieces());
+			if (count == 2) {
+				return 0;
+			}
+			if (count > Tablebases::MAX_PIECES || pos.castling_rights() != NO_CASTLINGS || is_en_passant_possible(pos)) {
+				return -1;
+			}
+
+			bool flip;
+			const Table* t = find_table(pos, flip);
+			if (!t || !t->data) {
+				return -1;
+			}
+
+			int squares[MAX_SLOTS];
+			position_squares(*t, pos, flip, squares);
+			int side = color_index(flip ? color_flip(pos.turn()) : pos.turn());
+			return t->data[side * t->size + index(*t, squares)];
+		}
+
+		Value to_value(int byte, int ply) {
+			if (byte == 0) {
+				return 0;
+			}
+			int plies = std::min(ply + byte - 1, MAX_PLIES_TILL_MATE);
+			return byte & 1 ? mate(plies) : -mate(plies);
+		}
+
+		std::string table_path(const Table& t, const std::string& dir) {
+			std::string file = std::string(t.name) + ".stb";
+			return dir.empty() ? file : dir + "/" + file;
+		}
+
+		bool map_table(Table& t, const std::string& dir) {
+			t.data = nullptr;
+			if (!t.file.open(table_path(t, dir))) {
+				return false;
+			}
+
+			Header header;
+			if (t.file.size() != sizeof(Header) + 2 * t.size) {
+				t.file.close();
+				return false;
+			}
+			std::memcpy(&header, t.file.data(), sizeof(Header));
+			if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || std::memcmp(header.name, t.name, sizeof(t.name)) != 0 || header.size != t.size) {
+				t.file.close();
+				return false;
+			}
+
+			t.data = t.file.data() + sizeof(Header);
+			return true;
+		}
+
+		// Generation state of one table, indexed by side * size + index
+		class Generator {
+		public:
+			explicit Generator(const Table& t);
+
+			void run(int threads);
+			bool write(const std::string& dir) const;
+			void print_stats() const;
+
+		private:
+			enum ExitFlags : u8 { EXIT_DRAW = 1, EXIT_WIN = 2 };
+			typedef std::vector<std::pair<int, u64>> Scheduled;
+
+			// A position after a double push that allows an en passant
+			// capture. It is not in the index, so it is resolved along with
+			// the others under an id past the table.
+			struct EnPassant {
+				u64 parent;
+				bool in_check;
+				int exit_flags;
+				int longest_loss;
+				int shortest_win;
+				std::vector<u64> children;
+			};
+
+			// Table positions one move away, without duplicates
+			int successors(u64 id, Position& pos, const Position* blank, u64* out, int& exit_flags, int& longest_loss, int& shortest_win, std::vector<EnPassant>& en_passants) const;
+			int expand(u64 id, Position& pos, u64* out, int& exit_flags, int& longest_loss, int& shortest_win, std::vector<EnPassant>* en_passants) const;
+			int predecessors(u64 id, u64* out) const;
+			void initialize_range(u64 begin, u64 end, Scheduled& scheduled, std::vector<EnPassant>& en_passants);
+			void schedule(u64 id, int count, int exit_flags, int longest_loss, int shortest_win, bool in_check, Scheduled& scheduled);
+			void add_en_passants(const std::vector<EnPassant>& en_passants, Scheduled& scheduled);
+
+			static void add_unique(u64 id, u64* out, int& count);
+
+			const Table& t_;
+			std::vector<u8> values_;
+			std::vector<u8> counts_;
+			std::vector<u8> exit_plies_;
+			std::vector<u8> exit_flags_;
+			std::vector<std::vector<u64>> buckets_;
+
+			// The position that pushed to each en passant id, and the table
+			// positions their moves lead to, sorted by table position
+			std::vector<u64> pushes_;
+			std::vector<std::pair<u64, u64>> en_passant_children_;
+		};
+
+		Generator::Generator(const Table& t)
+			: t_(t), values_(2 * t.size, 0), counts_(2 * t.size, 0), exit_plies_(2 * t.size, 0), exit_flags_(2 * t.size, 0), buckets_(256) {
+		}
+
+		void Generator::add_unique(u64 id, u64* out, int& count) {
+			if (std::find(out, out + count, id) == out + count) {
+				out[count++] = id;
+			}
+		}
+
+		int Generator::successors(u64 id, Position& pos, const Position* blank, u64* out, int& exit_flags, int& longest_loss, int& shortest_win, std::vector<EnPassant>& en_passants) const {
+			int side = static_cast<int>(id / t_.size);
+			int squares[MAX_SLOTS];
+			decode(t_, id % t_.size, squares);
+
+			pos = blank[side];
+			for (int i = 0; i < 2 + t_.count; i++) {
+				pos.put_piece(make_piece(slot_type(t_, i), slot_color(t_, i)), squares[i]);
+			}
+			return expand(id, pos, out, exit_flags, longest_loss, shortest_win, &en_passants);
+		}
+
+		// The moves of pos. Captures and promotions leave for the smaller
+		// tables, a double push allowing en passant is expanded into
+		// en_passants and counted under a placeholder id past the table.
+		int Generator::expand(u64 id, Position& pos, u64* out, int& exit_flags, int& longest_loss, int& shortest_win, std::vector<EnPassant>* en_passants) const {
+			int side = color_index(pos.turn());
+			int count = 0;
+			int child[MAX_SLOTS];
+			for (const auto move : pos.legal_moves()) {
+				bool exits = is_promotion(move) || move_flags(move) == EN_PASSANT_CAPTURE || pos.piece_on(move_to(move)) != NO_PIECE;
+				pos.do_move(move);
+				if (exits) {
+					// the smaller tables are generated first, so none is missing
+					int byte = probe_byte(pos);
+					if (byte <= 0) {
+						exit_flags |= EXIT_DRAW;
+					}
+					else if (byte & 1) {
+						exit_flags |= EXIT_WIN;
+						shortest_win = std::min(shortest_win, byte);
+					}
+					else {
+						longest_loss = std::max(longest_loss, byte);
+					}
+				}
+				else if (en_passants && move_flags(move) == PAWN_DOUBLE_PUSH && is_en_passant_possible(pos)) {
+					// with four pieces the side to move has no pawn left to
+					// double push, so its moves stay in the index
+					u64 children[256];
+					EnPassant ep = { id, pos.is_in_check(), 0, 0, 255, {} };
+					int n = expand(id, pos, children, ep.exit_flags, ep.longest_loss, ep.shortest_win, nullptr);
+					ep.children.assign(children, children + n);
+					add_unique(2 * t_.size + en_passants->size(), out, count);
+					en_passants->push_back(ep);
+				}
+				else {
+					position_squares(t_, pos, false, child);
+					add_unique((1 - side) * t_.size + index(t_, child), out, count);
+				}
+				pos.undo_move(move);
+			}
+			return count;
+		}
+
+		// Positions where the side that just moved made a quiet move, that is
+		// not a capture or a promotion, to reach this one. A double push
+		// next to one of our pawns reaches an en passant id instead.
+		int Generator::predecessors(u64 id, u64* out) const {
+			if (id >= 2 * t_.size) {
+				out[0] = pushes_[id - 2 * t_.size];
+				return 1;
+			}
+
+			int side = static_cast<int>(id / t_.size);
+			int us = side == 0 ? WHITE : BLACK;
+			int them = color_flip(us);
+			int squares[MAX_SLOTS];
+			decode(t_, id % t_.size, squares);
+
+			Bitboard empty = Bitboards::ALL;
+			Bitboard our_pawns = Bitboards::EMPTY;
+			for (int i = 0; i < 2 + t_.count; i++) {
+				empty ^= Bitboards::make(squares[i]);
+				if (slot_type(t_, i) == PAWN && slot_color(t_, i) == us) {
+					our_pawns |= Bitboards::make(squares[i]);
+				}
+			}
+
+			int count = 0;
+			for (int i = 0; i < 2 + t_.count; i++) {
+				if (slot_color(t_, i) != them) {
+					continue;
+				}
+				int to = squares[i];
+				Bitboard froms = Bitboards::EMPTY;
+				switch (slot_type(t_, i)) {
+				case PAWN: {
+					int down = them == WHITE ? SOUTH : NORTH;
+					int relative_rank = them == WHITE ? square_rank(to) : RANK_8 - square_rank(to);
+					if (relative_rank >= RANK_3 && (empty & Bitboards::make(to + down))) {
+						froms |= Bitboards::make(to + down);
+						Bitboard en_passant = them == WHITE ? Bitboards::pawn_attacks<WHITE>(Bitboards::make(to + down)) : Bitboards::pawn_attacks<BLACK>(Bitboards::make(to + down));
+						if (relative_rank == RANK_4 && (empty & Bitboards::make(to + 2 * down)) && !(en_passant & our_pawns)) {
+							froms |= Bitboards::make(to + 2 * down);
+						}
+					}
+					break;
+				}
+				case KNIGHT: froms = Bitboards::knight_attacks(to) & empty; break;
+				case BISHOP: froms = Bitboards::bishop_attacks(to, empty) & empty; break;
+				case ROOK: froms = Bitboards::rook_attacks(to, empty) & empty; break;
+				case QUEEN: froms = Bitboards::queen_attacks(to, empty) & empty; break;
+				case KING: froms = Bitboards::king_attacks(to) & empty; break;
+				}
+
+				while (froms) {
+					int previous[MAX_SLOTS];
+					std::copy(squares, squares + 2 + t_.count, previous);
+					previous[i] = Bitboards::pop(froms);
+
+					// our king can not be in check when they are to move
+					if (is_attacked(t_, previous, previous[us == WHITE ? 0 : 1], them)) {
+						continue;
+					}
+					add_unique((1 - side) * t_.size + index(t_, previous), out, count);
+				}
+			}
+
+			auto range = std::equal_range(en_passant_children_.begin(), en_passant_children_.end(), std::make_pair(id, u64(0)),
+				[](const std::pair<u64, u64>& a, const std::pair<u64, u64>& b) { return a.first < b.first; });
+			for (auto it = range.first; it != range.second; ++it) {
+				add_unique(it->second, out, count);
+			}
+			return count;
+		}
+
+		void Generator::initialize_range(u64 begin, u64 end, Scheduled& scheduled, std::vector<EnPassant>& en_passants) {
+			Position blank[2] = { Position("8/8/8/8/8/8/8/8 w - - 0 1"), Position("8/8/8/8/8/8/8/8 b - - 0 1") };
+			Position pos;
+			u64 children[256];
+
+			for (u64 id = begin; id < end; id++) {
+				int side = static_cast<int>(id / t_.size);
+				u64 i = id % t_.size;
+				int squares[MAX_SLOTS];
+				decode(t_, i, squares);
+
+				// one entry per position, and the side not to move is not in check
+				Bitboard occupied = Bitboards::EMPTY;
+				for (int s = 0; s < 2 + t_.count; s++) {
+					occupied |= Bitboards::make(squares[s]);
+				}
+				if (Bitboards::popcount(occupied) != 2 + t_.count || index(t_, squares) != i) {
+					continue;
+				}
+				int us = side == 0 ? WHITE : BLACK;
+				if (is_attacked(t_, squares, squares[us == WHITE ? 1 : 0], us)) {
+					continue;
+				}
+
+				int exit_flags = 0;
+				int longest_loss = 0;
+				int shortest_win = 255;
+				int count = successors(id, pos, blank, children, exit_flags, longest_loss, shortest_win, en_passants);
+				schedule(id, count, exit_flags, longest_loss, shortest_win, pos.is_in_check(), scheduled);
+			}
+		}
+
+		void Generator::schedule(u64 id, int count, int exit_flags, int longest_loss, int shortest_win, bool in_check, Scheduled& scheduled) {
+			if (count == 0 && exit_flags == 0 && longest_loss == 0) {
+				if (in_check) {
+					scheduled.push_back({ 0, id });
+				}
+				return;
+			}
+
+			counts_[id] = static_cast<u8>(count);
+			exit_plies_[id] = static_cast<u8>(longest_loss);
+			exit_flags_[id] = static_cast<u8>(exit_flags);
+			if (exit_flags & EXIT_WIN) {
+				scheduled.push_back({ shortest_win, id });
+			}
+			else if (count == 0 && !(exit_flags & EXIT_DRAW)) {
+				scheduled.push_back({ longest_loss, id });
+			}
+		}
+
+		// Gives the en passant positions found by the workers their ids
+		void Generator::add_en_passants(const std::vector<EnPassant>& en_passants, Scheduled& scheduled) {
+			for (const auto& ep : en_passants) {
+				u64 id = values_.size();
+				values_.push_back(0);
+				counts_.push_back(0);
+				exit_plies_.push_back(0);
+				exit_flags_.push_back(0);
+				pushes_.push_back(ep.parent);
+				for (const auto child : ep.children) {
+					en_passant_children_.push_back({ child, id });
+				}
+				schedule(id, static_cast<int>(ep.children.size()), ep.exit_flags, ep.longest_loss, ep.shortest_win, ep.in_check, scheduled);
+			}
+		}
+
+		// A position loses in n plies when all moves lead to wins in at most
+		// n - 1 plies, and wins in n when a move leads to a loss in n - 1.
+		// Positions are resolved in order of plies, counting down the moves
+		// not yet known to lose; what is left at the end is a draw.
+		void Generator::run(int threads) {
+			std::vector<Scheduled> scheduled(threads + 1);
+			std::vector<std::vector<EnPassant>> en_passants(threads);
+			std::vector<std::thread> workers;
+			u64 chunk = (2 * t_.size + threads - 1) / threads;
+			for (int i = 0; i < threads; i++) {
+				u64 begin = i * chunk;
+				u64 end = std::min(2 * t_.size, begin + chunk);
+				workers.emplace_back([this, begin, end, &scheduled, &en_passants, i]() { initialize_range(begin, end, scheduled[i], en_passants[i]); });
+			}
+			for (auto& worker : workers) {
+				worker.join();
+			}
+			for (const auto& e : en_passants) {
+				add_en_passants(e, scheduled[threads]);
+			}
+			std::sort(en_passant_children_.begin(), en_passant_children_.end());
+			for (const auto& s : scheduled) {
+				for (const auto& entry : s) {
+					buckets_[entry.first].push_back(entry.second);
+				}
+			}
+
+			u64 previous[256];
+			for (int plies = 0; plies < 255; plies++) {
+				auto& bucket = buckets_[plies];
+				for (size_t i = 0; i < bucket.size(); i++) {
+					u64 id = bucket[i];
+					if (values_[id]) {
+						continue;
+					}
+					values_[id] = static_cast<u8>(plies + 1);
+
+					int count = predecessors(id, previous);
+					for (int j = 0; j < count; j++) {
+						u64 p = previous[j];
+						if (values_[p]) {
+							continue;
+						}
+						if (plies % 2 == 0) {
+							buckets_[plies + 1].push_back(p);
+						}
+						else if (--counts_[p] == 0 && !(exit_flags_[p] & (EXIT_DRAW | EXIT_WIN))) {
+							buckets_[std::max(plies + 1, static_cast<int>(exit_plies_[p]))].push_back(p);
+						}
+					}
+				}
+				std::vector<u64>().swap(bucket);
+			}
+		}
+
+		bool Generator::write(const std::string& dir) const {
+			std::ofstream out(table_path(t_, dir), std::ios::binary);
+			if (!out) {
+				return false;
+			}
+
+			Header header;
+			std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+			std::memcpy(header.name, t_.name, sizeof(t_.name));
+			header.size = t_.size;
+			out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			out.write(reinterpret_cast<const char*>(values_.data()), 2 * t_.size);
+			return static_cast<bool>(out);
+		}
+
+		void Generator::print_stats() const {
+			u64 wins = 0, losses = 0;
+			int longest = 0;
+			for (u64 id = 0; id < 2 * t_.size; id++) {
+				int byte = values_[id];
+				if (byte) {
+					(byte & 1 ? losses : wins)++;
+					longest = std::max(longest, byte - 1);
+				}
+			}
+			std::cout << t_.name << ": " << wins << " wins, " << losses << " losses, longest mate " << longest << " plies";
+		}
+	}
+
+	int Tablebases::init(const std::string& dir) {
+		int found = 0;
+		max_pieces_ = 0;
+		for (auto& t : tables) {
+			if (map_table(t, dir)) {
+				found++;
+				max_pieces_ = std::max(max_pieces_, 2 + t.count);
+			}
+		}
+		return found;
+	}
+
+	int Tablebases::max_pieces() {
+		return max_pieces_;
+	}
+
+	bool Tablebases::probe(const Position& pos, int ply, Value& value) noexcept {
+		if (max_pieces_ == 0 || Bitboards::popcount(pos.pieces()) > max_pieces_) {
+			return false;
+		}
+		int byte = probe_byte(pos);
+		if (byte < 0) {
+			return false;
+		}
+		value = to_value(byte, ply);
+		return true;
+	}
+
+	bool Tablebases::probe_root(Position& pos, Move& move, Value& value) {
+		Value v;
+		if (!probe(pos, 0, v)) {
+			return false;
+		}
+
+		auto moves = pos.legal_moves();
+		if (moves.empty()) {
+			return false;
+		}
+
+		value = VALUE_MIN;
+		for (const auto m : moves) {
+			pos.do_move(m);
+			bool found = probe(pos, 1, v);
+			pos.undo_move(m);
+			if (!found) {
+				return false;
+			}
+			if (-v > value) {
+				value = -v;
+				move = m;
+			}
+		}
+		return true;
+	}
+
+	bool Tablebases::generate(const std::string& dir, int threads) {
+		threads = std::max(1, threads);
+		for (auto& t : tables) {
+			if (map_table(t, dir)) {
+				std::cout << t.name << ": found\n";
+				continue;
+			}
+
+			Timer timer;
+			Generator generator(t);
+			generator.run(threads);
+			if (!generator.write(dir) || !map_table(t, dir)) {
+				std::cout << "Could not write " << table_path(t, dir) << "\n";
+				return false;
+			}
+			generator.print_stats();
+			std::cout << " (" << timer.get_elapsed_microseconds() / 1000000.0 << " s)" << std::endl;
+		}
+		init(dir);
+		return true;
+	}
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#ifndef TABLEBASE_H
+#define TABLEBASE_H
+
+#include <string>
+
+#include "chess.h"
+#include "position.h"
+
+namespace Chess {
+
+	// Distance to mate tables for all material with three and four pieces.
+	// A table holds one byte per position and side to move: 0 for a draw,
+	// otherwise the plies to mate plus one, so odd bytes are losses and even
+	// bytes wins for the side to move. Positions with castling rights or a
+	// possible en passant capture are not in the tables, and the fifty move
+	// rule is ignored.
+	namespace Tablebases {
+		constexpr int MAX_PIECES = 4;
+
+		// Maps the table files in dir, returns how many were found
+		int init(const std::string& dir);
+		int max_pieces();
+
+		// Value of the position as a search at ply would score it. Does not
+		// allocate, so it can be called from the search.
+		bool probe(const Position& pos, int ply, Value& value) noexcept;
+
+		// The move keeping the best value at the root
+		bool probe_root(Position& pos, Move& move, Value& value);
+
+		// Writes the missing tables to dir by retrograde analysis, smaller
+		// tables first as the larger ones probe them for captures and
+		// promotions
+		bool generate(const std::string& dir, int threads);
+	}
+}
+
+#endif // TABLEBASE_H
@@ -0,0 +1,84 @@
+#include <iostream>
+#include <sstream>
+
+#include "tools.h"
+#include "nnue.h"
+#include "tablebase.h"
+
+namespace Chess {
+
+	Tools::Worker::Worker(bool nnue, int make_mode, TranspositionTable* tt)
+		: search(is_searching, make_mode, tt) {
+		if (nnue) {
+			accumulators.resize(MAX_PLYS);
+			pos.attach(accumulators.data());
+		}
+	}
+
+	bool Tools::parse_engine_option(const std::vector<std::string>& args, size_t& i, bool& ok) {
+		const std::string& arg = args[i];
+		if (i + 1 >= args.size() || (arg != "evalfile" && arg != "tbpath")) {
+			return false;
+		}
+
+		const std::string& value = args[++i];
+		if (arg == "evalfile") {
+			ok = NNUE::load(value);
+			if (!ok) {
+				std::cerr << "Could not load network " << value << "\n";
+			}
+		}
+		else {
+			Tablebases::init(value);
+		}
+		return true;
+	}
+
+	bool Tools::parse_integer(const std::string& arg, const std::string& value, long long min, long long max, long long& result) {
+		std::istringstream iss(value);
+		long long n;
+		if (!(iss >> n) || !(iss >> std::ws).eof() || n < min || n > max) {
+			std::cerr << "Invalid " << arg << " " << value << "\n";
+			return false;
+		}
+		result = n;
+		return true;
+	}
+
+	bool Tools::is_game_over(const Position& pos, const std::vector<Move>& moves, int ply, std::string& reason, int& white_points) {
+		white_points = 1;
+		if (moves.empty()) {
+			reason = pos.is_in_check() ? "mate" : "stalemate";
+			if (pos.is_in_check()) {
+				white_points = pos.turn() == WHITE ? 0 : 2;
+			}
+		}
+		else if (pos.halfmove() >= 100) {
+			reason = "fifty moves";
+		}
+		else if (pos.is_3x_repeat()) {
+			reason = "repetition";
+		}
+		else if (pos.is_insufficient_material()) {
+			reason = "insufficient material";
+		}
+		else if (ply >= MAX_GAME_PLIES) {
+			reason = "game too long";
+		}
+		else {
+			return false;
+		}
+		return true;
+	}
+
+	bool Tools::parse_real(const std::string& arg, const std::string& value, double min, double max, double& result) {
+		std::istringstream iss(value);
+		double x;
+		if (!(iss >> x) || !(iss >> std::ws).eof() || !(x >= min && x <= max)) {
+			std::cerr << "Invalid " << arg << " " << value << "\n";
+			return false;
+		}
+		result = x;
+		return true;
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#ifndef TOOLS_H
+#define TOOLS_H
+
+#include <atomic>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "chess.h"
+#include "position.h"
+#include "search.h"
+
+namespace Chess {
+
+	// Shared by the command line tools that search on several threads
+	namespace Tools {
+		// Bounds of the numeric arguments
+		constexpr long long MAX_ARGUMENT = std::numeric_limits<long long>::max();
+		constexpr long long MAX_THREADS = 1024;
+
+		// Without a limit each move of a played game gets this many nodes
+		constexpr u64 DEFAULT_NODES = 10000;
+
+		// Longer games are drawn, so that a game between weak settings ends
+		constexpr int MAX_GAME_PLIES = 400;
+
+		// Per thread state, a search is never stopped from outside. The
+		// position has accumulators when the search evaluates with the network.
+		struct Worker {
+			std::atomic<bool> is_searching{ true };
+			Search search;
+			Position pos;
+			std::vector<NNUE::Accumulator> accumulators;
+
+			explicit Worker(bool nnue = NNUE::is_loaded(), int make_mode = MAKE_UNMAKE, TranspositionTable* tt = nullptr);
+		};
+
+		// The arguments every tool takes, evalfile FILE and tbpath DIR. False
+		// when args[i] is not one of them, otherwise i is moved to the value
+		// and ok cleared when the network could not be loaded.
+		bool parse_engine_option(const std::vector<std::string>& args, size_t& i, bool& ok);
+
+		// The value of argument arg when all of it is an integer in [min,
+		// max], like UCI::parse_spin. Otherwise prints it and returns false.
+		bool parse_integer(const std::string& arg, const std::string& value, long long min, long long max, long long& result);
+
+		template <typename T>
+		bool parse_integer(const std::string& arg, const std::string& value, long long min, long long max, T& result) {
+			long long n;
+			if (!parse_integer(arg, value, min, max, n)) {
+				return false;
+			}
+			result = static_cast<T>(n);
+			return true;
+		}
+
+		// The same for a real number
+		bool parse_real(const std::string& arg, const std::string& value, double min, double max, double& result);
+
+		// True when a game is over before the side to move plays one of its
+		// legal moves at ply: by mate, stalemate, the fifty move rule,
+		// repetition, insufficient material or MAX_GAME_PLIES. Sets the
+		// reason and the points for white in half points, 2 for a win.
+		bool is_game_over(const Position& pos, const std::vector<Move>& moves, int ply, std::string& reason, int& white_points);
+	}
+}
+
+#endif // TOOLS_H
@@ -0,0 +1,470 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "tt.h"
+#include "eval.h"
+#include "nnue.h"
+#include "search.h"
+#include "tools.h"
+#include "uci.h"
+
+namespace Chess {
+
+	namespace {
+		constexpr u64 MAGIC = 0x325454414B494953; // "SIIKATT2"
+
+		// Another process may still be setting up a table it created
+		constexpr int ATTACH_RETRIES = 1000;
+
+		// move 16 bits, value 32, depth 8, bound 2 and generation 6
+		u64 pack(Move move, Value value, int depth, Bound bound, u32 generation) {
+			return static_cast<u64>(move) | static_cast<u64>(static_cast<u32>(value)) << 16
+				| static_cast<u64>(depth) << 48 | static_cast<u64>(bound) << 56 | static_cast<u64>(generation & 63) << 58;
+		}
+
+		Bound bound_of(u64 data) { return static_cast<Bound>((data >> 56) & 3); }
+		int depth_of(u64 data) { return static_cast<int>((data >> 48) & 255); }
+		u32 generation_of(u64 data) { return static_cast<u32>(data >> 58); }
+	}
+
+	TranspositionTable::~TranspositionTable() {
+		release();
+	}
+
+	size_t TranspositionTable::slot_count(size_t size_mb) {
+		size_t count = std::max<size_t>(size_mb * 1024 * 1024 / sizeof(Slot), 1);
+		size_t n = 1;
+		while (n * 2 <= count) {
+			n *= 2;
+		}
+		return n;
+	}
+
+	void TranspositionTable::use(Header* header, void* slots) {
+		header_ = header;
+		slots_ = static_cast<Slot*>(slots);
+		mask_ = header_->count - 1;
+	}
+
+	bool TranspositionTable::resize(size_t size_mb) {
+		release();
+		size_t count = slot_count(size_mb);
+		bytes_ = count * sizeof(Slot);
+		try {
+			memory_.assign(bytes_ / sizeof(u64), 0);
+		}
+		catch (const std::bad_alloc&) {
+			bytes_ = 0;
+			return false;
+		}
+		private_header_.magic = MAGIC;
+		private_header_.count = count;
+		private_header_.generation.store(0, std::memory_order_relaxed);
+		private_header_.attached.store(0, std::memory_order_relaxed);
+		private_header_.searches.store(0, std::memory_order_relaxed);
+		use(&private_header_, memory_.data());
+		return true;
+	}
+
+	// Without the shared table the process goes on with a private one
+	bool TranspositionTable::attach(const std::string& name, size_t size_mb) {
+		release();
+		if (name.empty() || !map_shared(name, slot_count(size_mb))) {
+			resize(size_mb);
+			return false;
+		}
+		return true;
+	}
+
+	void TranspositionTable::detach() {
+		if (is_shared()) {
+			resize(size_mb());
+		}
+	}
+
+#ifdef _WIN32
+	// The system removes the mapping with its last handle
+	bool TranspositionTable::map_shared(const std::string& name, size_t count) {
+		u64 bytes = HEADER_BYTES + count * sizeof(Slot);
+		std::string object = "Local\\" + name;
+		HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+			static_cast<DWORD>(bytes >> 32), static_cast<DWORD>(bytes), object.c_str());
+		if (!mapping) {
+			return false;
+		}
+		bool created = GetLastError() != ERROR_ALREADY_EXISTS;
+		void* view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+		if (!view) {
+			CloseHandle(mapping);
+			return false;
+		}
+
+		Header* header = static_cast<Header*>(view);
+		if (created) {
+			header->count = count;
+			std::atomic_thread_fence(std::memory_order_release);
+			header->magic = MAGIC;
+		}
+		else {
+			int retries = 0;
+			while (header->magic != MAGIC && retries++ < ATTACH_RETRIES) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			std::atomic_thread_fence(std::memory_order_acquire);
+			MEMORY_BASIC_INFORMATION info;
+			if (header->magic != MAGIC || VirtualQuery(view, &info, sizeof(info)) == 0
+				|| info.RegionSize < HEADER_BYTES + header->count * sizeof(Slot)) {
+				UnmapViewOfFile(view);
+				CloseHandle(mapping);
+				return false;
+			}
+		}
+		header->attached.fetch_add(1);
+
+		mapping_ = mapping;
+		name_ = name;
+		bytes_ = static_cast<size_t>(HEADER_BYTES + header->count * sizeof(Slot));
+		use(header, static_cast<u8*>(view) + HEADER_BYTES);
+		return true;
+	}
+
+	void TranspositionTable::release() {
+		if (is_shared()) {
+			header_->attached.fetch_sub(1);
+			UnmapViewOfFile(header_);
+			CloseHandle(mapping_);
+			mapping_ = nullptr;
+			name_.clear();
+		}
+		LargeVector<u64>(memory_.get_allocator()).swap(memory_);
+		header_ = nullptr;
+		slots_ = nullptr;
+		mask_ = 0;
+		bytes_ = 0;
+	}
+#else
+	// A segment left by a process that did not detach stays until it is
+	// removed from /dev/shm or the host restarts
+	bool TranspositionTable::map_shared(const std::string& name, size_t count) {
+		std::string object = name[0] == '/' ? name : "/" + name;
+		size_t bytes = HEADER_BYTES + count * sizeof(Slot);
+
+		int fd = shm_open(object.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+		bool created = fd >= 0;
+		if (!created) {
+			fd = errno == EEXIST ? shm_open(object.c_str(), O_RDWR, 0600) : -1;
+		}
+		if (fd < 0) {
+			return false;
+		}
+
+		void* memory = MAP_FAILED;
+		if (created) {
+			if (ftruncate(fd, static_cast<off_t>(bytes)) == 0) {
+				memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			}
+			if (memory == MAP_FAILED) {
+				close(fd);
+				shm_unlink(object.c_str());
+				return false;
+			}
+			Header* header = static_cast<Header*>(memory);
+			header->count = count;
+			std::atomic_thread_fence(std::memory_order_release);
+			header->magic = MAGIC;
+		}
+		else {
+			for (int retries = 0; memory == MAP_FAILED && retries < ATTACH_RETRIES; retries++) {
+				struct stat st;
+				if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) > HEADER_BYTES) {
+					bytes = static_cast<size_t>(st.st_size);
+					memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+				}
+				if (memory != MAP_FAILED) {
+					const Header* header = static_cast<const Header*>(memory);
+					bool ready = header->magic == MAGIC;
+					std::atomic_thread_fence(std::memory_order_acquire);
+					if (!ready || HEADER_BYTES + header->count * sizeof(Slot) != bytes) {
+						munmap(memory, bytes);
+						memory = MAP_FAILED;
+					}
+				}
+				if (memory == MAP_FAILED) {
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+			}
+			if (memory == MAP_FAILED) {
+				close(fd);
+				return false;
+			}
+		}
+#ifdef MADV_HUGEPAGE
+		// Huge pages of shared memory also depend on the host allowing them
+		madvise(memory, bytes, MADV_HUGEPAGE);
+#endif
+		// The mapping stays valid after the descriptor is closed
+		close(fd);
+		static_cast<Header*>(memory)->attached.fetch_add(1);
+
+		name_ = object;
+		bytes_ = bytes;
+		use(static_cast<Header*>(memory), static_cast<u8*>(memory) + HEADER_BYTES);
+		return true;
+	}
+
+	void TranspositionTable::release() {
+		if (is_shared()) {
+			bool last = header_->attached.fetch_sub(1) == 1;
+			munmap(header_, bytes_);
+			if (last) {
+				shm_unlink(name_.c_str());
+			}
+			name_.clear();
+		}
+		LargeVector<u64>(memory_.get_allocator()).swap(memory_);
+		header_ = nullptr;
+		slots_ = nullptr;
+		mask_ = 0;
+		bytes_ = 0;
+	}
+#endif
+
+	bool TranspositionTable::is_shared() const {
+		return !name_.empty();
+	}
+
+	size_t TranspositionTable::size_mb() const {
+		return header_ ? static_cast<size_t>(header_->count * sizeof(Slot) / (1024 * 1024)) : 0;
+	}
+
+	void TranspositionTable::clear() {
+		for (u64 i = 0; header_ && i <= mask_; i++) {
+			slots_[i].check.store(0, std::memory_order_relaxed);
+			slots_[i].data.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	void TranspositionTable::new_search() {
+		if (header_) {
+			u32 searches = header_->searches.fetch_add(1, std::memory_order_relaxed) + 1;
+			u32 processes = std::max(header_->attached.load(std::memory_order_relaxed), 1u);
+			if (searches % processes == 0) {
+				header_->generation.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+	}
+
+	bool TranspositionTable::probe(u64 key, Data& data) const {
+		if (!header_) {
+			return false;
+		}
+		const Slot& slot = slots_[key & mask_];
+		u64 d = slot.data.load(std::memory_order_relaxed);
+		u64 check = slot.check.load(std::memory_order_relaxed);
+		if ((check ^ d) != key || bound_of(d) == BOUND_NONE) {
+			return false;
+		}
+		data.move = static_cast<Move>(d & 0xFFFF);
+		data.value = static_cast<Value>(static_cast<u32>(d >> 16));
+		data.depth = depth_of(d);
+		data.bound = bound_of(d);
+		return true;
+	}
+
+	// Deeper entries of the current search are kept, unless the new one
+	// is exact
+	void TranspositionTable::store(u64 key, Move move, Value value, int depth, Bound bound) {
+		if (!header_) {
+			return;
+		}
+		Slot& slot = slots_[key & mask_];
+		u32 generation = header_->generation.load(std::memory_order_relaxed) & 63;
+		u64 old = slot.data.load(std::memory_order_relaxed);
+		if (bound_of(old) != BOUND_NONE) {
+			bool same = (slot.check.load(std::memory_order_relaxed) ^ old) == key;
+			if (generation_of(old) == generation && depth_of(old) > depth && bound != BOUND_EXACT) {
+				return;
+			}
+			if (same && move == NULLMOVE) {
+				move = static_cast<Move>(old & 0xFFFF);
+			}
+		}
+
+		u64 d = pack(move, value, std::min(std::max(depth, 0), 255), bound, generation);
+		slot.check.store(key ^ d, std::memory_order_relaxed);
+		slot.data.store(d, std::memory_order_relaxed);
+	}
+
+	int TranspositionTable::hashfull() const {
+		if (!header_) {
+			return 0;
+		}
+		u32 generation = header_->generation.load(std::memory_order_relaxed) & 63;
+		u64 sample = std::min<u64>(1000, mask_ + 1);
+		u64 used = 0;
+		for (u64 i = 0; i < sample; i++) {
+			u64 d = slots_[i].data.load(std::memory_order_relaxed);
+			used += bound_of(d) != BOUND_NONE && generation_of(d) == generation;
+		}
+		return static_cast<int>(used * 1000 / sample);
+	}
+
+	Value TranspositionTable::value_to_tt(Value value, int ply) {
+		return value >= -MATE ? value + ply : value <= MATE ? value - ply : value;
+	}
+
+	Value TranspositionTable::value_from_tt(Value value, int ply) {
+		return value >= -MATE ? value - ply : value <= MATE ? value + ply : value;
+	}
+
+	namespace {
+		struct BenchOptions {
+			int workers = 4;
+			u32 depth = 6;
+			int plies = 24;
+			size_t hash_mb = 16;
+		};
+
+		// Positions of a game played with short searches after the given
+		// first move, so that the games of the workers differ but share
+		// much of their trees
+		std::vector<std::string> bench_positions(int plies, int first) {
+			std::atomic<bool> is_searching{ true };
+			Search search(is_searching);
+			SearchParameters sp;
+			sp.max_depth = 3;
+
+			std::vector<std::string> fens;
+			Position game;
+			auto moves = game.legal_moves();
+			game.do_move(moves[first % moves.size()]);
+			for (int i = 0; i < plies && !game.legal_moves().empty(); i++) {
+				fens.push_back(game.fen());
+				Position pos = game;
+				game.do_move(search.run(pos, sp).bestmove);
+			}
+			return fens;
+		}
+
+		struct BenchResult {
+			u64 nodes = 0;
+			double seconds = 0;
+		};
+
+		// Each worker goes through the positions of its game, keeping its
+		// table from one to the next
+		BenchResult bench_run(const BenchOptions& options, const std::vector<std::vector<std::string>>& games, const std::string& shared) {
+			std::vector<u64> nodes(options.workers);
+			std::vector<char> ok(options.workers, 1);
+			Timer timer;
+
+			auto work = [&](int w) {
+				TranspositionTable tt;
+				ok[w] = shared.empty() ? tt.resize(options.hash_mb) : tt.attach(shared, options.hash_mb);
+
+				Tools::Worker worker(NNUE::is_loaded(), MAKE_UNMAKE, &tt);
+				SearchParameters sp;
+				sp.max_depth = options.depth;
+
+				for (const auto& fen : games[w]) {
+					worker.pos.set(fen);
+					nodes[w] += worker.search.run(worker.pos, sp).nodes;
+				}
+			};
+
+			std::vector<std::thread> threads;
+			for (int w = 0; w < options.workers; w++) {
+				threads.emplace_back(work, w);
+			}
+			for (auto& thread : threads) {
+				thread.join();
+			}
+
+			BenchResult result;
+			result.seconds = timer.get_elapsed_microseconds() / 1000000.0;
+			for (int w = 0; w < options.workers; w++) {
+				result.nodes += nodes[w];
+				if (!ok[w]) {
+					result.seconds = 0;
+				}
+			}
+			return result;
+		}
+
+		void print_bench(const char* name, const BenchResult& r, size_t searches) {
+			std::cout << std::left << std::setw(16) << name << std::right << std::fixed << std::setprecision(2)
+				<< r.seconds << " s, " << std::setw(10) << r.nodes << " nodes, "
+				<< std::setprecision(1) << searches / std::max(r.seconds, 1e-6) << " searches/s" << std::endl;
+		}
+	}
+
+	int TranspositionTable::bench(const std::vector<std::string>& args) {
+		BenchOptions options;
+		bool ok = true;
+		for (size_t i = 0; ok && i < args.size(); i++) {
+			const std::string& arg = args[i];
+			bool has_value = i + 1 < args.size();
+
+			if (arg == "workers" && has_value) {
+				ok = Tools::parse_integer(arg, args[++i], 1, Tools::MAX_THREADS, options.workers);
+			}
+			else if (arg == "depth" && has_value) {
+				ok = Tools::parse_integer(arg, args[++i], 1, MAX_SEARCH_DEPTH, options.depth);
+			}
+			else if (arg == "plies" && has_value) {
+				ok = Tools::parse_integer(arg, args[++i], 1, Tools::MAX_GAME_PLIES, options.plies);
+			}
+			else if (arg == "hash" && has_value) {
+				ok = Tools::parse_integer(arg, args[++i], 1, UCI::MAX_HASH_MB, options.hash_mb);
+			}
+			else {
+				ok = false;
+			}
+		}
+		if (!ok) {
+			std::cerr << "usage: Siika ttbench [workers N] [depth N] [plies N] [hash MB]\n";
+			return 1;
+		}
+
+		std::vector<std::vector<std::string>> games;
+		size_t searches = 0;
+		for (int w = 0; w < options.workers; w++) {
+			games.push_back(bench_positions(options.plies, w));
+			searches += games.back().size();
+		}
+		std::cout << options.workers << " workers, " << searches << " positions to depth " << options.depth
+			<< ", " << options.hash_mb << " MB tables" << std::endl;
+
+		BenchResult isolated = bench_run(options, games, "");
+		print_bench("Private tables", isolated, searches);
+
+		std::string name = "siika-ttbench-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+		BenchResult shared = bench_run(options, games, name);
+		if (shared.seconds == 0) {
+			std::cerr << "Could not attach to a shared table\n";
+			return 1;
+		}
+		print_bench("Shared table", shared, searches);
+
+		std::cout << "Throughput gain " << std::setprecision(2) << isolated.seconds / std::max(shared.seconds, 1e-6)
+			<< "x, nodes " << static_cast<double>(shared.nodes) / std::max<u64>(isolated.nodes, 1) << "x" << std::endl;
+		return 0;
+	}
+}
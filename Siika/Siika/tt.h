@@ -0,0 +1,119 @@
+#pragma once
+
+#ifndef TT_H
+#define TT_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "chess.h"
+#include "position.h"
+#include "search.h"
+
+namespace Chess {
+
+	// Transposition table of single entry slots, either private to the
+	// process or in a named shared memory segment that several processes
+	// on the host attach to. Entries are written without locks as two
+	// words, the first one the key xor the second, so that a torn entry
+	// does not check out and is never seen.
+	class TranspositionTable {
+	public:
+		struct Data {
+			Move move;
+			Value value;
+			int depth;
+			Bound bound;
+		};
+
+		TranspositionTable() = default;
+		~TranspositionTable();
+		TranspositionTable(const TranspositionTable&) = delete;
+		TranspositionTable& operator=(const TranspositionTable&) = delete;
+
+		// A cleared table of this process, detaching from a shared one
+		bool resize(size_t size_mb);
+
+		// Uses the shared table of that name, created with size_mb if there
+		// is none. An existing one keeps its size.
+		bool attach(const std::string& name, size_t size_mb);
+
+		// Back to a private table of the same size. The last process to
+		// detach removes the shared table.
+		void detach();
+
+		bool is_shared() const;
+		size_t size_mb() const;
+
+		void clear();
+
+		// Entries of earlier searches are replaced first. A shared table
+		// moves on to the next generation once for as many searches as
+		// there are processes attached, so that one process searching
+		// often does not age the entries of the others.
+		void new_search();
+
+		bool probe(u64 key, Data& data) const;
+		void store(u64 key, Move move, Value value, int depth, Bound bound);
+
+		// Entries of the current search per mille, from a sample
+		int hashfull() const;
+
+		// Mate values are stored from the position, not from the root
+		static Value value_to_tt(Value value, int ply);
+		static Value value_from_tt(Value value, int ply);
+
+		// Siika ttbench [workers N] [depth N] [plies N] [hash MB]
+		// Workers analyze the positions of a game each, the games opening
+		// with different first moves, with a private table and then
+		// attached to one shared table, and the throughput of both is
+		// compared. Each worker maps the shared table on its own, as a
+		// process would.
+		static int bench(const std::vector<std::string>& args);
+
+	private:
+		// A shared table has the header at the start of its memory, followed
+		// by the slots from the next cache line on. A private one keeps it
+		// apart so that the slots fill whole large pages.
+		struct Header {
+			u64 magic;
+			u64 count;
+			std::atomic<u32> generation;
+			std::atomic<u32> attached;
+			std::atomic<u32> searches;
+		};
+
+		struct Slot {
+			std::atomic<u64> check;
+			std::atomic<u64> data;
+		};
+
+		static constexpr size_t HEADER_BYTES = 64;
+
+		static_assert(sizeof(Header) <= HEADER_BYTES, "Header should fit in a cache line");
+		static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "slots are shared between processes");
+		static_assert(sizeof(Slot) == 16, "Slot should be 16 bytes");
+
+		static size_t slot_count(size_t size_mb);
+
+		void use(Header* header, void* slots);
+		bool map_shared(const std::string& name, size_t count);
+		void release();
+
+		Header* header_ = nullptr;
+		Slot* slots_ = nullptr;
+		u64 mask_ = 0;
+		size_t bytes_ = 0;
+
+		// The slots of a private table, or the mapping of a shared one
+		Header private_header_;
+		LargeVector<u64> memory_{ LargePageAllocator<u64>("transposition table") };
+		std::string name_;
+#ifdef _WIN32
+		void* mapping_ = nullptr;
+#endif
+	};
+}
+
+#endif // TT_H
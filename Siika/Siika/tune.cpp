@@ -0,0 +1,307 @@
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <atomic>
+#include <cmath>
+#include <cctype>
+#include <algorithm>
+
+#include "tune.h"
+#include "evalparams.h"
+#include "position.h"
+#include "search.h"
+#include "eval.h"
+#include "pawns.h"
+#include "tools.h"
+
+namespace Chess {
+
+	namespace {
+		bool parse_result(const std::string& token, double& result) {
+			std::string t = token;
+			t.erase(std::remove_if(t.begin(), t.end(), [](char c) { return c == '"' || c == ';' || c == '[' || c == ']'; }), t.end());
+
+			if (t == "1-0" || t == "1.0" || t == "1") { result = 1.0; }
+			else if (t == "0-1" || t == "0.0" || t == "0") { result = 0.0; }
+			else if (t == "1/2-1/2" || t == "0.5") { result = 0.5; }
+			else { return false; }
+			return true;
+		}
+
+		bool is_number(const std::string& token) {
+			return !token.empty() && std::all_of(token.begin(), token.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)); });
+		}
+
+		double sigmoid(double k, double value) {
+			return 1.0 / (1.0 + std::pow(10.0, -k * value / 400.0));
+		}
+	}
+
+	Tune::Pool::Pool(int threads) : thread_count_(std::max(1, threads)) {
+		for (int t = 0; t < thread_count_; t++) {
+			threads_.emplace_back(&Pool::work, this, t);
+		}
+	}
+
+	Tune::Pool::~Pool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stopping_ = true;
+		}
+		start_.notify_all();
+		for (auto& thread : threads_) {
+			thread.join();
+		}
+	}
+
+	int Tune::Pool::size() const {
+		return thread_count_;
+	}
+
+	void Tune::Pool::run(size_t count, const Job& job) {
+		std::unique_lock<std::mutex> lock(mutex_);
+		job_ = &job;
+		count_ = count;
+		pending_ = thread_count_;
+		generation_++;
+		start_.notify_all();
+		done_.wait(lock, [this]() { return pending_ == 0; });
+		job_ = nullptr;
+	}
+
+	void Tune::Pool::work(int thread) {
+		u64 seen = 0;
+		std::unique_lock<std::mutex> lock(mutex_);
+		while (true) {
+			start_.wait(lock, [this, seen]() { return stopping_ || generation_ != seen; });
+			if (stopping_) {
+				return;
+			}
+			seen = generation_;
+			const Job& job = *job_;
+			size_t chunk = (count_ + thread_count_ - 1) / thread_count_;
+			size_t begin = std::min(count_, thread * chunk);
+			size_t end = std::min(count_, begin + chunk);
+
+			lock.unlock();
+			job(thread, begin, end);
+			lock.lock();
+
+			if (--pending_ == 0) {
+				done_.notify_all();
+			}
+		}
+	}
+
+	// Lines are read first, then quieted on the threads of the pool
+	bool Tune::load(const std::string& file, std::vector<Sample>& samples, Pool& pool) {
+		std::ifstream in(file);
+		if (!in) {
+			std::cout << "Could not open " << file << "\n";
+			return false;
+		}
+
+		std::vector<std::string> fens;
+		std::vector<double> results;
+		std::string line;
+		size_t skipped = 0;
+
+		while (std::getline(in, line)) {
+			std::istringstream ss(line);
+			std::vector<std::string> tokens;
+			std::string token;
+			while (ss >> token) {
+				tokens.push_back(token);
+			}
+			if (tokens.size() < 5) {
+				skipped++;
+				continue;
+			}
+
+			// board, turn, castling and en passant, then the clocks if given
+			size_t n = 4;
+			while (n < 6 && n < tokens.size() && is_number(tokens[n])) {
+				n++;
+			}
+			std::string fen;
+			for (size_t i = 0; i < n; i++) {
+				fen += tokens[i] + " ";
+			}
+
+			double result = -1.0;
+			for (size_t i = n; i < tokens.size(); i++) {
+				if (parse_result(tokens[i], result)) {
+					break;
+				}
+			}
+			if (result < 0.0) {
+				skipped++;
+				continue;
+			}
+
+			fens.push_back(fen);
+			results.push_back(result);
+		}
+
+		std::vector<Sample> quieted(fens.size());
+		std::vector<char> packed(fens.size(), 0);
+		pool.run(fens.size(), [&](int, size_t begin, size_t end) {
+			std::atomic<bool> is_searching(true);
+			Search search(is_searching);
+			Position pos;
+			for (size_t i = begin; i < end; i++) {
+				pos.set(fens[i]);
+				search.quiet(pos);
+				packed[i] = pos.pack(quieted[i].pos);
+				quieted[i].result = results[i];
+			}
+		});
+		for (size_t i = 0; i < quieted.size(); i++) {
+			if (packed[i]) {
+				samples.push_back(quieted[i]);
+			}
+			else {
+				skipped++;
+			}
+		}
+
+		std::cout << "Loaded " << samples.size() << " positions, skipped " << skipped << " lines\n";
+		return !samples.empty();
+	}
+
+	// The pawn tables of the threads are emptied first, as they hold scores
+	// of the parameters of the last call
+	double Tune::error(const std::vector<Sample>& samples, double k, Pool& pool) {
+		std::vector<double> sums(pool.size(), 0.0);
+		pool.run(samples.size(), [&](int thread, size_t begin, size_t end) {
+			Pawns::clear();
+			Position pos;
+			double sum = 0.0;
+			for (size_t i = begin; i < end; i++) {
+				pos.set(samples[i].pos);
+				Value value = evaluate(pos);
+				if (pos.turn() == BLACK) {
+					value = -value;
+				}
+				double diff = samples[i].result - sigmoid(k, value);
+				sum += diff * diff;
+			}
+			sums[thread] = sum;
+		});
+
+		double sum = 0.0;
+		for (const auto s : sums) {
+			sum += s;
+		}
+		return sum / samples.size();
+	}
+
+	// Narrows the step around the best k until it is below 0.001
+	double Tune::fit_k(const std::vector<Sample>& samples, Pool& pool) {
+		double best_k = 1.0;
+		double best_error = error(samples, best_k, pool);
+
+		for (double step = 0.5; step >= 0.001; step /= 2) {
+			bool improved = true;
+			while (improved) {
+				improved = false;
+				for (const auto k : { best_k - step, best_k + step }) {
+					if (k <= 0.0) {
+						continue;
+					}
+					double e = error(samples, k, pool);
+					if (e < best_error) {
+						best_error = e;
+						best_k = k;
+						improved = true;
+					}
+				}
+			}
+		}
+
+		std::cout << "K " << best_k << " error " << std::setprecision(8) << best_error << "\n";
+		return best_k;
+	}
+
+	void Tune::tune(const std::vector<Sample>& samples, double k, int iterations, Pool& pool) {
+		std::vector<i32*> params;
+		std::vector<std::string> names;
+		eval_params.for_each([&](const std::string& name, i32& value) {
+			params.push_back(&value);
+			names.push_back(name);
+		}, true);
+
+		double best_error = error(samples, k, pool);
+
+		for (int iteration = 1; iteration <= iterations; iteration++) {
+			bool improved = false;
+
+			for (size_t i = 0; i < params.size(); i++) {
+				i32& value = *params[i];
+				for (const auto delta : { 1, -1 }) {
+					value += delta;
+					double e = error(samples, k, pool);
+					if (e < best_error) {
+						best_error = e;
+						improved = true;
+						std::cout << names[i] << " " << value << "\n";
+						break;
+					}
+					value -= delta;
+				}
+			}
+
+			std::cout << "iteration " << iteration << " error " << std::setprecision(8) << best_error << "\n";
+			if (!improved) {
+				break;
+			}
+		}
+	}
+
+	bool Tune::write_header(const std::string& file) {
+		std::ofstream out(file);
+		if (!out) {
+			std::cout << "Could not write " << file << "\n";
+			return false;
+		}
+
+		out << "#pragma once\n\n";
+		out << "#ifndef TUNED_H\n#define TUNED_H\n\n";
+		out << "#include \"util.h\"\n\n";
+		out << "// Written by 'Siika tune', in the order of EvalParams::for_each\n\n";
+		out << "namespace Chess {\n\n";
+		out << "\tconstexpr i32 TUNED_PARAMS[] = {\n";
+		eval_params.for_each([&out](const std::string& name, i32& value) {
+			out << "\t\t" << value << ", // " << name << "\n";
+		});
+		out << "\t};\n}\n\n";
+		out << "#endif // TUNED_H\n";
+		return true;
+	}
+
+	int Tune::run(const std::vector<std::string>& args) {
+		std::string out = args.size() > 1 ? args[1] : "tuned.h";
+		int iterations = 100;
+		int threads = std::max(1u, std::thread::hardware_concurrency());
+		if (args.empty() || (args.size() > 2 && !Tools::parse_integer("iterations", args[2], 1, std::numeric_limits<int>::max(), iterations))
+			|| (args.size() > 3 && !Tools::parse_integer("threads", args[3], 1, Tools::MAX_THREADS, threads))) {
+			std::cout << "usage: Siika tune <file> [out.h] [iterations] [threads]\n";
+			return 1;
+		}
+
+		// The cache would return values of earlier parameters
+		EvalCache::set_size(0);
+
+		Pool pool(threads);
+		std::vector<Sample> samples;
+		if (!load(args[0], samples, pool)) {
+			return 1;
+		}
+
+		double k = fit_k(samples, pool);
+		tune(samples, k, iterations, pool);
+		return write_header(out) ? 0 : 1;
+	}
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#ifndef TUNE_H
+#define TUNE_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "chess.h"
+#include "position.h"
+
+namespace Chess {
+
+	// Texel tuning of EvalParams. Positions are read one per line as a FEN
+	// followed by the game result, either "1-0", "0-1", "1/2-1/2" or
+	// [1.0], [0.0], [0.5], and are quieted with a quiescence search
+	// before tuning.
+	namespace Tune {
+		struct Sample {
+			PackedPosition pos;
+			double result; // for white
+		};
+
+		// Threads kept for the whole run, so that each error is computed
+		// without starting any
+		class Pool {
+		public:
+			typedef std::function<void(int thread, size_t begin, size_t end)> Job;
+
+			explicit Pool(int threads);
+			~Pool();
+			Pool(const Pool&) = delete;
+			Pool& operator=(const Pool&) = delete;
+
+			// Calls job on every thread with its share of [0, count) and
+			// returns when all are done
+			void run(size_t count, const Job& job);
+			int size() const;
+
+		private:
+			void work(int thread);
+
+			int thread_count_;
+			std::vector<std::thread> threads_;
+			std::mutex mutex_;
+			std::condition_variable start_;
+			std::condition_variable done_;
+			const Job* job_ = nullptr;
+			size_t count_ = 0;
+			u64 generation_ = 0;
+			int pending_ = 0;
+			bool stopping_ = false;
+		};
+
+		bool load(const std::string& file, std::vector<Sample>& samples, Pool& pool);
+
+		// Mean squared error of the evaluation, mapped through the sigmoid
+		double error(const std::vector<Sample>& samples, double k, Pool& pool);
+		double fit_k(const std::vector<Sample>& samples, Pool& pool);
+
+		// Local search over the eval_params that the evaluation reads,
+		// until no step improves the error
+		void tune(const std::vector<Sample>& samples, double k, int iterations, Pool& pool);
+
+		bool write_header(const std::string& file);
+
+		// Siika tune <file> [out.h] [iterations] [threads]
+		int run(const std::vector<std::string>& args);
+	}
+}
+
+#endif // TUNE_H
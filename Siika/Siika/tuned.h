@@ -0,0 +1,68 @@
+#pragma once
+
+#ifndef TUNED_H
+#define TUNED_H
+
+#include "util.h"
+
+// Written by 'Siika tune', in the order of EvalParams::for_each
+
+namespace Chess {
+
+	constexpr i32 TUNED_PARAMS[] = {
+		0, // passed[0].mg
+		0, // passed[0].eg
+		5, // passed[1].mg
+		10, // passed[1].eg
+		10, // passed[2].mg
+		20, // passed[2].eg
+		15, // passed[3].mg
+		35, // passed[3].eg
+		25, // passed[4].mg
+		55, // passed[4].eg
+		40, // passed[5].mg
+		85, // passed[5].eg
+		60, // passed[6].mg
+		120, // passed[6].eg
+		0, // passed[7].mg
+		0, // passed[7].eg
+		10, // isolated.mg
+		15, // isolated.eg
+		10, // doubled.mg
+		20, // doubled.eg
+		8, // backward.mg
+		10, // backward.eg
+		15, // shelter[0].mg
+		0, // shelter[0].eg
+		8, // shelter[1].mg
+		0, // shelter[1].eg
+		0, // shelter[2].mg
+		0, // shelter[2].eg
+		15, // open_file.mg
+		0, // open_file.eg
+		0, // mobility[0].mg
+		0, // mobility[0].eg
+		0, // mobility[1].mg
+		0, // mobility[1].eg
+		4, // mobility[2].mg
+		4, // mobility[2].eg
+		5, // mobility[3].mg
+		5, // mobility[3].eg
+		2, // mobility[4].mg
+		4, // mobility[4].eg
+		1, // mobility[5].mg
+		2, // mobility[5].eg
+		0, // mobility[6].mg
+		0, // mobility[6].eg
+		0, // king_attack_units[0]
+		0, // king_attack_units[1]
+		2, // king_attack_units[2]
+		2, // king_attack_units[3]
+		3, // king_attack_units[4]
+		5, // king_attack_units[5]
+		0, // king_attack_units[6]
+		400, // king_danger_max
+	};
+}
+
+#endif // TUNED_H
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <sstream>
 #include <string>
 #include <iostream>
@@ -7,22 +8,56 @@
 
 #include "uci.h"
 #include "debug.h"
+#include "nnue.h"
+#include "pawns.h"
+#include "tablebase.h"
 
 namespace Chess {
 
-	u64 UCI::nodes = 0;
-	u32 UCI::self_depth = 0;
-
-	std::atomic<bool> UCI::is_searching(false);
-	std::thread UCI::search_thread;
+	Book UCI::book;
+	ResultCache UCI::results;
+	TranspositionTable UCI::tt;
 	bool UCI::is_initialized = initialize();
-	bool UCI::is_running = false;
 
+	UCI::UCI(std::ostream& out, const Launcher& launch, size_t cache_limit_mb)
+		: output(out), launcher(launch), cache_limit_mb(cache_limit_mb) {
+		if (is_session()) {
+			eval_cache.reset(new EvalCache(std::min<size_t>(4, cache_limit_mb)));
+		}
+	}
+
+	UCI::~UCI() {
+		stop_searching();
+	}
+
+	size_t UCI::search_bytes() {
+		size_t bytes = Search::MEMORY_BYTES + Pawns::TABLE_SIZE * sizeof(Pawns::Entry);
+		if (NNUE::is_loaded()) {
+			bytes += MAX_PLYS * sizeof(NNUE::Accumulator);
+		}
+		return bytes;
+	}
 
 	bool UCI::initialize() {
 		return true;
 	}
 
+	bool UCI::open_book(const std::string& file) {
+		return book.open(file);
+	}
+
+	bool UCI::open_results(const std::string& file) {
+		return results.open(file);
+	}
+
+	bool UCI::set_hash(size_t size_mb, const std::string& shared) {
+		return shared.empty() ? tt.resize(size_mb) : tt.attach(shared, size_mb);
+	}
+
+	bool UCI::is_session() const {
+		return cache_limit_mb > 0;
+	}
+
 	void UCI::quit() {
 		is_running = false;
 		stop_searching();
@@ -33,17 +68,155 @@ namespace Chess {
 	}
 
 	void UCI::uci() {
-		std::cout << "id author " << AUTHOR << "\n";
-		std::cout << "id name " << ENGINE << " " << MAJOR_VERSION << "." << MINOR_VERSION << "\n";
-		std::cout << "uciok\n";
+		output << "id author " << AUTHOR << "\n";
+		output << "id name " << ENGINE << " " << MAJOR_VERSION << "." << MINOR_VERSION << "\n";
+		if (is_session()) {
+			output << "option name EvalCache type spin default " << std::min<size_t>(4, cache_limit_mb)
+				<< " min 0 max " << cache_limit_mb << "\n";
+			output << "option name OwnBook type check default false\n";
+		}
+		else {
+			output << "option name EvalFile type string default <empty>\n";
+			output << "option name Hash type spin default " << DEFAULT_HASH_MB << " min 1 max " << MAX_HASH_MB << "\n";
+			output << "option name SharedHash type string default <empty>\n";
+			output << "option name EvalCache type spin default 4 min 0 max 1024\n";
+			output << "option name TablebasePath type string default <empty>\n";
+			output << "option name OwnBook type check default false\n";
+			output << "option name BookFile type string default <empty>\n";
+			output << "option name ResultCache type string default <empty>\n";
+		}
+		output << "uciok" << std::endl;
 	}
 
 	void UCI::isready() {
-		std::cout << "readyok\n";
+		output << "readyok" << std::endl;
 	}
 
+	// A table shared with others is not theirs to clear
 	void UCI::ucinewgame() {
+		game_parameters = PositionParameters();
+		game.set_default();
+		game_moves.clear();
+		if (!is_session() && !tt.is_shared()) {
+			tt.clear();
+		}
+	}
+
+	// The tables a session shares are set when the server starts
+	void UCI::setoption(std::istringstream& ss) {
+		std::string token, name, value;
+
+		ss >> token;
+		while (ss >> token && token != "value") {
+			name += (name.empty() ? "" : " ") + token;
+		}
+		std::getline(ss >> std::ws, value);
+
+		if (is_session() && (name == "EvalFile" || name == "BookFile" || name == "TablebasePath" || name == "ResultCache"
+			|| name == "Hash" || name == "SharedHash")) {
+			output << "info string " << name << " is set by the server" << std::endl;
+		}
+		else if (name == "EvalFile") {
+			std::lock_guard<std::mutex> lock(search_mutex);
+			if (search_running) {
+				output << "info string EvalFile can not change during a search" << std::endl;
+			}
+			else if (NNUE::load(value)) {
+				output << "info string loaded network " << value << "\n";
+			}
+			else {
+				output << "info string failed to load network " << value << "\n";
+			}
+		}
+		else if (name == "Hash") {
+			size_t size_mb;
+			std::lock_guard<std::mutex> lock(search_mutex);
+			if (!parse_spin(value, 1, MAX_HASH_MB, size_mb)) {
+				output << "info string invalid Hash " << value << "\n";
+			}
+			else if (search_running) {
+				output << "info string Hash can not change during a search" << std::endl;
+			}
+			else if (tt.is_shared()) {
+				output << "info string the shared table keeps its size of " << tt.size_mb() << " MB\n";
+			}
+			else if (!tt.resize(size_mb)) {
+				output << "info string failed to allocate " << value << " MB\n";
+			}
+		}
+		else if (name == "SharedHash") {
+			std::lock_guard<std::mutex> lock(search_mutex);
+			if (search_running) {
+				output << "info string SharedHash can not change during a search" << std::endl;
+			}
+			else if (value.empty() || value == "<empty>") {
+				tt.detach();
+				output << "info string detached from the shared table\n";
+			}
+			else if (tt.attach(value, tt.size_mb())) {
+				output << "info string attached to shared table " << value << " of " << tt.size_mb() << " MB\n";
+			}
+			else {
+				output << "info string failed to attach to shared table " << value << "\n";
+			}
+		}
+		else if (name == "EvalCache") {
+			size_t size_mb;
+			if (!parse_spin(value, 0, is_session() ? cache_limit_mb : 1024, size_mb)) {
+				output << "info string invalid EvalCache " << value << std::endl;
+			}
+			else if (!is_session()) {
+				EvalCache::set_size(size_mb);
+			}
+			else {
+				std::lock_guard<std::mutex> lock(search_mutex);
+				if (search_running) {
+					output << "info string EvalCache can not change during a search" << std::endl;
+				}
+				else {
+					eval_cache.reset(new EvalCache(size_mb));
+				}
+			}
+		}
+		else if (name == "OwnBook") {
+			own_book = value == "true";
+		}
+		else if (name == "BookFile") {
+			if (book.open(value)) {
+				output << "info string loaded book " << value << "\n";
+			}
+			else {
+				output << "info string failed to load book " << value << "\n";
+			}
+		}
+		else if (name == "ResultCache") {
+			if (results.open(value)) {
+				output << "info string loaded " << results.size() << " results from " << value << "\n";
+			}
+			else {
+				output << "info string failed to open result cache " << value << "\n";
+			}
+		}
+		else if (name == "TablebasePath") {
+			std::lock_guard<std::mutex> lock(search_mutex);
+			if (search_running) {
+				output << "info string TablebasePath can not change during a search" << std::endl;
+			}
+			else {
+				int found = Tablebases::init(value);
+				output << "info string found " << found << " tablebases, up to " << Tablebases::max_pieces() << " pieces\n";
+			}
+		}
+	}
 
+	bool UCI::parse_spin(const std::string& value, long long min, long long max, size_t& result) {
+		std::istringstream iss(value);
+		long long n;
+		if (!(iss >> n) || !(iss >> std::ws).eof() || n < min || n > max) {
+			return false;
+		}
+		result = static_cast<size_t>(n);
+		return true;
 	}
 
 	void UCI::parse_position(std::istringstream& ss, PositionParameters& pp) {
@@ -124,9 +297,8 @@ namespace Chess {
 		}
 	}
 
-	void UCI::debug_perft(std::istringstream& ss, PositionParameters& pp) {
-		Position pos;
-		make_position(pp, pos);
+	void UCI::debug_perft(std::istringstream& ss) {
+		Position pos = game;
 
 		int depth = 0;
 		ss >> depth;
@@ -134,69 +306,187 @@ namespace Chess {
 		auto start = std::chrono::high_resolution_clock::now();
 		for (const auto move : pos.legal_moves()) {
 			pos.do_move(move);
-			auto move_nodes = Debug::perft(pos, depth - 1);
-			std::cout << move_to_string(move) << ": " << move_nodes << "\n";
+			auto move_nodes = make_mode == COPY_MAKE ? Debug::perft<COPY_MAKE>(pos, depth - 1) : Debug::perft<MAKE_UNMAKE>(pos, depth - 1);
+			output << move_to_string(move) << ": " << move_nodes << "\n";
 			nodes += move_nodes;
 			pos.undo_move(move);
 		}
 		auto end = std::chrono::high_resolution_clock::now();
-		std::cout << "Leaf nodes: " << nodes << "\n";
+		output << "Leaf nodes: " << nodes << "\n";
 		auto secs = std::chrono::duration<double>(end - start).count();
 		auto nps = nodes / secs;
 		std::string prefix = "";
 		if (nps > 1e6) { prefix = "m"; nps /= 1e6; }
 		else if (nps > 1e3) { prefix = "k"; nps /= 1e3; }
-		std::cout << "Time elapsed: " << std::setprecision(2) << secs << " s (" << std::setprecision(3) << nps << " " << prefix << "nps)\n";
+		output << "Time elapsed: " << std::setprecision(2) << secs << " s (" << std::setprecision(3) << nps << " " << prefix << "nps)\n";
+	}
+
+	void UCI::debug_print() {
+		output << game;
+	}
+
+	void UCI::debug_see(std::istringstream& ss) {
+		Position pos = game;
+
+		std::string token;
+		ss >> token;
+		Move move = parse_move(pos, token);
+		if (move == NULLMOVE) {
+			output << "Illegal move: " << token << "\n";
+			return;
+		}
+		output << "see(" << move_to_string(move) << "): " << pos.see(move) << "\n";
 	}
 
-	void UCI::debug_print(PositionParameters& pp) {
-		Position pos;
-		make_position(pp, pos);
+	void UCI::debug_book() {
+		Position pos = game;
 
-		std::cout << pos;
+		output << "key: " << std::hex << Book::key(pos) << std::dec << "\n";
+		output << "book move: " << move_to_string(book.probe(pos)) << "\n";
 	}
 
+	// Input ends like quit, after the search has finished
 	void UCI::run() {
-		is_running = true;
-		PositionParameters p;
-		while (is_running) {
-			std::string input, token;
-			std::getline(std::cin, input);
-			std::istringstream iss(input);
-			iss >> token;
-
-			if (token == "quit") {
-				quit();
-			}
-			else if (token == "stop") {
-				stop();
-			}
-			else if (token == "uci") {
-				uci();
+		tt.resize(DEFAULT_HASH_MB);
+		UCI session(std::cout, [](const SearchJob& job) {
+			std::thread([job]() { job(std::cout); }).detach();
+		});
+		std::string input;
+		while (std::getline(std::cin, input)) {
+			if (!session.command(input)) {
+				return;
 			}
-			else if (token == "isready") {
-				isready();
-			}
-			else if (token == "go") {
-				if (!is_searching.load()) {
-					stop();
-					SearchParameters sp;
-					parse_go(iss, sp);
-					if (!is_searching.load()) {
-						search_thread = std::thread(search, std::ref(p), std::ref(sp));
-					}
-				}
-			}
-			else if (token == "position") {
-				parse_position(iss, p);
-			}
-			// debug stuff
-			else if (token == "perft") {
-				debug_perft(iss, p);
+		}
+		session.wait();
+	}
+
+	bool UCI::command(const std::string& line) {
+		std::istringstream iss(line);
+		std::string token;
+		iss >> token;
+
+		if (token == "quit") {
+			quit();
+		}
+		else if (token == "stop") {
+			stop();
+		}
+		else if (token == "uci") {
+			uci();
+		}
+		else if (token == "isready") {
+			isready();
+		}
+		else if (token == "go") {
+			go(iss);
+		}
+		else if (token == "position") {
+			PositionParameters p;
+			parse_position(iss, p);
+			make_position(p);
+		}
+		else if (token == "ucinewgame") {
+			ucinewgame();
+		}
+		else if (token == "setoption") {
+			setoption(iss);
+		}
+		// the debug commands print to the console and may take long
+		else if (!is_session()) {
+			debug_command(token, iss);
+		}
+		return is_running;
+	}
+
+	void UCI::go(std::istringstream& ss) {
+		if (!is_searching.load()) {
+			stop();
+			SearchParameters sp;
+			parse_go(ss, sp);
+			if ((own_book && play_book_move()) || play_cached_result(sp)) {
+				return;
 			}
-			else if (token == "d") {
-				debug_print(p);
+			is_searching = true;
+			{
+				std::lock_guard<std::mutex> lock(search_mutex);
+				search_running = true;
 			}
+			Position pos = game;
+			launcher([this, pos, sp](std::ostream& out) { search(pos, sp, out); });
+		}
+	}
+
+	void UCI::debug_command(const std::string& token, std::istringstream& iss) {
+		if (token == "perft") {
+			debug_perft(iss);
+		}
+		else if (token == "d") {
+			debug_print();
+		}
+		else if (token == "perftsuite") {
+			std::string file = "perftsuite.epd";
+			int depth = MAX_PLYS;
+			iss >> file >> depth;
+			Debug::perft_suite(file, depth, make_mode);
+		}
+		else if (token == "makemode") {
+			std::string mode;
+			iss >> mode;
+			if (mode == "copy") { make_mode = COPY_MAKE; }
+			else if (mode == "unmake") { make_mode = MAKE_UNMAKE; }
+			output << "make mode: " << (make_mode == COPY_MAKE ? "copy" : "unmake") << "\n";
+		}
+		else if (token == "book") {
+			debug_book();
+		}
+		else if (token == "booksuite") {
+			std::string file = "perftsuite.epd";
+			iss >> file;
+			Debug::book_suite(file);
+		}
+		else if (token == "sansuite") {
+			std::string file = "perftsuite.epd";
+			iss >> file;
+			Debug::san_suite(file);
+		}
+		else if (token == "packsuite") {
+			std::string file = "perftsuite.epd";
+			iss >> file;
+			Debug::pack_suite(file);
+		}
+		else if (token == "see") {
+			debug_see(iss);
+		}
+		else if (token == "seesuite") {
+			std::string file = "seesuite.epd";
+			iss >> file;
+			Debug::see_suite(file);
+		}
+		else if (token == "legalitysuite") {
+			std::string file = "perftsuite.epd";
+			int depth = 1;
+			iss >> file >> depth;
+			Debug::legality_suite(file, depth);
+		}
+		else if (token == "nnuesuite") {
+			std::string file = "perftsuite.epd";
+			int depth = 3;
+			iss >> file >> depth;
+			Debug::nnue_suite(file, depth);
+		}
+		else if (token == "evalsuite") {
+			std::string file = "perftsuite.epd";
+			int depth = 3;
+			iss >> file >> depth;
+			Debug::eval_suite(file, depth);
+		}
+		else if (token == "tbsuite") {
+			int count = 10000;
+			iss >> count;
+			Debug::tablebase_suite(count);
+		}
+		else if (token == "pages") {
+			LargePages::report(output);
 		}
 	}
 
@@ -227,213 +517,152 @@ namespace Chess {
 		return ss.str();
 	}
 
-	Move UCI::parse_move(Position& pos, const std::string& str) {
-		if (str.length() >= 4 || str != "0000") {
-			int from = make_square(str[1] - '1', str[0] - 'a');
-			int to = make_square(str[3] - '1', str[2] - 'a');
-
-			if (square_ok(from) && square_ok(to)) {
-				int flags = NORMAL_MOVE;
-				if (str.length() == 5) {
-					switch (str[4]) {
-					case 'q': flags = PROMOTION_QUEEN; break;
-					case 'r': flags = PROMOTION_ROOK; break;
-					case 'b': flags = PROMOTION_BISHOP; break;
-					case 'n': flags = PROMOTION_KNIGHT; break;
-					}
-				}
-				Move move = make_move(from, to, flags);
-
-				for (const auto candidate_move : pos.legal_moves()) {
-					if (is_promotion(candidate_move)) {
-						if (candidate_move == move) {
-							return candidate_move;
-						}
-					}
-					else if (move_from(candidate_move) == from && move_to(candidate_move) == to) {
-						return candidate_move;
-					}
-				}
-			}
-		}
-		return NULLMOVE;
-	}
-
-	void UCI::make_position(PositionParameters& pp, Position& pos) {
-		if (pp.from_startpos) {
-			pos.set_default();
-		}
-		else {
-			pos.set(pp.fen);
+	// The flags follow from the board, and the move is checked without
+	// generating the legal moves
+	Move UCI::parse_move(const Position& pos, const std::string& str) {
+		if (str.length() < 4 || str.length() > 5
+			|| str[0] < 'a' || str[0] > 'h' || str[1] < '1' || str[1] > '8'
+			|| str[2] < 'a' || str[2] > 'h' || str[3] < '1' || str[3] > '8') {
+			return NULLMOVE;
 		}
-
-		for (const auto str : pp.moves) {
-			auto move = parse_move(pos, str);
-			if (move != NULLMOVE) {
-				pos.do_move(move);
+		int from = make_square(str[1] - '1', str[0] - 'a');
+		int to = make_square(str[3] - '1', str[2] - 'a');
+		int type = piece_type(pos.piece_on(from));
+
+		// a promotion letter is ignored unless a pawn reaches the last rank
+		int flags = NORMAL_MOVE;
+		if (type == PAWN && (square_rank(to) == RANK_1 || square_rank(to) == RANK_8)) {
+			switch (str.length() == 5 ? str[4] : ' ') {
+			case 'q': flags = PROMOTION_QUEEN; break;
+			case 'r': flags = PROMOTION_ROOK; break;
+			case 'b': flags = PROMOTION_BISHOP; break;
+			case 'n': flags = PROMOTION_KNIGHT; break;
+			default: return NULLMOVE;
 			}
 		}
-	}
-
-	void UCI::stop_searching() {
-		is_searching = false;
-		if (search_thread.joinable()) {
-			search_thread.join();
+		else if (type == KING && to == from + 2) {
+			flags = KINGSIDE_CASTLE;
 		}
-	}
-
-	
-
-	Value UCI::negamax_ab(Position& pos, Value alpha, Value beta, int depth, int max_depth, Move& bestmove, bool is_root) {
-		
-		if (depth > self_depth) {
-			self_depth = depth;
+		else if (type == KING && to == from - 2) {
+			flags = QUEENSIDE_CASTLE;
 		}
-
-		if (depth >= max_depth) {
-			return quiescence_search(pos, alpha, beta, depth + 1);
+		else if (type == PAWN && to == pos.en_passant_square() && square_file(to) != square_file(from)) {
+			flags = EN_PASSANT_CAPTURE;
+		}
+		else if (type == PAWN && (to == from + 16 || to == from - 16)) {
+			flags = PAWN_DOUBLE_PUSH;
 		}
-		nodes++;
-
-		auto moves = pos.legal_moves();
-		sort_moves(pos, moves);
 
-		for (const auto move : moves) {
-			pos.do_move(move);
-			Value value = -negamax_ab(pos, -beta, -alpha, depth + 1, max_depth, bestmove, false);
-			pos.undo_move(move);
+		Move move = make_move(from, to, flags);
+		return pos.is_pseudo_legal(move) && pos.is_legal(move) ? move : NULLMOVE;
+	}
 
-			if (value >= beta) {
-				return beta;
-			}
-			if (value > alpha) {
-				alpha = value;
-				if (is_root) {
-					bestmove = move;
-				}
+	// Only the moves added since the last position command are played when
+	// the new one extends it, so a long game is not replayed for every move
+	void UCI::make_position(const PositionParameters& pp) {
+		bool extends = pp.from_startpos == game_parameters.from_startpos && pp.fen == game_parameters.fen
+			&& pp.moves.size() >= game_parameters.moves.size()
+			&& std::equal(game_parameters.moves.begin(), game_parameters.moves.end(), pp.moves.begin());
+		if (!extends) {
+			if (pp.from_startpos) {
+				game.set_default();
 			}
-			if (!is_searching.load()) {
-				return alpha;
+			else {
+				game.set(pp.fen);
 			}
+			game_parameters = pp;
+			game_parameters.moves.clear();
+			game_moves.clear();
 		}
 
-		if (moves.empty()) {
-			if (pos.is_in_check()) {
-				return mate(depth);
-			}
-			else {
-				return STALEMATE;
+		for (size_t i = game_parameters.moves.size(); i < pp.moves.size(); i++) {
+			Move move = parse_move(game, pp.moves[i]);
+			if (move != NULLMOVE) {
+				game.do_move(move);
+				game_moves.push_back(move);
+
+				// The position keeps MAX_PLYS plies. Only those since the
+				// last irreversible move matter for repetitions, so the game
+				// is set again from the position before them and they are
+				// played on it.
+				if (game_moves.size() >= MAX_PLYS / 2) {
+					size_t keep = std::min<size_t>(game.halfmove(), MAX_PLYS / 4);
+					size_t first = game_moves.size() - keep;
+					for (size_t j = game_moves.size(); j-- > first;) {
+						game.undo_move(game_moves[j]);
+					}
+					game.set(game.fen());
+					for (size_t j = first; j < game_moves.size(); j++) {
+						game.do_move(game_moves[j]);
+					}
+					game_moves.erase(game_moves.begin(), game_moves.begin() + first);
+				}
 			}
+			game_parameters.moves.push_back(pp.moves[i]);
 		}
-		
+	}
 
-		return alpha;
+	void UCI::stop_searching() {
+		is_searching = false;
+		wait();
 	}
 
-	Value UCI::quiescence_search(Position& pos, Value alpha, Value beta, int depth) {
+	void UCI::wait() {
+		std::unique_lock<std::mutex> lock(search_mutex);
+		search_done.wait(lock, [this]() { return !search_running; });
+	}
 
-		if (depth > self_depth) {
-			self_depth = depth;
-		}
-		Value standing_pat = evaluate(pos);
+	// Book moves are played at once, without starting a search
+	bool UCI::play_book_move() {
+		Position pos = game;
 
-		if (standing_pat >= beta) {
-			return beta;
-		}
-		if (alpha < standing_pat) {
-			alpha = standing_pat;
+		Move move = book.probe(pos);
+		if (move == NULLMOVE) {
+			return false;
 		}
+		output << "info string book move" << std::endl;
+		output << "bestmove " << move_to_string(move) << std::endl;
+		return true;
+	}
 
-		auto in_check = pos.is_in_check();
-		auto moves = in_check ? pos.legal_moves() : pos.legal_moves(true);
-
-		sort_moves(pos, moves);
-
-		for (const auto move : moves) {
-			pos.do_move(move);
-			Value value = -quiescence_search(pos, -beta, -alpha, depth + 1);
-			pos.undo_move(move);
-
-			if (value >= beta) {
-				return beta;
-			}
-			if (value > alpha) {
-				alpha = value;
-			}
+	// Only a search limited by depth alone can be answered from the cache
+	bool UCI::play_cached_result(const SearchParameters& sp) {
+		if (!results.is_open() || sp.max_depth == MAX_SEARCH_DEPTH || sp.wtime_ms != 0 || sp.btime_ms != 0
+			|| sp.max_nodes != REALLY_BIG_NUMBER || sp.max_search_time_ms != REALLY_BIG_NUMBER) {
+			return false;
 		}
 
-		if (moves.empty()) {
-			if (in_check) {
-				return mate(depth);
-			}
+		SearchResult result;
+		if (!results.probe(game, sp.max_depth, result)) {
+			return false;
 		}
-		else {
-			nodes++;
-		}
-
-		return alpha;
+		Search::print(output, result);
+		output << "info string cached result" << std::endl;
+		output << "bestmove " << move_to_string(result.bestmove) << std::endl;
+		return true;
 	}
 
-	void UCI::search(PositionParameters& pp, SearchParameters& sp) {
-		Position pos;
-		make_position(pp, pos);
-
-		constexpr int moves_to_go = 28;
-		auto player_time_usecs = pos.turn() == WHITE ? sp.wtime_ms * 1000 : sp.btime_ms * 1000;
-		auto allocated_time_usecs = (player_time_usecs / moves_to_go);
-		Move bestmove = NULLMOVE;
-		is_searching = true;
-		nodes = 0;
-
-
-		
-		std::cout << "(time allocated: " << (double)(allocated_time_usecs / 1000000.0) << " s)" << std::endl;
-		Timer search;
-
-		
-		
-		constexpr double ad_hoc_ratio = 12.0;
-		for (int i =1; i <= sp.max_depth; i++) {
-			self_depth = 0;
-
-			u64 node_count = nodes;
-
-			Timer depth_timer;
-			Value val = negamax_ab(pos, VALUE_MIN, VALUE_MAX, 0, i, bestmove);
-			auto depth_time = depth_timer.get_elapsed_microseconds();
-
-			auto predicted_time = (Timer::Microseconds)(ad_hoc_ratio * depth_time);
-
-			auto nodes_searched = nodes - node_count;
-			auto nps = 1000000.0 * (double)(nodes_searched) / depth_time;
-
-			std::cout << "info depth " << i << " ";
-			std::cout << "seldepth " << self_depth << " ";
-			std::cout << "nodes " << nodes_searched << " nps " << (u64)nps << " ";
-			if (is_mate(val)) {
-				int n = plies_till_mate(val);
-				std::cout << "score mate " << ((n+1)/2);
-			}
-			else {
-				std::cout << "score cp " << val;
-			}
-
-			std::cout << " pv " << move_to_string(bestmove);
-			
-			std::cout << std::endl;
+	// The session may be gone once search_running is cleared, so that is
+	// the last thing done
+	void UCI::search(Position pos, SearchParameters sp, std::ostream& out) {
+		std::vector<NNUE::Accumulator> accumulators;
+		if (NNUE::is_loaded()) {
+			accumulators.resize(MAX_PLYS);
+			pos.attach(accumulators.data());
+		}
 
-			if (!is_searching.load() || search.get_elapsed_microseconds() > (allocated_time_usecs)) {
-				break;
-			}
-			if ((search.get_elapsed_microseconds() + predicted_time) > (allocated_time_usecs + allocated_time_usecs * 0.3)) {
-				std::cout << "(Predicted time " << (predicted_time / 1000000.0) << " exceeds allocated time " << (allocated_time_usecs / 1000000.0) << ")\n";
-				break;
-			}
+		EvalCache::set_local(eval_cache.get());
+		Search search(is_searching, make_mode, &tt);
+		SearchResult result = search.think(pos, sp, out);
+		EvalCache::set_local(nullptr);
+		if (results.is_open() && !result.tablebase_hit) {
+			results.store(pos, result);
 		}
-		
-		std::cout << "bestmove " << move_to_string(bestmove) << std::endl;
-		std::cout << "(time: " << (double)(search.get_elapsed_microseconds() / 1000000.0) << " s)" << std::endl;
 		is_searching = false;
+
+		std::lock_guard<std::mutex> lock(search_mutex);
+		search_running = false;
+		search_done.notify_all();
 	}
 
 }
\ No newline at end of file
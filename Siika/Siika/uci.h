@@ -9,23 +9,64 @@
 #include <map>
 #include <functional>
 #include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <iostream>
 
 #include "chess.h"
 #include "position.h"
 #include "eval.h"
+#include "search.h"
+#include "book.h"
+#include "resultcache.h"
+#include "tt.h"
 
 namespace Chess {
 
-	constexpr u32 MAX_SEARCH_DEPTH = MAX_PLYS - 1;
-	constexpr u64 REALLY_BIG_NUMBER = UINT64_MAX;
-
+	// One UCI session. The console has one, the server one for each
+	// connection. Searches run wherever the launcher puts them, writing
+	// to the stream it gives.
 	class UCI {
 	public:
+		typedef std::function<void(std::ostream& out)> SearchJob;
+		typedef std::function<void(const SearchJob& job)> Launcher;
+
+		static constexpr size_t DEFAULT_HASH_MB = 16;
+		static constexpr size_t MAX_HASH_MB = 65536;
+
 		static void run();
 
+		// A session of the server when cache_limit_mb is given. It shares
+		// the network, the tablebases and the book of the process and has
+		// an evaluation cache of its own within the limit.
+		UCI(std::ostream& out, const Launcher& launch, size_t cache_limit_mb = 0);
+		~UCI();
+		UCI(const UCI&) = delete;
+		UCI& operator=(const UCI&) = delete;
+
+		// Handles one line of input, false after quit
+		bool command(const std::string& line);
+
+		// Waits until the search, if any, has finished
+		void wait();
 
+		// Memory of a search besides the evaluation cache: the pawn table of
+		// its thread, the principal variation table and the accumulators
+		static size_t search_bytes();
+
+		// The book and the result cache of all sessions
+		static bool open_book(const std::string& file);
+		static bool open_results(const std::string& file);
+
+		// The transposition table of all sessions, private or attached to
+		// the shared table of that name
+		static bool set_hash(size_t size_mb, const std::string& shared = "");
+
+		static std::string square_to_string(int square);
+		static std::string move_to_string(Move move);
+		static Move parse_move(const Position& pos, const std::string& str);
 
-		UCI() = delete;
 	private:
 		struct PositionParameters {
 			bool from_startpos = true;
@@ -33,51 +74,61 @@ namespace Chess {
 			std::vector<std::string> moves;
 		};
 
-		struct SearchParameters {
-			u64 wtime_ms = 0, btime_ms = 0;
-			u64 winc_ms = 0, binc_ms = 0;
-			u32 max_depth = MAX_SEARCH_DEPTH;
-			bool ponder = false;
-			u64 max_nodes = REALLY_BIG_NUMBER;
-			u64 max_search_time_ms = REALLY_BIG_NUMBER;
-			bool search_for_mate = false;
-			u32 search_for_mate_in_n = 0;
-			bool is_sudden_death = true;
-			u32 moves_to_go = 0;
-			std::vector<Move> searchmoves;
-		};
-
-		static u64 nodes;
-		static u32 self_depth;
-		static std::atomic<bool> is_searching;
-		static std::thread search_thread;
+		static Book book;
+		static ResultCache results;
+		static TranspositionTable tt;
 		static bool is_initialized;
-		static bool is_running;
-	public:
-	//private:
-		static bool initialize();
 
-		static std::string square_to_string(int square);
-		static std::string move_to_string(Move move);
-		static Move parse_move(Position& pos, const std::string& str);
-		static void make_position(PositionParameters& pp, Position& pos);
+		std::ostream& output;
+		Launcher launcher;
+		size_t cache_limit_mb;
+		std::unique_ptr<EvalCache> eval_cache;
 
-		static void stop_searching();
-		static void search(PositionParameters& pp, SearchParameters& sp);
-		static Value negamax_ab(Position& pos, Value alpha, Value beta, int depth, int max_depth, Move& bestmove, bool is_root = true);
-		static Value quiescence_search(Position& pos, Value alpha, Value beta, int depth);
+		int make_mode = MAKE_UNMAKE;
+		bool own_book = false;
+		std::atomic<bool> is_searching{ false };
+		bool is_running = true;
 
+		// Set from launching a search until its job returns
+		bool search_running = false;
+		std::mutex search_mutex;
+		std::condition_variable search_done;
 
-		static void quit();
-		static void stop();
-		static void uci();
-		static void isready();
-		static void ucinewgame();
-		static void parse_position(std::istringstream& ss, PositionParameters& pp);
-		static void parse_go(std::istringstream& ss, SearchParameters& sp);
+		// The game as of the last position command, and what it was set
+		// from. The moves are those played since the last time it was set.
+		Position game;
+		PositionParameters game_parameters;
+		std::vector<Move> game_moves;
+
+		static bool initialize();
 
-		static void debug_perft(std::istringstream& ss, PositionParameters& pp);
-		static void debug_print(PositionParameters& pp);
+		// A whole number of the option's range, false for anything else
+		static bool parse_spin(const std::string& value, long long min, long long max, size_t& result);
+
+		bool is_session() const;
+		void make_position(const PositionParameters& pp);
+
+		void stop_searching();
+		bool play_book_move();
+		bool play_cached_result(const SearchParameters& sp);
+		void search(Position pos, SearchParameters sp, std::ostream& out);
+
+
+		void quit();
+		void stop();
+		void uci();
+		void isready();
+		void go(std::istringstream& ss);
+		void ucinewgame();
+		void setoption(std::istringstream& ss);
+		void parse_position(std::istringstream& ss, PositionParameters& pp);
+		void parse_go(std::istringstream& ss, SearchParameters& sp);
+
+		void debug_command(const std::string& token, std::istringstream& ss);
+		void debug_perft(std::istringstream& ss);
+		void debug_print();
+		void debug_see(std::istringstream& ss);
+		void debug_book();
 
 	};
 
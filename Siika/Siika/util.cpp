@@ -1,4 +1,28 @@
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <new>
+#include <numeric>
+#include <sstream>
+#include <vector>
+
 #include "util.h"
+#include "tools.h"
+#include "uci.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace Chess {
 
@@ -41,4 +65,374 @@ namespace Chess {
 		start_ = std::chrono::high_resolution_clock::now();
 	}
 
+	// MappedFile
+	MappedFile::~MappedFile() {
+		close();
+	}
+
+#ifdef _WIN32
+	bool MappedFile::open(const std::string& path) {
+		close();
+		// others may go on appending to the file
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+
+		LARGE_INTEGER size;
+		HANDLE mapping = nullptr;
+		if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		}
+		if (!mapping) {
+			CloseHandle(file);
+			return false;
+		}
+
+		void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (!data) {
+			CloseHandle(mapping);
+			CloseHandle(file);
+			return false;
+		}
+
+		file_ = file;
+		mapping_ = mapping;
+		data_ = static_cast<const u8*>(data);
+		size_ = static_cast<size_t>(size.QuadPart);
+		return true;
+	}
+
+	void MappedFile::close() {
+		if (data_) {
+			UnmapViewOfFile(data_);
+			CloseHandle(mapping_);
+			CloseHandle(file_);
+		}
+		data_ = nullptr;
+		size_ = 0;
+		file_ = nullptr;
+		mapping_ = nullptr;
+	}
+
+	bool truncate_file(const std::string& path, u64 size) {
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+		LARGE_INTEGER end;
+		end.QuadPart = static_cast<LONGLONG>(size);
+		bool ok = SetFilePointerEx(file, end, nullptr, FILE_BEGIN) && SetEndOfFile(file);
+		CloseHandle(file);
+		return ok;
+	}
+#else
+	bool MappedFile::open(const std::string& path) {
+		close();
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+
+		struct stat st;
+		void* data = MAP_FAILED;
+		if (fstat(fd, &st) == 0 && st.st_size > 0) {
+			data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		}
+		// The mapping stays valid after the descriptor is closed
+		::close(fd);
+		if (data == MAP_FAILED) {
+			return false;
+		}
+
+		data_ = static_cast<const u8*>(data);
+		size_ = static_cast<size_t>(st.st_size);
+		return true;
+	}
+
+	void MappedFile::close() {
+		if (data_) {
+			munmap(const_cast<u8*>(data_), size_);
+		}
+		data_ = nullptr;
+		size_ = 0;
+	}
+
+	bool truncate_file(const std::string& path, u64 size) {
+		return ::truncate(path.c_str(), static_cast<off_t>(size)) == 0;
+	}
+#endif
+
+	// Large pages
+	namespace {
+		struct LargeAllocation {
+			size_t bytes;
+			LargePages::Mode mode;
+			const char* name;
+		};
+
+		struct LargeRegistry {
+			std::mutex mutex;
+			std::map<const void*, LargeAllocation> allocations;
+			bool enabled = true;
+		};
+
+		// Never destroyed, as static tables may be freed after it at exit
+		LargeRegistry& large_registry() {
+			static LargeRegistry* registry = new LargeRegistry;
+			return *registry;
+		}
+
+		size_t round_up(size_t bytes, size_t multiple) {
+			return (bytes + multiple - 1) / multiple * multiple;
+		}
+
+#ifdef _WIN32
+		// Large pages need the lock memory privilege, which the account
+		// may have but the process does not hold by default
+		bool enable_lock_memory() {
+			HANDLE token;
+			if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+				return false;
+			}
+			TOKEN_PRIVILEGES privileges;
+			privileges.PrivilegeCount = 1;
+			privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+			bool ok = LookupPrivilegeValueA(nullptr, "SeLockMemoryPrivilege", &privileges.Privileges[0].Luid)
+				&& AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr)
+				&& GetLastError() == ERROR_SUCCESS;
+			CloseHandle(token);
+			return ok;
+		}
+
+		void* map_large(size_t bytes, bool huge, LargePages::Mode& mode) {
+			static const bool lock_memory = enable_lock_memory();
+			SIZE_T large_page = GetLargePageMinimum();
+			if (huge && lock_memory && large_page && bytes % large_page == 0) {
+				void* memory = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+				if (memory) {
+					mode = LargePages::HUGE_PAGES;
+					return memory;
+				}
+			}
+			mode = LargePages::SMALL_PAGES;
+			return VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+		}
+
+		void unmap_large(void* memory, size_t) {
+			VirtualFree(memory, 0, MEM_RELEASE);
+		}
+#else
+		void* map_large(size_t bytes, bool huge, LargePages::Mode& mode) {
+#ifdef MAP_HUGETLB
+			// Only if huge pages have been reserved on the host
+			if (huge) {
+				void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+				if (memory != MAP_FAILED) {
+					mode = LargePages::HUGE_PAGES;
+					return memory;
+				}
+			}
+#endif
+			// Mapped with a page to spare, which is cut off so that the
+			// memory starts on a 2 MB boundary
+			size_t spare_bytes = bytes + LargePages::PAGE_BYTES;
+			void* spare = mmap(nullptr, spare_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (spare == MAP_FAILED) {
+				return nullptr;
+			}
+			u8* start = static_cast<u8*>(spare);
+			u8* memory = reinterpret_cast<u8*>(round_up(reinterpret_cast<uintptr_t>(start), LargePages::PAGE_BYTES));
+			if (memory != start) {
+				munmap(start, memory - start);
+			}
+			if (start + spare_bytes != memory + bytes) {
+				munmap(memory + bytes, start + spare_bytes - (memory + bytes));
+			}
+
+			mode = LargePages::SMALL_PAGES;
+#ifdef MADV_HUGEPAGE
+			if (huge && madvise(memory, bytes, MADV_HUGEPAGE) == 0) {
+				mode = LargePages::TRANSPARENT_HUGE_PAGES;
+			}
+#endif
+#ifdef MADV_NOHUGEPAGE
+			// Transparent huge pages may be on for all memory
+			if (!huge) {
+				madvise(memory, bytes, MADV_NOHUGEPAGE);
+			}
+#endif
+			return memory;
+		}
+
+		void unmap_large(void* memory, size_t bytes) {
+			munmap(memory, bytes);
+		}
+#endif
+
+#ifdef __linux__
+		// Memory of the mappings in [memory, memory + bytes) that is in huge
+		// pages, as the kernel may not have found any to give
+		u64 huge_page_kb(const void* memory, size_t bytes) {
+			uintptr_t first = reinterpret_cast<uintptr_t>(memory);
+			uintptr_t last = first + bytes;
+			std::ifstream smaps("/proc/self/smaps");
+			std::string line;
+			bool inside = false;
+			u64 kb = 0;
+			while (std::getline(smaps, line)) {
+				std::istringstream iss(line);
+				unsigned long long start, end;
+				char dash;
+				if (iss >> std::hex >> start >> dash >> end && dash == '-') {
+					inside = start < last && end > first;
+					continue;
+				}
+				std::string field = line.substr(0, line.find(':'));
+				if (inside && (field == "AnonHugePages" || field == "Private_Hugetlb" || field == "Shared_Hugetlb")) {
+					u64 value = 0;
+					std::istringstream(line.substr(field.size() + 1)) >> value;
+					kb += value;
+				}
+			}
+			return kb;
+		}
+#endif
+	}
+
+	void* LargePages::allocate(size_t bytes, const char* name) {
+		if (bytes < MIN_BYTES) {
+			return ::operator new(bytes);
+		}
+		LargeRegistry& registry = large_registry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		bytes = round_up(bytes, PAGE_BYTES);
+		Mode mode;
+		void* memory = map_large(bytes, registry.enabled, mode);
+		if (!memory) {
+			throw std::bad_alloc();
+		}
+		registry.allocations[memory] = { bytes, mode, name };
+		return memory;
+	}
+
+	void LargePages::deallocate(void* memory, size_t bytes) {
+		if (bytes < MIN_BYTES) {
+			::operator delete(memory);
+			return;
+		}
+		LargeRegistry& registry = large_registry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		auto it = registry.allocations.find(memory);
+		if (it != registry.allocations.end()) {
+			unmap_large(memory, it->second.bytes);
+			registry.allocations.erase(it);
+		}
+	}
+
+	void LargePages::set_enabled(bool enabled) {
+		LargeRegistry& registry = large_registry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		registry.enabled = enabled;
+	}
+
+	LargePages::Mode LargePages::mode(const void* memory) {
+		LargeRegistry& registry = large_registry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		auto it = registry.allocations.find(memory);
+		return it != registry.allocations.end() ? it->second.mode : SMALL_PAGES;
+	}
+
+	const char* LargePages::mode_name(Mode mode) {
+		switch (mode) {
+		case TRANSPARENT_HUGE_PAGES: return "transparent huge pages";
+		case HUGE_PAGES: return "huge pages";
+		default: return "normal pages";
+		}
+	}
+
+	void LargePages::report(std::ostream& out) {
+		LargeRegistry& registry = large_registry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		if (registry.allocations.empty()) {
+			out << "No large tables\n";
+		}
+		for (const auto& allocation : registry.allocations) {
+			out << allocation.second.name << ": " << allocation.second.bytes / 1024 << " KB, "
+				<< mode_name(allocation.second.mode);
+#ifdef __linux__
+			out << ", " << huge_page_kb(allocation.first, allocation.second.bytes) << " KB in huge pages";
+#endif
+			out << "\n";
+		}
+	}
+
+	int LargePages::bench(const std::vector<std::string>& args) {
+		size_t size_mb = 256;
+		u64 probes = 10000000;
+		bool ok = true;
+		for (size_t i = 0; ok && i < args.size(); i++) {
+			const std::string& name = args[i];
+			bool has_value = i + 1 < args.size();
+			if (name == "mb" && has_value) {
+				ok = Tools::parse_integer(name, args[++i], 1, UCI::MAX_HASH_MB, size_mb);
+			}
+			else if (name == "probes" && has_value) {
+				ok = Tools::parse_integer(name, args[++i], 1, Tools::MAX_ARGUMENT, probes);
+			}
+			else {
+				ok = false;
+			}
+		}
+		if (!ok) {
+			std::cerr << "usage: Siika pagebench [mb N] [probes N]\n";
+			return 1;
+		}
+
+		// One word per cache line, linked into a single random cycle so
+		// that each probe waits for the one before it
+		constexpr size_t STRIDE = 64 / sizeof(u64);
+		const size_t lines = size_mb * 1024 * 1024 / 64;
+		std::vector<u64> order(lines);
+		std::iota(order.begin(), order.end(), u64(0));
+		PRNG::seed_64(0x9E3779B97F4A7C15ull);
+		for (size_t i = lines - 1; i > 0; i--) {
+			std::swap(order[i], order[PRNG::get_64() % i]);
+		}
+
+		double small_ns = 0;
+		for (bool huge : { false, true }) {
+			set_enabled(huge);
+			std::vector<u64, LargePageAllocator<u64>> table(lines * STRIDE, 0, LargePageAllocator<u64>("page bench"));
+			for (size_t i = 0; i < lines; i++) {
+				table[order[i] * STRIDE] = order[(i + 1) % lines] * STRIDE;
+			}
+
+			Timer timer;
+			u64 at = 0;
+			for (u64 i = 0; i < probes; i++) {
+				at = table[at];
+			}
+			double ns = timer.get_elapsed_microseconds() * 1000.0 / probes;
+			if (at >= table.size()) {
+				set_enabled(true);
+				std::cerr << "The probes left the table\n";
+				return 1;
+			}
+
+			std::cout << std::left << std::setw(24) << mode_name(mode(table.data())) << std::right
+				<< std::fixed << std::setprecision(1) << ns << " ns per probe";
+#ifdef __linux__
+			std::cout << ", " << huge_page_kb(table.data(), table.size() * sizeof(u64)) / 1024 << " MB in huge pages";
+#endif
+			if (huge) {
+				std::cout << ", " << std::setprecision(2) << small_ns / ns << "x";
+			}
+			std::cout << "\n";
+			small_ns = ns;
+		}
+		set_enabled(true);
+		return 0;
+	}
+
 }
\ No newline at end of file
@@ -3,8 +3,12 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <cstddef>
 #include <cstdint>
 #include <chrono>
+#include <iosfwd>
+#include <string>
+#include <vector>
 
 namespace Chess {
 	typedef int8_t i8;
@@ -39,6 +43,93 @@ namespace Chess {
 	private:
 		std::chrono::time_point<std::chrono::high_resolution_clock> start_;
 	};
+
+	// Read-only memory mapping of a whole file
+	class MappedFile {
+	public:
+		MappedFile() = default;
+		~MappedFile();
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		bool open(const std::string& path);
+		void close();
+
+		const u8* data() const;
+		size_t size() const;
+
+	private:
+		const u8* data_ = nullptr;
+		size_t size_ = 0;
+#ifdef _WIN32
+		void* file_ = nullptr;
+		void* mapping_ = nullptr;
+#endif
+	};
+
+	// Cuts the file to size bytes, e.g. to drop a partly written record
+	bool truncate_file(const std::string& path, u64 size);
+
+	// Memory for the big tables. Allocations of at least MIN_BYTES are
+	// rounded up to and aligned on 2 MB and asked to be backed by huge
+	// pages, so that a random probe needs fewer TLB misses. Explicit huge
+	// pages are tried first, then transparent ones, and failing both the
+	// memory has normal pages. Smaller allocations come from the heap.
+	namespace LargePages {
+		enum Mode { SMALL_PAGES, TRANSPARENT_HUGE_PAGES, HUGE_PAGES };
+
+		constexpr size_t PAGE_BYTES = 2 * 1024 * 1024;
+		constexpr size_t MIN_BYTES = 256 * 1024;
+
+		// Uninitialised memory, throws std::bad_alloc. A LargeVector
+		// initialises its elements itself.
+		void* allocate(size_t bytes, const char* name);
+		void deallocate(void* memory, size_t bytes);
+
+		// When disabled new allocations keep to normal pages
+		void set_enabled(bool enabled);
+
+		Mode mode(const void* memory);
+		const char* mode_name(Mode mode);
+
+		// The live allocations with their page mode
+		void report(std::ostream& out);
+
+		// Siika pagebench [mb N] [probes N]
+		// Latency of dependent random probes into a table of mb MB, with
+		// normal pages and then with huge pages.
+		int bench(const std::vector<std::string>& args);
+	}
+
+	// Allocator of a container that holds a big table
+	template <typename T>
+	class LargePageAllocator {
+	public:
+		typedef T value_type;
+
+		explicit LargePageAllocator(const char* name = "table") noexcept : name_(name) {}
+		template <typename U>
+		LargePageAllocator(const LargePageAllocator<U>& other) noexcept : name_(other.name()) {}
+
+		T* allocate(size_t n) { return static_cast<T*>(LargePages::allocate(n * sizeof(T), name_)); }
+		void deallocate(T* p, size_t n) noexcept { LargePages::deallocate(p, n * sizeof(T)); }
+
+		const char* name() const noexcept { return name_; }
+
+	private:
+		const char* name_;
+	};
+
+	template <typename T, typename U>
+	bool operator==(const LargePageAllocator<T>&, const LargePageAllocator<U>&) { return true; }
+	template <typename T, typename U>
+	bool operator!=(const LargePageAllocator<T>&, const LargePageAllocator<U>&) { return false; }
+
+	template <typename T>
+	using LargeVector = std::vector<T, LargePageAllocator<T>>;
+
+	inline const u8* MappedFile::data() const { return data_; }
+	inline size_t MappedFile::size() const { return size_; }
 }
 
 